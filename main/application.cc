@@ -8,9 +8,15 @@
 #include "font_awesome_symbols.h"
 #include "assets/lang_config.h"
 #include "mcp_server.h"
+#include "settings.h"
+#include "boot_profiler.h"
+#include "trace_buffer.h"
+#include "task_monitor.h"
 
 #include <cstring>
+#include <climits>
 #include <esp_log.h>
+#include <esp_app_desc.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
 #include <arpa/inet.h>
@@ -176,6 +182,174 @@ void Application::CheckNewVersion(Ota& ota) {
     }
 }
 
+void Application::CheckNewVersionInBackground() {
+    xTaskCreate([](void* arg) {
+        Application* app = (Application*)arg;
+        app->BackgroundVersionCheck();
+        app->check_new_version_task_handle_ = nullptr;
+        vTaskDelete(NULL);
+    }, "check_version", 4096 * 2, this, 2, &check_new_version_task_handle_);
+}
+
+// Runs while the protocol is starting with the settings of the last boot, quietly retries on failure
+// instead of alerting the user. The new settings take effect on the next connection.
+void Application::BackgroundVersionCheck() {
+    const int MAX_RETRY = 10;
+    int retry_delay = 10; // 初始重试延迟为10秒
+
+    BootSpanScope span("ota_check");
+    auto ota = std::make_unique<Ota>();
+    for (int retry_count = 1; !ota->CheckVersion(); retry_count++) {
+        if (retry_count >= MAX_RETRY) {
+            ESP_LOGE(TAG, "Too many retries, exit version check");
+            return;
+        }
+        ESP_LOGW(TAG, "Check new version failed, retry in %d seconds (%d/%d)", retry_delay, retry_count, MAX_RETRY);
+        vTaskDelay(pdMS_TO_TICKS(retry_delay * 1000));
+        retry_delay *= 2; // 每次重试后延迟时间翻倍
+    }
+
+    if (ota->HasNewVersion() || ota->HasActivationCode() || ota->HasActivationChallenge()) {
+        // The upgrade and the activation need the screen and the speaker. The main loop only claims the
+        // device once it is idle, the blocking download and activation loop run on this task.
+        auto task = xTaskGetCurrentTaskHandle();
+        uint32_t claimed = 0;
+        while (!claimed) {
+            while (device_state_ != kDeviceStateIdle) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+            }
+            Schedule([this, task]() {
+                // The user may have started a conversation in the meantime
+                bool idle = device_state_ == kDeviceStateIdle;
+                if (idle) {
+                    SetDeviceState(kDeviceStateActivating);
+                }
+                xTaskNotify(task, idle, eSetValueWithOverwrite);
+            });
+            xTaskNotifyWait(0, ULONG_MAX, &claimed, portMAX_DELAY);
+        }
+
+        BackgroundUpgradeOrActivate(*ota);
+        return;
+    }
+
+    ota->MarkCurrentVersionValid();
+
+    const char* protocol_type = ota->HasMqttConfig() ? "mqtt" : (ota->HasWebsocketConfig() ? "websocket" : nullptr);
+    if (protocol_type != nullptr) {
+        Settings settings("ota", true);
+        if (settings.GetString("protocol") != protocol_type) {
+            ESP_LOGW(TAG, "Protocol changed to %s, takes effect after restart", protocol_type);
+            settings.SetString("protocol", protocol_type);
+        }
+    }
+
+    bool has_server_time = ota->HasServerTime();
+    Schedule([this, has_server_time]() {
+        has_server_time_ = has_server_time;
+        xEventGroupSetBits(event_group_, MAIN_EVENT_CHECK_NEW_VERSION_DONE);
+    });
+}
+
+// Runs on the check_version task once the device is claimed (kDeviceStateActivating). Only the blocking
+// download and activation requests run here, the device state, the display and the audio service are
+// changed on the main loop.
+void Application::BackgroundUpgradeOrActivate(Ota& ota) {
+    auto& board = Board::GetInstance();
+    auto display = board.GetDisplay();
+
+    if (ota.HasNewVersion()) {
+        Schedule([this]() {
+            Alert(Lang::Strings::OTA_UPGRADE, Lang::Strings::UPGRADING, "happy", Lang::Sounds::P3_UPGRADE);
+        });
+        vTaskDelay(pdMS_TO_TICKS(3000));
+
+        std::string message = std::string(Lang::Strings::NEW_VERSION) + ota.GetFirmwareVersion();
+        ScheduleAndWait([this, &board, display, &message]() {
+            SetDeviceState(kDeviceStateUpgrading);
+            display->SetIcon(FONT_AWESOME_DOWNLOAD);
+            display->SetChatMessage("system", message.c_str());
+            board.SetPowerSaveMode(false);
+            audio_service_.Stop();
+        });
+        vTaskDelay(pdMS_TO_TICKS(1000));
+
+        bool upgrade_success = ota.StartUpgrade([display](int progress, size_t speed) {
+            std::thread([display, progress, speed]() {
+                char buffer[32];
+                snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
+                display->SetChatMessage("system", buffer);
+            }).detach();
+        });
+
+        if (upgrade_success) {
+            ESP_LOGI(TAG, "Firmware upgrade successful, rebooting...");
+            display->SetChatMessage("system", "Upgrade successful, rebooting...");
+            vTaskDelay(pdMS_TO_TICKS(1000)); // Brief pause to show message
+            Reboot();
+            return;
+        }
+
+        // Upgrade failed, restart audio service and continue running
+        ESP_LOGE(TAG, "Firmware upgrade failed, restarting audio service and continuing operation...");
+        ScheduleAndWait([this, &board]() {
+            audio_service_.Start();
+            board.SetPowerSaveMode(true);
+            SetDeviceState(kDeviceStateActivating);
+            Alert(Lang::Strings::ERROR, Lang::Strings::UPGRADE_FAILED, "sad", Lang::Sounds::P3_EXCLAMATION);
+        });
+        vTaskDelay(pdMS_TO_TICKS(3000));
+    }
+
+    ota.MarkCurrentVersionValid();
+    bool activated = !ota.HasActivationCode() && !ota.HasActivationChallenge();
+    if (!activated) {
+        std::string code = ota.GetActivationCode();
+        std::string message = ota.GetActivationMessage();
+        Schedule([this, code, message]() {
+            if (device_state_ != kDeviceStateActivating) {
+                return;
+            }
+            Board::GetInstance().GetDisplay()->SetStatus(Lang::Strings::ACTIVATION);
+            // Activation code is shown to the user and waiting for the user to input
+            if (!code.empty()) {
+                ShowActivationCode(code, message);
+            }
+        });
+
+        // Stops as soon as the user leaves the activation, ToggleChatState() sets the device idle
+        for (int i = 0; i < 10 && device_state_ == kDeviceStateActivating; ++i) {
+            ESP_LOGI(TAG, "Activating... %d/%d", i + 1, 10);
+            esp_err_t err = ota.Activate();
+            if (err == ESP_OK) {
+                activated = true;
+                break;
+            }
+            vTaskDelay(pdMS_TO_TICKS(err == ESP_ERR_TIMEOUT ? 3000 : 10000));
+        }
+    }
+
+    bool has_server_time = ota.HasServerTime();
+    Schedule([this, has_server_time, activated]() {
+        has_server_time_ = has_server_time;
+        if (activated) {
+            xEventGroupSetBits(event_group_, MAIN_EVENT_CHECK_NEW_VERSION_DONE);
+        }
+        if (device_state_ == kDeviceStateActivating) {
+            SetDeviceState(kDeviceStateIdle);
+        }
+    });
+}
+
+void Application::ScheduleAndWait(std::function<void()> callback) {
+    auto task = xTaskGetCurrentTaskHandle();
+    Schedule([task, &callback]() {
+        callback();
+        xTaskNotifyGive(task);
+    });
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
@@ -259,7 +433,7 @@ void Application::ToggleChatState() {
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
-        });
+        }, kTaskPriorityHigh);
     } else if (device_state_ == kDeviceStateListening) {
         Schedule([this]() {
             protocol_->CloseAudioChannel();
@@ -297,7 +471,7 @@ void Application::StartListening() {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
             SetListeningMode(kListeningModeManualStop);
-        });
+        }, kTaskPriorityHigh);
     }
 }
 
@@ -327,13 +501,17 @@ void Application::StopListening() {
 }
 
 void Application::Start() {
+    auto& profiler = BootProfiler::GetInstance();
+    int board_span = profiler.Begin("board");
     auto& board = Board::GetInstance();
     SetDeviceState(kDeviceStateStarting);
 
     /* Setup the display */
     auto display = board.GetDisplay();
+    profiler.End(board_span);
 
     /* Setup the audio service */
+    int audio_span = profiler.Begin("audio");
     auto codec = board.GetAudioCodec();
     audio_service_.Initialize(codec);
     audio_service_.Start();
@@ -349,29 +527,66 @@ void Application::Start() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
     audio_service_.SetCallbacks(callbacks);
+    profiler.End(audio_span);
 
-    /* Start the clock timer to update the status bar */
+    /* Start the clock timer for the task monitor and the debug info */
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
+    // Load the wake word model while the network is starting, the WiFi configuration mode never returns
+    // from StartNetwork() and needs the stack of the main task, so the models go to a helper task instead
+    xTaskCreate([](void* arg) {
+        auto app = (Application*)arg;
+        int span = BootProfiler::GetInstance().Begin("models");
+        app->audio_service_.PreloadWakeWord();
+        BootProfiler::GetInstance().End(span);
+        xEventGroupSetBits(app->event_group_, MAIN_EVENT_MODELS_LOADED);
+        vTaskDelete(NULL);
+    }, "preload_models", 4096 * 2, this, 2, nullptr);
+
     /* Wait for the network to be ready */
+    int network_span = profiler.Begin("network");
     board.StartNetwork();
+    profiler.End(network_span);
 
     // Update the status bar immediately to show the network state
-    display->UpdateStatusBar(true);
+    display->MarkStatusBarDirty(kStatusBarAll);
 
-    // Check for new firmware version or get the MQTT broker address
-    Ota ota;
-    CheckNewVersion(ota);
+    // Add MCP common tools before initializing the protocol
+    McpServer::GetInstance().AddCommonTools();
+
+    int models_span = profiler.Begin("wait_models");
+    xEventGroupWaitBits(event_group_, MAIN_EVENT_MODELS_LOADED, pdTRUE, pdTRUE, portMAX_DELAY);
+    profiler.End(models_span);
+
+    // The protocol chosen by the last version check, empty on the first boot
+    std::string protocol_type = Settings("ota").GetString("protocol");
+    if (protocol_type.empty()) {
+        // Check for new firmware version or get the MQTT broker address, the protocol can't start without it
+        int ota_span = profiler.Begin("ota_check");
+        Ota ota;
+        CheckNewVersion(ota);
+        has_server_time_ = ota.HasServerTime();
+        if (ota.HasMqttConfig()) {
+            protocol_type = "mqtt";
+        } else if (ota.HasWebsocketConfig()) {
+            protocol_type = "websocket";
+        }
+        if (!protocol_type.empty()) {
+            Settings settings("ota", true);
+            settings.SetString("protocol", protocol_type);
+        }
+        profiler.End(ota_span);
+    } else {
+        // The protocol settings are saved from the last boot, check the new version while the protocol starts
+        CheckNewVersionInBackground();
+    }
 
     // Initialize the protocol
     display->SetStatus(Lang::Strings::LOADING_PROTOCOL);
 
-    // Add MCP common tools before initializing the protocol
-    McpServer::GetInstance().AddCommonTools();
-
-    if (ota.HasMqttConfig()) {
+    if (protocol_type == "mqtt") {
         protocol_ = std::make_unique<MqttProtocol>();
-    } else if (ota.HasWebsocketConfig()) {
+    } else if (protocol_type == "websocket") {
         protocol_ = std::make_unique<WebsocketProtocol>();
     } else {
         ESP_LOGW(TAG, "No protocol specified in the OTA config, using MQTT");
@@ -383,6 +598,7 @@ void Application::Start() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+        TRACE_INSTANT("recv_audio", packet->payload.size());
         if (device_state_ == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
@@ -414,6 +630,10 @@ void Application::Start() {
                         SetDeviceState(kDeviceStateSpeaking);
                     }
                 });
+                // Queued behind the sentences of the last answer, which run at the same low priority
+                Schedule([this]() {
+                    new_assistant_message_ = true;
+                }, kTaskPriorityLow);
             } else if (strcmp(state->valuestring, "stop") == 0) {
                 Schedule([this]() {
                     if (device_state_ == kDeviceStateSpeaking) {
@@ -429,8 +649,14 @@ void Application::Start() {
                 if (cJSON_IsString(text)) {
                     ESP_LOGI(TAG, "<< %s", text->valuestring);
                     Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
+                        // The sentences of one answer are streamed into the same message
+                        if (new_assistant_message_) {
+                            new_assistant_message_ = false;
+                            display->SetChatMessage("assistant", message.c_str());
+                        } else {
+                            display->AppendChatMessage("assistant", message.c_str());
+                        }
+                    }, kTaskPriorityLow);
                 }
             }
         } else if (strcmp(type->valuestring, "stt") == 0) {
@@ -439,18 +665,18 @@ void Application::Start() {
                 ESP_LOGI(TAG, ">> %s", text->valuestring);
                 Schedule([this, display, message = std::string(text->valuestring)]() {
                     display->SetChatMessage("user", message.c_str());
-                });
+                }, kTaskPriorityLow);
             }
         } else if (strcmp(type->valuestring, "llm") == 0) {
             auto emotion = cJSON_GetObjectItem(root, "emotion");
             if (cJSON_IsString(emotion)) {
                 Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
                     display->SetEmotion(emotion_str.c_str());
-                });
+                }, kTaskPriorityLow);
             }
         } else if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            if (cJSON_IsObject(payload)) {
+            if (cJSON_IsObject(payload) || cJSON_IsArray(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
         } else if (strcmp(type->valuestring, "system") == 0) {
@@ -482,7 +708,7 @@ void Application::Start() {
             if (cJSON_IsObject(payload)) {
                 Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
                     display->SetChatMessage("system", payload_str.c_str());
-                });
+                }, kTaskPriorityLow);
             } else {
                 ESP_LOGW(TAG, "Invalid custom message format: missing payload");
             }
@@ -491,13 +717,15 @@ void Application::Start() {
             ESP_LOGW(TAG, "Unknown message type: %s", type->valuestring);
         }
     });
+    int protocol_span = profiler.Begin("protocol");
     bool protocol_started = protocol_->Start();
+    profiler.End(protocol_span);
 
     SetDeviceState(kDeviceStateIdle);
+    profiler.Finish();
 
-    has_server_time_ = ota.HasServerTime();
     if (protocol_started) {
-        std::string message = std::string(Lang::Strings::VERSION) + ota.GetCurrentVersion();
+        std::string message = std::string(Lang::Strings::VERSION) + esp_app_get_description()->version;
         display->ShowNotification(message.c_str());
         display->SetChatMessage("system", "");
         // Play the success sound to indicate the device is ready
@@ -511,26 +739,17 @@ void Application::Start() {
 void Application::OnClockTimer() {
     clock_ticks_++;
 
-    auto display = Board::GetInstance().GetDisplay();
-    display->UpdateStatusBar();
+    TaskMonitor::GetInstance().Sample();
 
     // Print the debug info every 10 seconds
     if (clock_ticks_ % 10 == 0) {
         // SystemInfo::PrintTaskCpuUsage(pdMS_TO_TICKS(1000));
         // SystemInfo::PrintTaskList();
         SystemInfo::PrintHeapStats();
+        ESP_LOGI(TAG, "Main loop tasks: %s", scheduler_.GetStatisticsJson().c_str());
     }
 }
 
-// Add a async task to MainLoop
-void Application::Schedule(std::function<void()> callback) {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        main_tasks_.push_back(std::move(callback));
-    }
-    xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
-}
-
 // The Main Event Loop controls the chat state and websocket connection
 // If other tasks need to access the websocket or chat state,
 // they should use Schedule to call this function
@@ -540,6 +759,7 @@ void Application::MainEventLoop() {
 
     while (true) {
         auto bits = xEventGroupWaitBits(event_group_, MAIN_EVENT_SCHEDULE |
+            MAIN_EVENT_CONTROL |
             MAIN_EVENT_SEND_AUDIO |
             MAIN_EVENT_WAKE_WORD_DETECTED |
             MAIN_EVENT_VAD_CHANGE |
@@ -549,11 +769,21 @@ void Application::MainEventLoop() {
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "sad", Lang::Sounds::P3_EXCLAMATION);
         }
 
+        if (bits & MAIN_EVENT_CONTROL) {
+            while (scheduler_.RunOne(kTaskPriorityHigh));
+        }
+
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (!protocol_->SendAudio(std::move(packet))) {
+                TRACE_BEGIN("send_audio");
+                bool sent = protocol_->SendAudio(std::move(packet));
+                TRACE_END("send_audio");
+                if (!sent) {
                     break;
                 }
+                if (xEventGroupClearBits(event_group_, MAIN_EVENT_CONTROL) & MAIN_EVENT_CONTROL) {
+                    while (scheduler_.RunOne(kTaskPriorityHigh));
+                }
             }
         }
 
@@ -569,11 +799,12 @@ void Application::MainEventLoop() {
         }
 
         if (bits & MAIN_EVENT_SCHEDULE) {
-            std::unique_lock<std::mutex> lock(mutex_);
-            auto tasks = std::move(main_tasks_);
-            lock.unlock();
-            for (auto& task : tasks) {
-                task();
+            while (scheduler_.RunOne()) {
+                // Let the audio packets and control tasks go first, come back for the rest later
+                if (xEventGroupGetBits(event_group_) & (MAIN_EVENT_SEND_AUDIO | MAIN_EVENT_CONTROL)) {
+                    xEventGroupSetBits(event_group_, MAIN_EVENT_SCHEDULE);
+                    break;
+                }
             }
         }
     }
@@ -637,6 +868,7 @@ void Application::SetDeviceState(DeviceState state) {
     auto previous_state = device_state_;
     device_state_ = state;
     ESP_LOGI(TAG, "STATE: %s", STATE_STRINGS[device_state_]);
+    TRACE_INSTANT(STATE_STRINGS[device_state_], device_state_);
 
     // Send the state change event
     DeviceStateEventManager::GetInstance().PostStateChangeEvent(previous_state, state);
@@ -662,6 +894,9 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetStatus(Lang::Strings::LISTENING);
             display->SetEmotion("neutral");
 
+            audio_service_.SetSendQueuePolicy(listening_mode_ == kListeningModeRealtime ?
+                kSendQueuePolicyDropOldest : kSendQueuePolicyBlock);
+
             // Make sure the audio processor is running
             if (!audio_service_.IsAudioProcessorRunning()) {
                 // Send the start listening command
@@ -738,7 +973,7 @@ void Application::SendMcpMessage(const std::string& payload) {
         if (protocol_) {
             protocol_->SendMcpMessage(payload);
         }
-    });
+    }, kTaskPriorityHigh);
 }
 
 void Application::SetAecMode(AecMode mode) {
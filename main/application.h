@@ -11,11 +11,13 @@
 #include <deque>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include "protocol.h"
 #include "ota.h"
 #include "audio_service.h"
 #include "device_state_event.h"
+#include "task_queue.h"
 
 #define MAIN_EVENT_SCHEDULE (1 << 0)
 #define MAIN_EVENT_SEND_AUDIO (1 << 1)
@@ -23,6 +25,8 @@
 #define MAIN_EVENT_VAD_CHANGE (1 << 3)
 #define MAIN_EVENT_ERROR (1 << 4)
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
+#define MAIN_EVENT_CONTROL (1 << 6)
+#define MAIN_EVENT_MODELS_LOADED (1 << 7)
 
 enum AecMode {
     kAecOff,
@@ -44,7 +48,15 @@ public:
     void MainEventLoop();
     DeviceState GetDeviceState() const { return device_state_; }
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
-    void Schedule(std::function<void()> callback);
+    // Add a async task to MainLoop, the tasks of a higher priority run first. High priority tasks (abort,
+    // MCP replies...) also run between the queued audio packets, so that they are never stuck behind
+    // seconds of audio on a slow network
+    template<typename F>
+    void Schedule(F&& callback, TaskPriority priority = kTaskPriorityNormal) {
+        scheduler_.Push(priority, std::forward<F>(callback));
+        xEventGroupSetBits(event_group_, priority == kTaskPriorityHigh ? MAIN_EVENT_CONTROL : MAIN_EVENT_SCHEDULE);
+    }
+    std::string GetScheduleStatisticsJson() const { return scheduler_.GetStatisticsJson(); }
     void SetDeviceState(DeviceState state);
     void Alert(const char* status, const char* message, const char* emotion = "", const std::string_view& sound = "");
     void DismissAlert();
@@ -60,13 +72,13 @@ public:
     AecMode GetAecMode() const { return aec_mode_; }
     void PlaySound(const std::string_view& sound);
     AudioService& GetAudioService() { return audio_service_; }
+    Protocol* GetProtocol() { return protocol_.get(); }
 
 private:
     Application();
     ~Application();
 
-    std::mutex mutex_;
-    std::deque<std::function<void()>> main_tasks_;
+    TaskScheduler scheduler_;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -78,11 +90,16 @@ private:
 
     bool has_server_time_ = false;
     bool aborted_ = false;
+    bool new_assistant_message_ = true;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
 
     void OnWakeWordDetected();
     void CheckNewVersion(Ota& ota);
+    void CheckNewVersionInBackground();
+    void BackgroundVersionCheck();
+    void BackgroundUpgradeOrActivate(Ota& ota);
+    void ScheduleAndWait(std::function<void()> callback);
     void ShowActivationCode(const std::string& code, const std::string& message);
     void OnClockTimer();
     void SetListeningMode(ListeningMode mode);
@@ -1,5 +1,8 @@
 #include "audio_service.h"
 #include <esp_log.h>
+#include <algorithm>
+#include "trace_buffer.h"
+#include "heap_profiler.h"
 
 #if CONFIG_USE_AUDIO_PROCESSOR
 #include "processors/afe_audio_processor.h"
@@ -30,6 +33,7 @@ AudioService::~AudioService() {
 
 
 void AudioService::Initialize(AudioCodec* codec) {
+    HeapTagScope heap_tag(kHeapTagAudio);
     codec_ = codec;
     codec_->Start();
 
@@ -151,6 +155,7 @@ void AudioService::Stop() {
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
+    TRACE_SCOPE("audio_read");
     if (!codec_->input_enabled()) {
         esp_timer_stop(audio_power_timer_);
         esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
@@ -206,6 +211,7 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    HeapTagScope heap_tag(kHeapTagAudio);
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -275,6 +281,7 @@ void AudioService::AudioInputTask() {
 }
 
 void AudioService::AudioOutputTask() {
+    HeapTagScope heap_tag(kHeapTagAudio);
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
         audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
@@ -292,7 +299,9 @@ void AudioService::AudioOutputTask() {
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+        TRACE_BEGIN("i2s_write");
         codec_->OutputData(task->pcm);
+        TRACE_END("i2s_write");
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
@@ -311,11 +320,12 @@ void AudioService::AudioOutputTask() {
 }
 
 void AudioService::OpusCodecTask() {
+    HeapTagScope heap_tag(kHeapTagAudio);
     while (true) {
         std::unique_lock<std::mutex> lock(audio_queue_mutex_);
         audio_queue_cv_.wait(lock, [this]() {
             return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
+                (!audio_encode_queue_.empty() && !IsSendQueueBlocked()) ||
                 (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
         });
         if (service_stopped_) {
@@ -333,8 +343,11 @@ void AudioService::OpusCodecTask() {
             task->type = kAudioTaskTypeDecodeToPlaybackQueue;
             task->timestamp = packet->timestamp;
 
+            TRACE_BEGIN("opus_decode");
             SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
+            bool decoded = opus_decoder_->Decode(std::move(packet->payload), task->pcm);
+            TRACE_END("opus_decode");
+            if (decoded) {
                 // Resample if the sample rate is different
                 if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
                     int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
@@ -354,7 +367,7 @@ void AudioService::OpusCodecTask() {
         }
         
         /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
+        if (!audio_encode_queue_.empty() && !IsSendQueueBlocked()) {
             auto task = std::move(audio_encode_queue_.front());
             audio_encode_queue_.pop_front();
             audio_queue_cv_.notify_all();
@@ -364,16 +377,16 @@ void AudioService::OpusCodecTask() {
             packet->frame_duration = OPUS_FRAME_DURATION_MS;
             packet->sample_rate = 16000;
             packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
+            TRACE_BEGIN("opus_encode");
+            bool encoded = opus_encoder_->Encode(std::move(task->pcm), packet->payload);
+            TRACE_END("opus_encode");
+            if (!encoded) {
                 ESP_LOGE(TAG, "Failed to encode audio");
                 continue;
             }
 
             if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
+                PushPacketToSendQueue(std::move(packet));
                 if (callbacks_.on_send_queue_available) {
                     callbacks_.on_send_queue_available();
                 }
@@ -437,10 +450,70 @@ bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> pa
         }
     }
     audio_decode_queue_.push_back(std::move(packet));
+    TRACE_COUNTER("decode_queue", audio_decode_queue_.size());
     audio_queue_cv_.notify_all();
     return true;
 }
 
+bool AudioService::IsSendQueueBlocked() const {
+    return send_queue_policy_ == kSendQueuePolicyBlock && audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE;
+}
+
+void AudioService::PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    if (audio_send_queue_.size() >= MAX_SEND_PACKETS_IN_QUEUE) {
+        // Only reached with the drop-oldest policy, the next packet carries the gap
+        auto dropped = std::move(audio_send_queue_.front());
+        audio_send_queue_.pop_front();
+        auto& next = audio_send_queue_.empty() ? packet : audio_send_queue_.front();
+        next->gap += dropped->gap + 1;
+        if (send_queue_statistics_.dropped_packets++ == 0) {
+            ESP_LOGW(TAG, "Send queue is full, dropping the oldest packets");
+        }
+    }
+    audio_send_queue_.push_back(std::move(packet));
+
+    auto size = audio_send_queue_.size();
+    TRACE_COUNTER("send_queue", size);
+    auto bucket = std::min<size_t>(size * SEND_QUEUE_HISTOGRAM_BUCKETS / MAX_SEND_PACKETS_IN_QUEUE, SEND_QUEUE_HISTOGRAM_BUCKETS - 1);
+    send_queue_statistics_.occupancy[bucket]++;
+    if (size > send_queue_statistics_.max_occupancy) {
+        send_queue_statistics_.max_occupancy = size;
+    }
+    if (size >= MAX_SEND_PACKETS_IN_QUEUE) {
+        send_queue_statistics_.full_count++;
+        if (send_queue_policy_ == kSendQueuePolicyBlock) {
+            ESP_LOGW(TAG, "Send queue is full, stop encoding");
+        }
+    }
+}
+
+void AudioService::SetSendQueuePolicy(SendQueuePolicy policy) {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    send_queue_policy_ = policy;
+    audio_queue_cv_.notify_all();
+}
+
+std::string AudioService::GetSendQueueStatisticsJson() {
+    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
+    std::string json = "{\"policy\":\"";
+    json += send_queue_policy_ == kSendQueuePolicyDropOldest ? "drop_oldest" : "block";
+    json += "\",\"capacity\":" + std::to_string(MAX_SEND_PACKETS_IN_QUEUE);
+    json += ",\"size\":" + std::to_string(audio_send_queue_.size());
+    json += ",\"max\":" + std::to_string(send_queue_statistics_.max_occupancy);
+    json += ",\"full\":" + std::to_string(send_queue_statistics_.full_count);
+    json += ",\"dropped\":" + std::to_string(send_queue_statistics_.dropped_packets);
+    json += ",\"histogram\":[";
+    for (int i = 0; i < SEND_QUEUE_HISTOGRAM_BUCKETS; i++) {
+        if (i > 0) {
+            json += ",";
+        }
+        json += std::to_string(send_queue_statistics_.occupancy[i]);
+    }
+    json += "]}";
+    return json;
+}
+
 std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
     std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     if (audio_send_queue_.empty()) {
@@ -471,6 +544,7 @@ std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
+    HeapTagScope heap_tag(kHeapTagAudio);
     if (!wake_word_) {
         return;
     }
@@ -492,7 +566,21 @@ void AudioService::EnableWakeWordDetection(bool enable) {
     }
 }
 
+void AudioService::PreloadWakeWord() {
+    HeapTagScope heap_tag(kHeapTagAudio);
+    if (!wake_word_ || wake_word_initialized_) {
+        return;
+    }
+    if (!wake_word_->Initialize(codec_)) {
+        // EnableWakeWordDetection() tries again when the device becomes idle
+        ESP_LOGE(TAG, "Failed to preload wake word");
+        return;
+    }
+    wake_word_initialized_ = true;
+}
+
 void AudioService::EnableVoiceProcessing(bool enable) {
+    HeapTagScope heap_tag(kHeapTagAudio);
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
@@ -2,6 +2,7 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
+#include <atomic>
 #include <deque>
 #include <condition_variable>
 #include <chrono>
@@ -42,6 +43,8 @@
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
 
+#define SEND_QUEUE_HISTOGRAM_BUCKETS 8
+
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
 
@@ -71,6 +74,26 @@ struct AudioTask {
     uint32_t timestamp;
 };
 
+/*
+ * What the Opus encoder does when the send queue is full (the network can't keep up):
+ * - Block: stop encoding until the queue drains, the mic path backs up. Used in auto / manual stop mode,
+ *   where the server needs the whole utterance.
+ * - DropOldest: drop the oldest packet and mark the gap on the next one. Used in realtime mode,
+ *   where a fresh barge-in matters more than seconds of stale audio.
+ */
+enum SendQueuePolicy {
+    kSendQueuePolicyBlock,
+    kSendQueuePolicyDropOldest,
+};
+
+struct SendQueueStatistics {
+    // Queue occupancy sampled on every push, bucket i covers [i, i + 1) * MAX_SEND_PACKETS_IN_QUEUE / SEND_QUEUE_HISTOGRAM_BUCKETS
+    uint32_t occupancy[SEND_QUEUE_HISTOGRAM_BUCKETS] = {};
+    uint32_t max_occupancy = 0;
+    uint32_t full_count = 0;
+    uint32_t dropped_packets = 0;
+};
+
 struct DebugStatistics {
     uint32_t input_count = 0;
     uint32_t decode_count = 0;
@@ -95,11 +118,15 @@ public:
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
 
     void EnableWakeWordDetection(bool enable);
+    // Load the wake word model ahead of the first idle state, may run on another task during the startup
+    void PreloadWakeWord();
     void EnableVoiceProcessing(bool enable);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
+    void SetSendQueuePolicy(SendQueuePolicy policy);
+    std::string GetSendQueueStatisticsJson();
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
@@ -119,6 +146,8 @@ private:
     OpusResampler reference_resampler_;
     OpusResampler output_resampler_;
     DebugStatistics debug_statistics_;
+    SendQueueStatistics send_queue_statistics_;
+    SendQueuePolicy send_queue_policy_ = kSendQueuePolicyBlock;
 
     EventGroupHandle_t event_group_;
 
@@ -136,7 +165,8 @@ private:
     // For server AEC
     std::deque<uint32_t> timestamp_queue_;
 
-    bool wake_word_initialized_ = false;
+    // Set by the preload task at startup and by the main loop
+    std::atomic<bool> wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
     bool service_stopped_ = true;
@@ -150,6 +180,8 @@ private:
     void AudioOutputTask();
     void OpusCodecTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    void PushPacketToSendQueue(std::unique_ptr<AudioStreamPacket> packet);
+    bool IsSendQueueBlocked() const;
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
     void CheckAndUpdateAudioPowerState();
 };
@@ -1,5 +1,7 @@
 #include "afe_audio_processor.h"
 #include <esp_log.h>
+#include "trace_buffer.h"
+#include "heap_profiler.h"
 
 #define PROCESSOR_RUNNING 0x01
 
@@ -115,6 +117,7 @@ void AfeAudioProcessor::OnVadStateChange(std::function<void(bool speaking)> call
 }
 
 void AfeAudioProcessor::AudioProcessorTask() {
+    HeapTagScope heap_tag(kHeapTagAudio);
     auto fetch_size = afe_iface_->get_fetch_chunksize(afe_data_);
     auto feed_size = afe_iface_->get_feed_chunksize(afe_data_);
     ESP_LOGI(TAG, "Audio communication task started, feed size: %d fetch size: %d",
@@ -133,6 +136,7 @@ void AfeAudioProcessor::AudioProcessorTask() {
             }
             continue;
         }
+        TRACE_INSTANT("afe_fetch", res->data_size);
 
         // VAD state change
         if (vad_state_change_callback_) {
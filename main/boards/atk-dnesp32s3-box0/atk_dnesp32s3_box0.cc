@@ -268,11 +268,13 @@ private:
             }
             codec->SetOutputVolume(volume);
             GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         left_button_.OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(0);
             GetDisplay()->ShowNotification(Lang::Strings::MUTED);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         right_button_.OnClick([this]() {
@@ -287,11 +289,13 @@ private:
             }
             codec->SetOutputVolume(volume);
             GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         right_button_.OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(100);
             GetDisplay()->ShowNotification(Lang::Strings::MAX_VOLUME);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
 
@@ -138,16 +138,19 @@ private:
             codec->SetOutputVolume(volume);
         }
         GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+        GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
     }
 
     void audio_volume_minimum(){
         GetAudioCodec()->SetOutputVolume(0);
         GetDisplay()->ShowNotification(Lang::Strings::MUTED);
+        GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
     }
 
     void audio_volume_maxmum(){
         GetAudioCodec()->SetOutputVolume(100);
         GetDisplay()->ShowNotification(Lang::Strings::MAX_VOLUME);
+        GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
     }
 
     esp_err_t IoExpanderSetLevel(uint16_t pin_mask, uint8_t level) {
@@ -74,11 +74,13 @@ private:
             }
             codec->SetOutputVolume(volume);
             GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         volume_up_button_.OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(100);
             GetDisplay()->ShowNotification(Lang::Strings::MAX_VOLUME);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         volume_down_button_.OnClick([this]() {
@@ -89,11 +91,13 @@ private:
             }
             codec->SetOutputVolume(volume);
             GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         volume_down_button_.OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(0);
             GetDisplay()->ShowNotification(Lang::Strings::MUTED);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         //不插耳机
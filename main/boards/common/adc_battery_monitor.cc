@@ -1,4 +1,6 @@
 #include "adc_battery_monitor.h"
+#include "board.h"
+#include "display.h"
 
 AdcBatteryMonitor::AdcBatteryMonitor(adc_unit_t adc_unit, adc_channel_t adc_channel, float upper_resistor, float lower_resistor, gpio_num_t charging_pin)
     : charging_pin_(charging_pin) {
@@ -74,6 +76,7 @@ void AdcBatteryMonitor::CheckBatteryStatus() {
     bool new_charging_status = IsCharging();
     if (new_charging_status != is_charging_) {
         is_charging_ = new_charging_status;
+        Board::GetInstance().GetDisplay()->MarkStatusBarDirty(kStatusBarBattery);
         if (on_charging_status_changed_) {
             on_charging_status_changed_(is_charging_);
         }
@@ -3,68 +3,123 @@
 #include "display.h"
 #include "board.h"
 #include "system_info.h"
+#include "heap_profiler.h"
 
 #include <esp_log.h>
 #include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <img_converters.h>
 #include <cstring>
+#include <cstdlib>
 
 #define TAG "Esp32Camera"
 
-Esp32Camera::Esp32Camera(const camera_config_t& config) {
-    // camera init
-    esp_err_t err = esp_camera_init(&config); // 配置上面定义的参数
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Camera init failed with error 0x%x", err);
-        return;
+// Minimum interval between two partial answers reported while the answer arrives
+#define EXPLAIN_PROGRESS_INTERVAL_MS 500
+
+// Length of the longest prefix of text that doesn't end inside a UTF-8 sequence
+static size_t Utf8CompleteLength(const std::string& text) {
+    size_t end = text.size();
+    size_t lead = end;
+    while (lead > 0 && end - lead < 4 && ((uint8_t)text[lead - 1] & 0xC0) == 0x80) {
+        lead--;
     }
+    if (lead == 0) {
+        return end;
+    }
+    uint8_t c = text[lead - 1];
+    size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return end - (lead - 1) >= need ? end : lead - 1;
+}
 
-    sensor_t *s = esp_camera_sensor_get(); // 获取摄像头型号
-    if (s->id.PID == GC0308_PID) {
-        s->set_hmirror(s, 0);  // 这里控制摄像头镜像 写1镜像 写0不镜像
+static void AppendUtf8(std::string& text, uint32_t code) {
+    if (code < 0x80) {
+        text += (char)code;
+    } else if (code < 0x800) {
+        text += (char)(0xC0 | (code >> 6));
+        text += (char)(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        text += (char)(0xE0 | (code >> 12));
+        text += (char)(0x80 | ((code >> 6) & 0x3F));
+        text += (char)(0x80 | (code & 0x3F));
+    } else {
+        text += (char)(0xF0 | (code >> 18));
+        text += (char)(0x80 | ((code >> 12) & 0x3F));
+        text += (char)(0x80 | ((code >> 6) & 0x3F));
+        text += (char)(0x80 | (code & 0x3F));
     }
+}
 
-    // 初始化预览图片的内存
-    memset(&preview_image_, 0, sizeof(preview_image_));
-    preview_image_.header.magic = LV_IMAGE_HEADER_MAGIC;
-    preview_image_.header.cf = LV_COLOR_FORMAT_RGB565;
-    preview_image_.header.flags = LV_IMAGE_FLAGS_ALLOCATED | LV_IMAGE_FLAGS_MODIFIABLE;
+/*
+ * The answer text received so far, from the partial response body: the "result" string of the
+ * JSON response, decoded up to the last complete escape sequence, or the body itself if it is not JSON.
+ */
+static std::string GetPartialAnswer(const std::string& body) {
+    size_t pos = body.find_first_not_of(" \t\r\n");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    if (body[pos] != '{') {
+        return body;
+    }
+    pos = body.find("\"result\"", pos);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos = body.find('"', body.find(':', pos + 8));
+    if (pos == std::string::npos) {
+        return "";
+    }
 
-    switch (config.frame_size) {
-        case FRAMESIZE_SVGA:
-            preview_image_.header.w = 800;
-            preview_image_.header.h = 600;
+    std::string text;
+    for (size_t i = pos + 1; i < body.size(); i++) {
+        char c = body[i];
+        if (c == '"') {
             break;
-        case FRAMESIZE_VGA:
-            preview_image_.header.w = 640;
-            preview_image_.header.h = 480;
-            break;
-        case FRAMESIZE_QVGA:
-            preview_image_.header.w = 320;
-            preview_image_.header.h = 240;
-            break;
-        case FRAMESIZE_128X128:
-            preview_image_.header.w = 128;
-            preview_image_.header.h = 128;
+        }
+        if (c != '\\') {
+            text += c;
+            continue;
+        }
+        if (i + 1 >= body.size()) {
             break;
-        case FRAMESIZE_240X240:
-            preview_image_.header.w = 240;
-            preview_image_.header.h = 240;
+        }
+        c = body[++i];
+        if (c != 'u') {
+            text += c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c == 'b' ? '\b' : c == 'f' ? '\f' : c;
+            continue;
+        }
+        if (i + 4 >= body.size()) {
             break;
-        default:
-            ESP_LOGE(TAG, "Unsupported frame size: %d, image preview will not be shown", config.frame_size);
-            preview_image_.data_size = 0;
-            preview_image_.data = nullptr;
-            return;
+        }
+        uint32_t code = strtoul(body.substr(i + 1, 4).c_str(), nullptr, 16);
+        i += 4;
+        if (code >= 0xD800 && code < 0xDC00) {
+            // Surrogate pair
+            if (i + 6 >= body.size()) {
+                break;
+            }
+            uint32_t low = strtoul(body.substr(i + 3, 4).c_str(), nullptr, 16);
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            i += 6;
+        }
+        AppendUtf8(text, code);
     }
+    return text;
+}
 
-    preview_image_.header.stride = preview_image_.header.w * 2;
-    preview_image_.data_size = preview_image_.header.w * preview_image_.header.h * 2;
-    preview_image_.data = (uint8_t*)heap_caps_malloc(preview_image_.data_size, MALLOC_CAP_SPIRAM);
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
+Esp32Camera::Esp32Camera(const camera_config_t& config) {
+    // camera init
+    esp_err_t err = esp_camera_init(&config); // 配置上面定义的参数
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Camera init failed with error 0x%x", err);
         return;
     }
+
+    sensor_t *s = esp_camera_sensor_get(); // 获取摄像头型号
+    if (s->id.PID == GC0308_PID) {
+        s->set_hmirror(s, 0);  // 这里控制摄像头镜像 写1镜像 写0不镜像
+    }
 }
 
 Esp32Camera::~Esp32Camera() {
@@ -72,10 +127,6 @@ Esp32Camera::~Esp32Camera() {
         esp_camera_fb_return(fb_);
         fb_ = nullptr;
     }
-    if (preview_image_.data) {
-        heap_caps_free((void*)preview_image_.data);
-        preview_image_.data = nullptr;
-    }
     esp_camera_deinit();
 }
 
@@ -85,6 +136,7 @@ void Esp32Camera::SetExplainUrl(const std::string& url, const std::string& token
 }
 
 bool Esp32Camera::Capture() {
+    HeapTagScope heap_tag(kHeapTagCamera);
     if (encoder_thread_.joinable()) {
         encoder_thread_.join();
     }
@@ -102,30 +154,72 @@ bool Esp32Camera::Capture() {
         }
     }
 
-    // 如果预览图片 buffer 为空，则跳过预览
-    // 但仍返回 true，因为此时图像可以上传至服务器
-    if (preview_image_.data_size == 0) {
-        ESP_LOGW(TAG, "Skip preview because of unsupported frame size");
+    // 显示预览图片
+    auto display = Board::GetInstance().GetDisplay();
+    if (display == nullptr) {
         return true;
     }
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Preview image data is not initialized");
+    // 非 RGB565 格式跳过预览，但仍返回 true，因为此时图像可以上传至服务器
+    if (fb_->format != PIXFORMAT_RGB565) {
+        ESP_LOGW(TAG, "Skip preview because of unsupported pixel format: %d", fb_->format);
         return true;
     }
-    // 显示预览图片
-    auto display = Board::GetInstance().GetDisplay();
-    if (display != nullptr) {
-        auto src = (uint16_t*)fb_->buf;
-        auto dst = (uint16_t*)preview_image_.data;
-        size_t pixel_count = fb_->len / 2;
-        for (size_t i = 0; i < pixel_count; i++) {
-            // 交换每个16位字内的字节
-            dst[i] = __builtin_bswap16(src[i]);
+
+    // Resample the frame to the largest size that fits GetPreviewMaxSize(), the display shows it unscaled
+    int max_width, max_height;
+    display->GetPreviewMaxSize(max_width, max_height);
+    int width, height;
+    if (fb_->width * max_height <= fb_->height * max_width) {
+        height = max_height;
+        width = fb_->width * max_height / fb_->height;
+    } else {
+        width = max_width;
+        height = fb_->height * max_width / fb_->width;
+    }
+    if (width <= 0 || height <= 0) {
+        return true;
+    }
+
+    // Write into the last preview if the display doesn't show it anymore
+    if (preview_image_ == nullptr || preview_image_.use_count() > 1 ||
+        preview_image_->width() != width || preview_image_->height() != height) {
+        preview_image_ = std::make_shared<PreviewImage>(width, height);
+    }
+    if (!preview_image_->valid()) {
+        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
+        preview_image_.reset();
+        return true;
+    }
+
+    // The camera outputs big endian RGB565, swap the bytes while resampling in one pass
+    auto dst = preview_image_->pixels();
+    if (width == (int)fb_->width && height == (int)fb_->height && (width & 1) == 0) {
+        // Two pixels per word
+        auto src = (const uint32_t*)fb_->buf;
+        auto dst32 = (uint32_t*)dst;
+        size_t word_count = (size_t)width * height / 2;
+        for (size_t i = 0; i < word_count; i++) {
+            uint32_t x = src[i];
+            dst32[i] = ((x & 0xFF00FF00) >> 8) | ((x & 0x00FF00FF) << 8);
+        }
+    } else {
+        // Nearest neighbour with 16.16 fixed point steps
+        auto src = (const uint16_t*)fb_->buf;
+        uint32_t x_step = ((uint32_t)fb_->width << 16) / width;
+        uint32_t y_step = ((uint32_t)fb_->height << 16) / height;
+        uint32_t src_y = 0;
+        for (int y = 0; y < height; y++, src_y += y_step) {
+            auto row = src + (size_t)(src_y >> 16) * fb_->width;
+            uint32_t src_x = 0;
+            for (int x = 0; x < width; x++, src_x += x_step) {
+                *dst++ = __builtin_bswap16(row[src_x >> 16]);
+            }
         }
-        display->SetPreviewImage(&preview_image_);
     }
+    display->SetPreviewImage(preview_image_);
     return true;
 }
+
 bool Esp32Camera::SetHMirror(bool enabled) {
     sensor_t *s = esp_camera_sensor_get();
     if (s == nullptr) {
@@ -184,10 +278,18 @@ bool Esp32Camera::SetVFlip(bool enabled) {
  * @warning 如果摄像头缓冲区为空或网络连接失败，将返回错误信息
  */
 std::string Esp32Camera::Explain(const std::string& question) {
+    HeapTagScope heap_tag(kHeapTagCamera);
     if (explain_url_.empty()) {
         return "{\"success\": false, \"message\": \"Image explain URL or token is not set\"}";
     }
 
+    // Called from the MCP tool call, report the progress and stop early once the call is cancelled
+    auto tool_call = McpToolCall::Current();
+    int progress = 0;
+    if (tool_call != nullptr) {
+        tool_call->ReportProgress(++progress, 0, "Uploading photo");
+    }
+
     // 创建局部的 JPEG 队列, 40 entries is about to store 512 * 40 = 20480 bytes of JPEG data
     QueueHandle_t jpeg_queue = xQueueCreate(40, sizeof(JpegChunk));
     if (jpeg_queue == nullptr) {
@@ -259,6 +361,7 @@ std::string Esp32Camera::Explain(const std::string& question) {
 
     // 第三块：JPEG数据
     size_t total_sent = 0;
+    bool cancelled = false;
     while (true) {
         JpegChunk chunk;
         if (xQueueReceive(jpeg_queue, &chunk, portMAX_DELAY) != pdPASS) {
@@ -268,8 +371,12 @@ std::string Esp32Camera::Explain(const std::string& question) {
         if (chunk.data == nullptr) {
             break; // The last chunk
         }
-        http->Write((const char*)chunk.data, chunk.len);
-        total_sent += chunk.len;
+        // Keep draining the queue after cancellation so that the encoder thread can finish
+        cancelled = cancelled || (tool_call != nullptr && tool_call->IsCancelled());
+        if (!cancelled) {
+            http->Write((const char*)chunk.data, chunk.len);
+            total_sent += chunk.len;
+        }
         heap_caps_free(chunk.data);
     }
     // Wait for the encoder thread to finish
@@ -277,6 +384,12 @@ std::string Esp32Camera::Explain(const std::string& question) {
     // 清理队列
     vQueueDelete(jpeg_queue);
 
+    if (cancelled) {
+        ESP_LOGW(TAG, "Explain cancelled after sending %d bytes", total_sent);
+        http->Close();
+        return "{\"success\": false, \"message\": \"Cancelled\"}";
+    }
+
     {
         // 第四块：multipart尾部
         std::string multipart_footer;
@@ -291,7 +404,35 @@ std::string Esp32Camera::Explain(const std::string& question) {
         return "{\"success\": false, \"message\": \"Failed to upload photo\"}";
     }
 
-    std::string result = http->ReadAll();
+    // Read the answer in chunks and forward the new answer text as a partial result while it arrives,
+    // at most every EXPLAIN_PROGRESS_INTERVAL_MS and never in the middle of a UTF-8 character
+    std::string result;
+    char buffer[512];
+    size_t reported_length = 0;
+    int64_t last_report_time = 0;
+    while (true) {
+        int ret = http->Read(buffer, sizeof(buffer));
+        if (ret <= 0) {
+            break;
+        }
+        result.append(buffer, ret);
+        if (tool_call != nullptr) {
+            if (tool_call->IsCancelled()) {
+                break;
+            }
+            int64_t now = esp_timer_get_time();
+            if (now - last_report_time < EXPLAIN_PROGRESS_INTERVAL_MS * 1000) {
+                continue;
+            }
+            auto answer = GetPartialAnswer(result);
+            size_t length = Utf8CompleteLength(answer);
+            if (length > reported_length) {
+                tool_call->ReportProgress(++progress, 0, answer.substr(reported_length, length - reported_length));
+                reported_length = length;
+                last_report_time = now;
+            }
+        }
+    }
     http->Close();
 
     // Get remain task stack size
@@ -10,6 +10,7 @@
 #include <freertos/queue.h>
 
 #include "camera.h"
+#include "preview_image.h"
 
 struct JpegChunk {
     uint8_t* data;
@@ -19,7 +20,8 @@ struct JpegChunk {
 class Esp32Camera : public Camera {
 private:
     camera_fb_t* fb_ = nullptr;
-    lv_img_dsc_t preview_image_;
+    // Shared with the display, reused once the display releases it
+    std::shared_ptr<PreviewImage> preview_image_;
     std::string explain_url_;
     std::string explain_token_;
     std::thread encoder_thread_;
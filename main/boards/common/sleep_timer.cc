@@ -88,7 +88,7 @@ void SleepTimer::CheckTimer() {
             app.Schedule([this, &app]() {
                 while (in_light_sleep_mode_) {
                     auto& board = Board::GetInstance();
-                    board.GetDisplay()->UpdateStatusBar(true);
+                    board.GetDisplay()->MarkStatusBarDirty(kStatusBarAll);
                     lv_refr_now(nullptr);
                     lvgl_port_stop();
     
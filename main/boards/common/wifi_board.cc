@@ -104,6 +104,7 @@ void WifiBoard::StartNetwork() {
         std::string notification = Lang::Strings::CONNECTED_TO;
         notification += ssid;
         display->ShowNotification(notification.c_str(), 30000);
+        display->MarkStatusBarDirty(kStatusBarNetwork);
     });
     wifi_station.Start();
 
@@ -136,6 +136,7 @@ private:
             }
             codec->SetOutputVolume(volume);
             self->GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            self->GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         }, this);
 
         // Button B
@@ -166,6 +167,7 @@ private:
             }
             codec->SetOutputVolume(volume);
             self->GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+            self->GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         }, this);
     }
 
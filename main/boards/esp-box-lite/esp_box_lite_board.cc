@@ -98,6 +98,7 @@ private:
         }
         codec->SetOutputVolume(volume);
         GetDisplay()->ShowNotification(Lang::Strings::VOLUME + std::to_string(volume));
+        GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
     }
     
     void TogleState() {
@@ -140,6 +141,7 @@ private:
         volume_up_button->OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(100);
             GetDisplay()->ShowNotification(Lang::Strings::MAX_VOLUME);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         auto volume_down_button = adc_button_[BSP_ADC_BUTTON_PREV];
@@ -147,6 +149,7 @@ private:
         volume_down_button->OnLongPress([this]() {
             GetAudioCodec()->SetOutputVolume(0);
             GetDisplay()->ShowNotification(Lang::Strings::MUTED);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         });
 
         auto break_button = adc_button_[BSP_ADC_BUTTON_ENTER];
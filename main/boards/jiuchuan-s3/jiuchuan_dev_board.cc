@@ -251,6 +251,7 @@ private:
             current_vol = (current_vol + 8 > 80) ? 80 : current_vol + 8;
             
             codec->SetOutputVolume(current_vol);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
 
             ESP_LOGI(TAG, "Current volume: %d", current_vol);
             int display_volume = MapVolumeForDisplay(current_vol);
@@ -266,6 +267,7 @@ private:
             current_vol = (current_vol - 8 < 0) ? 0 : current_vol - 8;
             
             codec->SetOutputVolume(current_vol);
+            GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
 
             ESP_LOGI(TAG, "Current volume: %d", current_vol);
             if (current_vol == 0) {
@@ -197,188 +197,137 @@ public:
         ESP_LOGI(TAG, "开始注册MCP工具...");
 
         // 基础移动动作
-        mcp_server.AddTool("self.otto.walk_forward",
-                           "行走。steps: 行走步数(1-100); speed: 行走速度(500-1500，数值越小越快); "
-                           "direction: 行走方向(-1=后退, 1=前进); arm_swing: 手臂摆动幅度(0-170度)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 3, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("arm_swing", kPropertyTypeInteger, 50, 0, 170),
-                                         Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int arm_swing = properties["arm_swing"].value<int>();
-                               int direction = properties["direction"].value<int>();
-                               QueueAction(ACTION_WALK, steps, speed, direction, arm_swing);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.turn_left",
-                           "转身。steps: 转身步数(1-100); speed: 转身速度(500-1500，数值越小越快); "
-                           "direction: 转身方向(1=左转, -1=右转); arm_swing: 手臂摆动幅度(0-170度)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 3, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("arm_swing", kPropertyTypeInteger, 50, 0, 170),
-                                         Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int arm_swing = properties["arm_swing"].value<int>();
-                               int direction = properties["direction"].value<int>();
-                               QueueAction(ACTION_TURN, steps, speed, direction, arm_swing);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.jump",
-                           "跳跃。steps: 跳跃次数(1-100); speed: 跳跃速度(500-1500，数值越小越快)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 1, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               QueueAction(ACTION_JUMP, steps, speed, 0, 0);
-                               return true;
-                           });
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 3>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"arm_swing", 0, 170, 50>, McpInt<"direction", -1, 1, 1>>(
+            "self.otto.walk_forward",
+            "行走。steps: 行走步数(1-100); speed: 行走速度(500-1500，数值越小越快); "
+            "direction: 行走方向(-1=后退, 1=前进); arm_swing: 手臂摆动幅度(0-170度)",
+            [this](int steps, int speed, int arm_swing, int direction) -> ReturnValue {
+                QueueAction(ACTION_WALK, steps, speed, direction, arm_swing);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 3>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"arm_swing", 0, 170, 50>, McpInt<"direction", -1, 1, 1>>(
+            "self.otto.turn_left",
+            "转身。steps: 转身步数(1-100); speed: 转身速度(500-1500，数值越小越快); "
+            "direction: 转身方向(1=左转, -1=右转); arm_swing: 手臂摆动幅度(0-170度)",
+            [this](int steps, int speed, int arm_swing, int direction) -> ReturnValue {
+                QueueAction(ACTION_TURN, steps, speed, direction, arm_swing);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 1>, McpInt<"speed", 500, 1500, 1000>>(
+            "self.otto.jump",
+            "跳跃。steps: 跳跃次数(1-100); speed: 跳跃速度(500-1500，数值越小越快)",
+            [this](int steps, int speed) -> ReturnValue {
+                QueueAction(ACTION_JUMP, steps, speed, 0, 0);
+                return true;
+            });
 
         // 特殊动作
-        mcp_server.AddTool("self.otto.swing",
-                           "左右摇摆。steps: 摇摆次数(1-100); speed: "
-                           "摇摆速度(500-1500，数值越小越快); amount: 摇摆幅度(0-170度)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 3, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("amount", kPropertyTypeInteger, 30, 0, 170)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int amount = properties["amount"].value<int>();
-                               QueueAction(ACTION_SWING, steps, speed, 0, amount);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.moonwalk",
-                           "太空步。steps: 太空步步数(1-100); speed: 速度(500-1500，数值越小越快); "
-                           "direction: 方向(1=左, -1=右); amount: 幅度(0-170度)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 3, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("direction", kPropertyTypeInteger, 1, -1, 1),
-                                         Property("amount", kPropertyTypeInteger, 25, 0, 170)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int direction = properties["direction"].value<int>();
-                               int amount = properties["amount"].value<int>();
-                               QueueAction(ACTION_MOONWALK, steps, speed, direction, amount);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.bend",
-                           "弯曲身体。steps: 弯曲次数(1-100); speed: "
-                           "弯曲速度(500-1500，数值越小越快); direction: 弯曲方向(1=左, -1=右)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 1, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int direction = properties["direction"].value<int>();
-                               QueueAction(ACTION_BEND, steps, speed, direction, 0);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.shake_leg",
-                           "摇腿。steps: 摇腿次数(1-100); speed: 摇腿速度(500-1500，数值越小越快); "
-                           "direction: 腿部选择(1=左腿, -1=右腿)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 1, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int direction = properties["direction"].value<int>();
-                               QueueAction(ACTION_SHAKE_LEG, steps, speed, direction, 0);
-                               return true;
-                           });
-
-        mcp_server.AddTool("self.otto.updown",
-                           "上下运动。steps: 上下运动次数(1-100); speed: "
-                           "运动速度(500-1500，数值越小越快); amount: 运动幅度(0-170度)",
-                           PropertyList({Property("steps", kPropertyTypeInteger, 3, 1, 100),
-                                         Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                                         Property("amount", kPropertyTypeInteger, 20, 0, 170)}),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               int steps = properties["steps"].value<int>();
-                               int speed = properties["speed"].value<int>();
-                               int amount = properties["amount"].value<int>();
-                               QueueAction(ACTION_UPDOWN, steps, speed, 0, amount);
-                               return true;
-                           });
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 3>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"amount", 0, 170, 30>>(
+            "self.otto.swing",
+            "左右摇摆。steps: 摇摆次数(1-100); speed: "
+            "摇摆速度(500-1500，数值越小越快); amount: 摇摆幅度(0-170度)",
+            [this](int steps, int speed, int amount) -> ReturnValue {
+                QueueAction(ACTION_SWING, steps, speed, 0, amount);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 3>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"direction", -1, 1, 1>, McpInt<"amount", 0, 170, 25>>(
+            "self.otto.moonwalk",
+            "太空步。steps: 太空步步数(1-100); speed: 速度(500-1500，数值越小越快); "
+            "direction: 方向(1=左, -1=右); amount: 幅度(0-170度)",
+            [this](int steps, int speed, int direction, int amount) -> ReturnValue {
+                QueueAction(ACTION_MOONWALK, steps, speed, direction, amount);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 1>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"direction", -1, 1, 1>>(
+            "self.otto.bend",
+            "弯曲身体。steps: 弯曲次数(1-100); speed: "
+            "弯曲速度(500-1500，数值越小越快); direction: 弯曲方向(1=左, -1=右)",
+            [this](int steps, int speed, int direction) -> ReturnValue {
+                QueueAction(ACTION_BEND, steps, speed, direction, 0);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 1>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"direction", -1, 1, 1>>(
+            "self.otto.shake_leg",
+            "摇腿。steps: 摇腿次数(1-100); speed: 摇腿速度(500-1500，数值越小越快); "
+            "direction: 腿部选择(1=左腿, -1=右腿)",
+            [this](int steps, int speed, int direction) -> ReturnValue {
+                QueueAction(ACTION_SHAKE_LEG, steps, speed, direction, 0);
+                return true;
+            });
+
+        mcp_server.AddTool<McpInt<"steps", 1, 100, 3>, McpInt<"speed", 500, 1500, 1000>,
+                           McpInt<"amount", 0, 170, 20>>(
+            "self.otto.updown",
+            "上下运动。steps: 上下运动次数(1-100); speed: "
+            "运动速度(500-1500，数值越小越快); amount: 运动幅度(0-170度)",
+            [this](int steps, int speed, int amount) -> ReturnValue {
+                QueueAction(ACTION_UPDOWN, steps, speed, 0, amount);
+                return true;
+            });
 
         // 手部动作（仅在有手部舵机时可用）
         if (has_hands_) {
-            mcp_server.AddTool(
+            mcp_server.AddTool<McpInt<"speed", 500, 1500, 1000>, McpInt<"direction", -1, 1, 1>>(
                 "self.otto.hands_up",
                 "举手。speed: 举手速度(500-1500，数值越小越快); direction: 手部选择(1=左手, "
                 "-1=右手, 0=双手)",
-                PropertyList({Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                              Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                [this](const PropertyList& properties) -> ReturnValue {
-                    int speed = properties["speed"].value<int>();
-                    int direction = properties["direction"].value<int>();
+                [this](int speed, int direction) -> ReturnValue {
                     QueueAction(ACTION_HANDS_UP, 1, speed, direction, 0);
                     return true;
                 });
 
-            mcp_server.AddTool(
+            mcp_server.AddTool<McpInt<"speed", 500, 1500, 1000>, McpInt<"direction", -1, 1, 1>>(
                 "self.otto.hands_down",
                 "放手。speed: 放手速度(500-1500，数值越小越快); direction: 手部选择(1=左手, "
                 "-1=右手, 0=双手)",
-                PropertyList({Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                              Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                [this](const PropertyList& properties) -> ReturnValue {
-                    int speed = properties["speed"].value<int>();
-                    int direction = properties["direction"].value<int>();
+                [this](int speed, int direction) -> ReturnValue {
                     QueueAction(ACTION_HANDS_DOWN, 1, speed, direction, 0);
                     return true;
                 });
 
-            mcp_server.AddTool(
+            mcp_server.AddTool<McpInt<"speed", 500, 1500, 1000>, McpInt<"direction", -1, 1, 1>>(
                 "self.otto.hand_wave",
                 "挥手。speed: 挥手速度(500-1500，数值越小越快); direction: 手部选择(1=左手, "
                 "-1=右手, 0=双手)",
-                PropertyList({Property("speed", kPropertyTypeInteger, 1000, 500, 1500),
-                              Property("direction", kPropertyTypeInteger, 1, -1, 1)}),
-                [this](const PropertyList& properties) -> ReturnValue {
-                    int speed = properties["speed"].value<int>();
-                    int direction = properties["direction"].value<int>();
+                [this](int speed, int direction) -> ReturnValue {
                     QueueAction(ACTION_HAND_WAVE, 1, speed, direction, 0);
                     return true;
                 });
         }
 
         // 系统工具
-        mcp_server.AddTool("self.otto.stop", "立即停止", PropertyList(),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               if (action_task_handle_ != nullptr) {
-                                   vTaskDelete(action_task_handle_);
-                                   action_task_handle_ = nullptr;
-                               }
-                               is_action_in_progress_ = false;
-                               xQueueReset(action_queue_);
-
-                               QueueAction(ACTION_HOME, 1, 1000, 1, 0);
-                               return true;
-                           });
-
         mcp_server.AddTool(
+            "self.otto.stop",
+            "立即停止",
+            [this]() -> ReturnValue {
+                if (action_task_handle_ != nullptr) {
+                    vTaskDelete(action_task_handle_);
+                    action_task_handle_ = nullptr;
+                }
+                is_action_in_progress_ = false;
+                xQueueReset(action_queue_);
+
+                QueueAction(ACTION_HOME, 1, 1000, 1, 0);
+                return true;
+            });
+
+        mcp_server.AddTool<McpString<"servo_type", "left_leg">, McpInt<"trim_value", -50, 50, 0>>(
             "self.otto.set_trim",
             "校准单个舵机位置。设置指定舵机的微调参数以调整Otto的初始站立姿态，设置将永久保存。"
             "servo_type: 舵机类型(left_leg/right_leg/left_foot/right_foot/left_hand/right_hand); "
             "trim_value: 微调值(-50到50度)",
-            PropertyList({Property("servo_type", kPropertyTypeString, "left_leg"),
-                          Property("trim_value", kPropertyTypeInteger, 0, -50, 50)}),
-            [this](const PropertyList& properties) -> ReturnValue {
-                std::string servo_type = properties["servo_type"].value<std::string>();
-                int trim_value = properties["trim_value"].value<int>();
+            [this](const std::string& servo_type, int trim_value) -> ReturnValue {
 
                 ESP_LOGI(TAG, "设置舵机微调: %s = %d度", servo_type.c_str(), trim_value);
 
@@ -429,47 +378,53 @@ public:
                        " 度，已永久保存";
             });
 
-        mcp_server.AddTool("self.otto.get_trims", "获取当前的舵机微调设置", PropertyList(),
-                           [this](const PropertyList& properties) -> ReturnValue {
-                               Settings settings("otto_trims", false);
-
-                               int left_leg = settings.GetInt("left_leg", 0);
-                               int right_leg = settings.GetInt("right_leg", 0);
-                               int left_foot = settings.GetInt("left_foot", 0);
-                               int right_foot = settings.GetInt("right_foot", 0);
-                               int left_hand = settings.GetInt("left_hand", 0);
-                               int right_hand = settings.GetInt("right_hand", 0);
-
-                               std::string result =
-                                   "{\"left_leg\":" + std::to_string(left_leg) +
-                                   ",\"right_leg\":" + std::to_string(right_leg) +
-                                   ",\"left_foot\":" + std::to_string(left_foot) +
-                                   ",\"right_foot\":" + std::to_string(right_foot) +
-                                   ",\"left_hand\":" + std::to_string(left_hand) +
-                                   ",\"right_hand\":" + std::to_string(right_hand) + "}";
-
-                               ESP_LOGI(TAG, "获取微调设置: %s", result.c_str());
-                               return result;
-                           });
-
-        mcp_server.AddTool("self.otto.get_status", "获取机器人状态，返回 moving 或 idle",
-                           PropertyList(), [this](const PropertyList& properties) -> ReturnValue {
-                               return is_action_in_progress_ ? "moving" : "idle";
-                           });
-
-        mcp_server.AddTool("self.battery.get_level", "获取机器人电池电量和充电状态", PropertyList(),
-                           [](const PropertyList& properties) -> ReturnValue {
-                               auto& board = Board::GetInstance();
-                               int level = 0;
-                               bool charging = false;
-                               bool discharging = false;
-                               board.GetBatteryLevel(level, charging, discharging);
-
-                               std::string status =
-                                   "{\"level\":" + std::to_string(level) +
-                                   ",\"charging\":" + (charging ? "true" : "false") + "}";
-                               return status;
-                           });
+        mcp_server.AddTool(
+            "self.otto.get_trims",
+            "获取当前的舵机微调设置",
+            [this]() -> ReturnValue {
+                Settings settings("otto_trims", false);
+
+                int left_leg = settings.GetInt("left_leg", 0);
+                int right_leg = settings.GetInt("right_leg", 0);
+                int left_foot = settings.GetInt("left_foot", 0);
+                int right_foot = settings.GetInt("right_foot", 0);
+                int left_hand = settings.GetInt("left_hand", 0);
+                int right_hand = settings.GetInt("right_hand", 0);
+
+                std::string result =
+                    "{\"left_leg\":" + std::to_string(left_leg) +
+                    ",\"right_leg\":" + std::to_string(right_leg) +
+                    ",\"left_foot\":" + std::to_string(left_foot) +
+                    ",\"right_foot\":" + std::to_string(right_foot) +
+                    ",\"left_hand\":" + std::to_string(left_hand) +
+                    ",\"right_hand\":" + std::to_string(right_hand) + "}";
+
+                ESP_LOGI(TAG, "获取微调设置: %s", result.c_str());
+                return result;
+            });
+
+        mcp_server.AddTool(
+            "self.otto.get_status",
+            "获取机器人状态，返回 moving 或 idle",
+            [this]() -> ReturnValue {
+                return is_action_in_progress_ ? "moving" : "idle";
+            });
+
+        mcp_server.AddTool(
+            "self.battery.get_level",
+            "获取机器人电池电量和充电状态",
+            []() -> ReturnValue {
+                auto& board = Board::GetInstance();
+                int level = 0;
+                bool charging = false;
+                bool discharging = false;
+                board.GetBatteryLevel(level, charging, discharging);
+
+                std::string status =
+                    "{\"level\":" + std::to_string(level) +
+                    ",\"charging\":" + (charging ? "true" : "false") + "}";
+                return status;
+            });
 
         ESP_LOGI(TAG, "MCP工具注册完成");
     }
@@ -215,6 +215,7 @@ private:
                    new_volume, codec->output_volume());
         }
         GetDisplay()->ShowNotification(std::string(Lang::Strings::VOLUME) + ": "+std::to_string(codec->output_volume()));
+        GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
         power_save_timer_->WakeUp();
     }
 
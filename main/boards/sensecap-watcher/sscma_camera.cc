@@ -132,29 +132,9 @@ SscmaCamera::SscmaCamera(esp_io_expander_handle_t io_exp_handle) {
         return;
     }
     memset(jpeg_out_, 0, sizeof(jpeg_dec_header_info_t));
-
-    // 初始化预览图片的内存
-    memset(&preview_image_, 0, sizeof(preview_image_));
-    preview_image_.header.magic = LV_IMAGE_HEADER_MAGIC;
-    preview_image_.header.cf = LV_COLOR_FORMAT_RGB565;
-    preview_image_.header.flags = LV_IMAGE_FLAGS_ALLOCATED | LV_IMAGE_FLAGS_MODIFIABLE;
-    preview_image_.header.w = 640;
-    preview_image_.header.h = 480;
-
-    preview_image_.header.stride = preview_image_.header.w * 2;
-    preview_image_.data_size = preview_image_.header.w * preview_image_.header.h * 2;
-    preview_image_.data = (uint8_t*)heap_caps_malloc(preview_image_.data_size, MALLOC_CAP_SPIRAM);
-    if (preview_image_.data == nullptr) {
-        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
-        return;
-    }
 }
 
 SscmaCamera::~SscmaCamera() {
-    if (preview_image_.data) {
-        heap_caps_free((void*)preview_image_.data);
-        preview_image_.data = nullptr;
-    }
     if (sscma_client_handle_) {
         sscma_client_del(sscma_client_handle_);
     }
@@ -221,7 +201,7 @@ bool SscmaCamera::Capture() {
     heap_caps_free(data.img);
 
     //DECODE JPEG
-    if (!jpeg_dec_ || !jpeg_io_ || !jpeg_out_ || !preview_image_.data) {
+    if (!jpeg_dec_ || !jpeg_io_ || !jpeg_out_) {
         return true;
     }
     jpeg_io_->inbuf = jpeg_data_.buf;
@@ -231,7 +211,17 @@ bool SscmaCamera::Capture() {
         ESP_LOGE(TAG, "Failed to parse JPEG header, ret: %d", ret);
         return true;
     }
-    jpeg_io_->outbuf = (unsigned char*)preview_image_.data;
+    // Decode into the last preview if the display doesn't show it anymore
+    if (preview_image_ == nullptr || preview_image_.use_count() > 1 ||
+        preview_image_->width() != jpeg_out_->width || preview_image_->height() != jpeg_out_->height) {
+        preview_image_ = std::make_shared<PreviewImage>(jpeg_out_->width, jpeg_out_->height);
+    }
+    if (!preview_image_->valid()) {
+        ESP_LOGE(TAG, "Failed to allocate memory for preview image");
+        preview_image_.reset();
+        return true;
+    }
+    jpeg_io_->outbuf = (unsigned char*)preview_image_->pixels();
     int inbuf_consumed = jpeg_io_->inbuf_len - jpeg_io_->inbuf_remain;
     jpeg_io_->inbuf =  jpeg_data_.buf + inbuf_consumed;
     jpeg_io_->inbuf_len = jpeg_io_->inbuf_remain;
@@ -245,7 +235,7 @@ bool SscmaCamera::Capture() {
     // 显示预览图片
     auto display = Board::GetInstance().GetDisplay();
     if (display != nullptr) {
-        display->SetPreviewImage(&preview_image_);
+        display->SetPreviewImage(preview_image_);
     }
     return true;
 }
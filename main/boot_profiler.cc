@@ -0,0 +1,84 @@
+#include "boot_profiler.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <cstdio>
+
+#define TAG "BootProfiler"
+
+int BootProfiler::Begin(const char* name) {
+    if (finished()) {
+        return -1;
+    }
+    int id = span_count_.fetch_add(1, std::memory_order_relaxed);
+    if (id >= BOOT_PROFILER_MAX_SPANS) {
+        ESP_LOGW(TAG, "Span table is full, dropped %s", name);
+        return -1;
+    }
+    auto& span = spans_[id];
+    span.start_time = esp_timer_get_time();
+    span.core = xPortGetCoreID();
+    span.name = name;
+    return id;
+}
+
+void BootProfiler::End(int id) {
+    if (id < 0) {
+        return;
+    }
+    spans_[id].end_time = esp_timer_get_time();
+}
+
+void BootProfiler::Mark(const char* name) {
+    End(Begin(name));
+}
+
+void BootProfiler::Finish() {
+    int64_t expected = 0;
+    if (!finish_time_.compare_exchange_strong(expected, esp_timer_get_time(), std::memory_order_acq_rel)) {
+        return;
+    }
+
+    int count = std::min(span_count_.load(std::memory_order_relaxed), BOOT_PROFILER_MAX_SPANS);
+    // newlib nano printf has no 64-bit formats, the boot times fit in a long
+    ESP_LOGI(TAG, "Boot finished in %ld ms, timeline (ms):", (long)(finish_time_.load() / 1000));
+    ESP_LOGI(TAG, "%8s %8s %8s %4s  %s", "start", "end", "duration", "core", "name");
+    for (int i = 0; i < count; i++) {
+        auto& span = spans_[i];
+        if (span.name == nullptr) {
+            continue;
+        }
+        if (span.end_time == 0) {
+            ESP_LOGI(TAG, "%8ld %8s %8s %4d  %s", (long)(span.start_time / 1000), "-", "-", span.core, span.name);
+        } else {
+            ESP_LOGI(TAG, "%8ld %8ld %8ld %4d  %s", (long)(span.start_time / 1000), (long)(span.end_time / 1000),
+                (long)((span.end_time - span.start_time) / 1000), span.core, span.name);
+        }
+    }
+}
+
+std::string BootProfiler::GetTimelineJson() const {
+    int count = std::min(span_count_.load(std::memory_order_relaxed), BOOT_PROFILER_MAX_SPANS);
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "{\"finished\":%s,\"boot_time_us\":%ld,\"spans\":[",
+        finished() ? "true" : "false", (long)finish_time_.load(std::memory_order_acquire));
+    std::string json = buffer;
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        auto& span = spans_[i];
+        if (span.name == nullptr) {
+            continue;
+        }
+        // A negative duration marks the spans that are still running
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"start_us\":%ld,\"duration_us\":%ld,\"core\":%d}",
+            first ? "" : ",", span.name, (long)span.start_time,
+            span.end_time == 0 ? -1L : (long)(span.end_time - span.start_time), span.core);
+        json += buffer;
+        first = false;
+    }
+    json += "]}";
+    return json;
+}
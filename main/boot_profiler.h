@@ -0,0 +1,64 @@
+#ifndef BOOT_PROFILER_H
+#define BOOT_PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Boot timeline profiler
+ *
+ * Records named spans from app_main to the first idle state, the spans may overlap and come from
+ * different tasks (the startup runs some steps concurrently). The timeline is printed when the boot
+ * finishes and can be read later with the MCP tool `self.get_boot_timeline`.
+ */
+#define BOOT_PROFILER_MAX_SPANS 32
+
+struct BootSpan {
+    const char* name = nullptr;     // Must be a string literal
+    int64_t start_time = 0;
+    int64_t end_time = 0;           // 0 if the span is still running
+    int core = 0;
+};
+
+class BootProfiler {
+public:
+    static BootProfiler& GetInstance() {
+        static BootProfiler instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    BootProfiler(const BootProfiler&) = delete;
+    BootProfiler& operator=(const BootProfiler&) = delete;
+
+    // Returns the span id, -1 if the boot has finished or the span table is full
+    int Begin(const char* name);
+    void End(int id);
+    // Record a point in time as a span of zero length
+    void Mark(const char* name);
+    // Called when the device reaches the idle state for the first time, prints the timeline
+    void Finish();
+    bool finished() const { return finish_time_.load(std::memory_order_acquire) != 0; }
+    std::string GetTimelineJson() const;
+
+private:
+    BootProfiler() = default;
+
+    BootSpan spans_[BOOT_PROFILER_MAX_SPANS];
+    std::atomic<int> span_count_ = 0;
+    std::atomic<int64_t> finish_time_ = 0;
+};
+
+// Records a span for the lifetime of the object
+class BootSpanScope {
+public:
+    explicit BootSpanScope(const char* name) : id_(BootProfiler::GetInstance().Begin(name)) {}
+    ~BootSpanScope() { BootProfiler::GetInstance().End(id_); }
+    BootSpanScope(const BootSpanScope&) = delete;
+    BootSpanScope& operator=(const BootSpanScope&) = delete;
+
+private:
+    int id_;
+};
+
+#endif // BOOT_PROFILER_H
@@ -1,8 +1,12 @@
 #include <esp_log.h>
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
 #include <string>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 
 #include "display.h"
 #include "board.h"
@@ -11,15 +15,21 @@
 #include "audio_codec.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "trace_buffer.h"
 
 #define TAG "Display"
 
+#define STATUS_BAR_BATTERY_POLL_SECONDS 10
+#define STATUS_BAR_NETWORK_POLL_SECONDS 30
+#define STATUS_BAR_CLOCK_DELAY_SECONDS 10
+#define DISPLAY_LOCK_TIMEOUT_MS 30000
+
 Display::Display() {
     // Notification timer
     esp_timer_create_args_t notification_timer_args = {
         .callback = [](void *arg) {
             Display *display = static_cast<Display*>(arg);
-            DisplayLockGuard lock(display);
+            DisplayLockGuard lock(display, "notification_timer");
             lv_obj_add_flag(display->notification_label_, LV_OBJ_FLAG_HIDDEN);
             lv_obj_clear_flag(display->status_label_, LV_OBJ_FLAG_HIDDEN);
         },
@@ -30,6 +40,17 @@ Display::Display() {
     };
     ESP_ERROR_CHECK(esp_timer_create(&notification_timer_args, &notification_timer_));
 
+    esp_timer_create_args_t status_bar_timer_args = {
+        .callback = [](void *arg) {
+            static_cast<Display*>(arg)->UpdateStatusBar();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "status_bar_timer",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&status_bar_timer_args, &status_bar_timer_));
+
     // Create a power management lock
     auto ret = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "display_update", &pm_lock_);
     if (ret == ESP_ERR_NOT_SUPPORTED) {
@@ -44,6 +65,10 @@ Display::~Display() {
         esp_timer_stop(notification_timer_);
         esp_timer_delete(notification_timer_);
     }
+    if (status_bar_timer_ != nullptr) {
+        esp_timer_stop(status_bar_timer_);
+        esp_timer_delete(status_bar_timer_);
+    }
 
     if (network_label_ != nullptr) {
         lv_obj_del(network_label_);
@@ -61,6 +86,381 @@ Display::~Display() {
     }
 }
 
+DisplayLockGuard::DisplayLockGuard(Display* display, const char* tag) : display_(display) {
+#if CONFIG_USE_DISPLAY_STATISTICS
+    // The displays without LVGL don't lock anything
+    if (display_->display_ == nullptr) {
+        locked_ = display_->Lock(DISPLAY_LOCK_TIMEOUT_MS);
+        return;
+    }
+    auto& stats = display_->stats_;
+    const char* holder = stats.holder();
+    int64_t start_time = esp_timer_get_time();
+    locked_ = display_->Lock(DISPLAY_LOCK_TIMEOUT_MS);
+    if (!locked_) {
+        stats.RecordTimeout(tag);
+        ESP_LOGE(TAG, "Failed to lock display for %s, held by %s", tag, holder != nullptr ? holder : "lvgl");
+        return;
+    }
+    locked_time_ = esp_timer_get_time();
+    int64_t wait_us = locked_time_ - start_time;
+    tag_ = tag;
+    previous_holder_ = stats.SetHolder(tag);
+    caller_ = stats.RecordWait(tag, holder, wait_us);
+    if (wait_us >= DISPLAY_LOCK_CONTENDED_US) {
+        TRACE_INSTANT("display_lock_wait", (int32_t)wait_us);
+    }
+    TRACE_BEGIN(tag);
+#else
+    locked_ = display_->Lock(DISPLAY_LOCK_TIMEOUT_MS);
+    if (!locked_) {
+        ESP_LOGE(TAG, "Failed to lock display for %s", tag);
+    }
+#endif
+}
+
+DisplayLockGuard::~DisplayLockGuard() {
+    if (!locked_) {
+        return;
+    }
+#if CONFIG_USE_DISPLAY_STATISTICS
+    if (caller_ != nullptr) {
+        TRACE_END(tag_);
+        display_->stats_.RecordHold(caller_, esp_timer_get_time() - locked_time_);
+        display_->stats_.SetHolder(previous_holder_);
+    }
+#endif
+    display_->Unlock();
+}
+
+void Display::InstrumentRefresh() {
+#if CONFIG_USE_TRACE_BUFFER || CONFIG_USE_DISPLAY_STATISTICS
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto code = lv_event_get_code(e);
+        switch (code) {
+            case LV_EVENT_REFR_START:
+                TRACE_BEGIN("lv_refresh");
+                break;
+            case LV_EVENT_REFR_READY:
+                TRACE_END("lv_refresh");
+                break;
+            case LV_EVENT_FLUSH_START:
+                TRACE_BEGIN("lv_flush");
+                break;
+            case LV_EVENT_FLUSH_FINISH:
+                TRACE_END("lv_flush");
+                break;
+            default:
+                break;
+        }
+#if CONFIG_USE_DISPLAY_STATISTICS
+        auto display = (Display*)lv_event_get_user_data(e);
+        display->stats_.OnRefreshEvent(code);
+#endif
+    }, LV_EVENT_ALL, this);
+#endif
+}
+
+std::string Display::GetStatisticsJson(bool reset) {
+#if CONFIG_USE_DISPLAY_STATISTICS
+    if (display_ == nullptr) {
+        return "{\"success\": false, \"message\": \"No LVGL display\"}";
+    }
+    DisplayLockGuard lock(this);
+    auto json = stats_.GetJson();
+    if (reset) {
+        stats_.Reset();
+    }
+    return json;
+#else
+    return "{\"success\": false, \"message\": \"Display statistics are disabled\"}";
+#endif
+}
+
+std::string Display::RunBenchmark(int seconds) {
+    if (display_ == nullptr) {
+        return "{\"success\": false, \"message\": \"No LVGL display\"}";
+    }
+
+    struct BenchmarkStats {
+        int64_t refresh_start = 0;
+        int64_t flush_start = 0;
+        int64_t wait_start = 0;
+        int64_t refresh_us = 0;
+        int64_t flush_us = 0;
+        int64_t wait_us = 0;
+        uint32_t frames = 0;
+        uint32_t flushes = 0;
+        bool flushed = false;
+    } stats;
+    auto event_cb = [](lv_event_t* e) {
+        auto stats = (BenchmarkStats*)lv_event_get_user_data(e);
+        int64_t now = esp_timer_get_time();
+        switch (lv_event_get_code(e)) {
+            case LV_EVENT_REFR_START:
+                stats->refresh_start = now;
+                stats->flushed = false;
+                break;
+            case LV_EVENT_REFR_READY:
+                // Only the refreshes that redrew something are frames
+                if (stats->flushed) {
+                    stats->frames++;
+                    stats->refresh_us += now - stats->refresh_start;
+                }
+                break;
+            case LV_EVENT_FLUSH_START:
+                stats->flush_start = now;
+                stats->flushed = true;
+                stats->flushes++;
+                break;
+            case LV_EVENT_FLUSH_FINISH:
+                stats->flush_us += now - stats->flush_start;
+                break;
+            case LV_EVENT_FLUSH_WAIT_START:
+                stats->wait_start = now;
+                break;
+            case LV_EVENT_FLUSH_WAIT_FINISH:
+                stats->wait_us += now - stats->wait_start;
+                break;
+            default:
+                break;
+        }
+    };
+
+    // The scene: a box bouncing over the whole screen and a rotating arc, redrawn every frame
+    lv_obj_t* scene;
+    int64_t start_time;
+    {
+        DisplayLockGuard lock(this);
+        scene = lv_obj_create(lv_layer_top());
+        lv_obj_set_size(scene, LV_HOR_RES, LV_VER_RES);
+        lv_obj_set_style_radius(scene, 0, 0);
+        lv_obj_set_style_border_width(scene, 0, 0);
+        lv_obj_set_scrollbar_mode(scene, LV_SCROLLBAR_MODE_OFF);
+
+        int box_size = std::min(width_, height_) / 4;
+        lv_obj_t* box = lv_obj_create(scene);
+        lv_obj_set_size(box, box_size, box_size);
+        lv_obj_set_style_bg_color(box, lv_palette_main(LV_PALETTE_BLUE), 0);
+        lv_anim_t anim;
+        lv_anim_init(&anim);
+        lv_anim_set_var(&anim, box);
+        lv_anim_set_exec_cb(&anim, [](void* obj, int32_t x) { lv_obj_set_x((lv_obj_t*)obj, x); });
+        lv_anim_set_values(&anim, 0, width_ - box_size - 2 * lv_obj_get_style_pad_left(scene, 0));
+        lv_anim_set_duration(&anim, 1300);
+        lv_anim_set_playback_duration(&anim, 1300);
+        lv_anim_set_repeat_count(&anim, LV_ANIM_REPEAT_INFINITE);
+        lv_anim_start(&anim);
+        lv_anim_set_exec_cb(&anim, [](void* obj, int32_t y) { lv_obj_set_y((lv_obj_t*)obj, y); });
+        lv_anim_set_values(&anim, 0, height_ - box_size - 2 * lv_obj_get_style_pad_top(scene, 0));
+        lv_anim_set_duration(&anim, 900);
+        lv_anim_set_playback_duration(&anim, 900);
+        lv_anim_start(&anim);
+
+        lv_obj_t* arc = lv_arc_create(scene);
+        lv_obj_set_size(arc, box_size, box_size);
+        lv_obj_remove_flag(arc, LV_OBJ_FLAG_CLICKABLE);
+        lv_arc_set_bg_angles(arc, 0, 360);
+        lv_arc_set_angles(arc, 0, 90);
+        lv_obj_center(arc);
+        lv_anim_set_var(&anim, arc);
+        lv_anim_set_exec_cb(&anim, [](void* obj, int32_t angle) { lv_arc_set_rotation((lv_obj_t*)obj, angle); });
+        lv_anim_set_values(&anim, 0, 360);
+        lv_anim_set_duration(&anim, 1000);
+        lv_anim_set_playback_duration(&anim, 0);
+        lv_anim_start(&anim);
+
+        lv_display_add_event_cb(display_, event_cb, LV_EVENT_ALL, &stats);
+        start_time = esp_timer_get_time();
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(seconds * 1000));
+
+    uint32_t lvgl_load;
+    int64_t elapsed_us;
+    lv_draw_buf_t* draw_buf;
+    {
+        DisplayLockGuard lock(this);
+        elapsed_us = esp_timer_get_time() - start_time;
+        lv_display_remove_event_cb_with_user_data(display_, event_cb, &stats);
+        lv_obj_delete(scene);
+        // The share of the time the LVGL task spent rendering over its last measurement period
+        lvgl_load = 100 - lv_timer_get_idle();
+        draw_buf = lv_display_get_buf_active(display_);
+    }
+
+    // newlib nano printf has no float formats, the frame rate is printed from tenths
+    uint32_t fps = stats.frames * 10000000LL / elapsed_us;
+    uint32_t frames = std::max<uint32_t>(stats.frames, 1);
+    char buffer[320];
+    snprintf(buffer, sizeof(buffer), "{\"seconds\":%d,\"width\":%d,\"height\":%d,\"buffer_lines\":%d,"
+        "\"frames\":%lu,\"fps\":%lu.%lu,\"flushes_per_frame\":%lu,\"refresh_us\":%ld,\"flush_us\":%ld,"
+        "\"flush_wait_us\":%ld,\"lvgl_load\":%lu}",
+        seconds, width_, height_, draw_buf != nullptr ? (int)draw_buf->header.h : 0,
+        (unsigned long)stats.frames, (unsigned long)(fps / 10), (unsigned long)(fps % 10),
+        (unsigned long)(stats.flushes / frames), (long)(stats.refresh_us / frames), (long)(stats.flush_us / frames),
+        (long)(stats.wait_us / frames), (unsigned long)lvgl_load);
+    ESP_LOGI(TAG, "Benchmark: %s", buffer);
+    return buffer;
+}
+
+enum class ReplayCall {
+    kStatus,
+    kEmotion,
+    kChat,
+    kAppendChat,
+    kNotification,
+    kPreview,
+    kTheme,
+};
+
+struct ReplayStep {
+    ReplayCall call;
+    const char* arg;
+    const char* text;
+};
+
+// The display calls of a conversation, in the order the application makes them
+static const ReplayStep REPLAY_STEPS[] = {
+    { ReplayCall::kStatus, Lang::Strings::LISTENING, nullptr },
+    { ReplayCall::kEmotion, "neutral", nullptr },
+    { ReplayCall::kChat, "user", "今天天气怎么样？" },
+    { ReplayCall::kStatus, Lang::Strings::SPEAKING, nullptr },
+    { ReplayCall::kEmotion, "thinking", nullptr },
+    { ReplayCall::kChat, "assistant", "今天晴，气温十八到二十六度，很适合出门散步。" },
+    { ReplayCall::kAppendChat, "assistant", "傍晚可能会起风，记得带一件外套。" },
+    { ReplayCall::kEmotion, "happy", nullptr },
+    { ReplayCall::kNotification, "60", nullptr },
+    { ReplayCall::kStatus, Lang::Strings::LISTENING, nullptr },
+    { ReplayCall::kChat, "user", "Take a photo and tell me what you see." },
+    { ReplayCall::kPreview, nullptr, nullptr },
+    { ReplayCall::kStatus, Lang::Strings::SPEAKING, nullptr },
+    { ReplayCall::kChat, "assistant", "I can see a desk with a laptop, a cup of coffee and a small plant next to the window." },
+    { ReplayCall::kEmotion, "surprised", nullptr },
+    { ReplayCall::kTheme, nullptr, nullptr },
+    { ReplayCall::kTheme, nullptr, nullptr },
+    { ReplayCall::kChat, "system", Lang::Strings::STANDBY },
+    { ReplayCall::kStatus, Lang::Strings::STANDBY, nullptr },
+};
+
+std::string Display::RunReplayBenchmark() {
+    if (display_ == nullptr) {
+        return "{\"success\": false, \"message\": \"No LVGL display\"}";
+    }
+
+    // A gradient for the preview image, it is released with the replay display
+    const int image_size = 64;
+    auto image = std::make_shared<PreviewImage>(image_size, image_size);
+    if (!image->valid()) {
+        return "{\"success\": false, \"message\": \"Failed to allocate the preview image\"}";
+    }
+    auto pixels = image->pixels();
+    for (int y = 0; y < image_size; y++) {
+        for (int x = 0; x < image_size; x++) {
+            pixels[y * image_size + x] = lv_color_to_u16(lv_color_make(x * 4, y * 4, 128));
+        }
+    }
+
+    size_t start_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t min_free = start_free;
+    std::unique_ptr<Display> replay;
+    {
+        DisplayLockGuard lock(this);
+        replay = CreateReplayDisplay();
+    }
+    if (replay == nullptr) {
+        return "{\"success\": false, \"message\": \"The display has no off-screen replay\"}";
+    }
+
+    std::string json = replay->ReplayConversation(image, min_free);
+    replay.reset();
+    image.reset();
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), ",\"heap_peak_bytes\":%ld,\"heap_retained_bytes\":%ld}",
+        (long)(start_free - min_free), (long)start_free - (long)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+    json += buffer;
+    ESP_LOGI(TAG, "Replay benchmark: %s", json.c_str());
+    return json;
+}
+
+// Runs on the replay display, its UI is deleted afterwards so nothing is restored
+std::string Display::ReplayConversation(const std::shared_ptr<PreviewImage>& image, size_t& min_free) {
+    std::string original_theme = GetTheme();
+    int64_t invalidated = 0;
+    auto invalidate_cb = [](lv_event_t* e) {
+        auto area = (const lv_area_t*)lv_event_get_param(e);
+        *(int64_t*)lv_event_get_user_data(e) += lv_area_get_size(area);
+    };
+    {
+        DisplayLockGuard lock(this);
+        lv_display_add_event_cb(display_, invalidate_cb, LV_EVENT_INVALIDATE_AREA, &invalidated);
+    }
+
+    static const char* call_names[] = { "SetStatus", "SetEmotion", "SetChatMessage", "AppendChatMessage",
+        "ShowNotification", "SetPreviewImage", "SetTheme" };
+    int64_t total_call_us = 0;
+    int64_t total_render_us = 0;
+    char buffer[160];
+    std::string json = "{\"calls\":[";
+    for (size_t i = 0; i < sizeof(REPLAY_STEPS) / sizeof(REPLAY_STEPS[0]); i++) {
+        auto& step = REPLAY_STEPS[i];
+        int64_t call_us, render_us;
+        {
+            // Keep the LVGL task from rendering between the call and the measured frame
+            DisplayLockGuard lock(this);
+            invalidated = 0;
+            int64_t start_time = esp_timer_get_time();
+            switch (step.call) {
+                case ReplayCall::kStatus:
+                    SetStatus(step.arg);
+                    break;
+                case ReplayCall::kEmotion:
+                    SetEmotion(step.arg);
+                    break;
+                case ReplayCall::kChat:
+                    SetChatMessage(step.arg, step.text);
+                    break;
+                case ReplayCall::kAppendChat:
+                    AppendChatMessage(step.arg, step.text);
+                    break;
+                case ReplayCall::kNotification:
+                    // Outlasts the replay, the timer never fires on the deleted UI
+                    ShowNotification(std::string(Lang::Strings::VOLUME) + step.arg, 60000);
+                    break;
+                case ReplayCall::kPreview:
+                    SetPreviewImage(image);
+                    break;
+                case ReplayCall::kTheme:
+                    if (!original_theme.empty()) {
+                        SetTheme(GetTheme() == "dark" ? "light" : "dark");
+                    }
+                    break;
+            }
+            int64_t call_time = esp_timer_get_time();
+            lv_refr_now(display_);
+            call_us = call_time - start_time;
+            render_us = esp_timer_get_time() - call_time;
+        }
+        min_free = std::min(min_free, heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        total_call_us += call_us;
+        total_render_us += render_us;
+        snprintf(buffer, sizeof(buffer), "%s{\"call\":\"%s\",\"call_us\":%ld,\"render_us\":%ld,\"invalidated_px\":%ld}",
+            i == 0 ? "" : ",", call_names[(int)step.call], (long)call_us, (long)render_us, (long)invalidated);
+        json += buffer;
+    }
+
+    {
+        DisplayLockGuard lock(this);
+        lv_display_remove_event_cb_with_user_data(display_, invalidate_cb, &invalidated);
+    }
+
+    snprintf(buffer, sizeof(buffer), "],\"total_call_us\":%ld,\"total_render_us\":%ld",
+        (long)total_call_us, (long)total_render_us);
+    json += buffer;
+    return json;
+}
+
 void Display::SetStatus(const char* status) {
     DisplayLockGuard lock(this);
     if (status_label_ == nullptr) {
@@ -71,6 +471,9 @@ void Display::SetStatus(const char* status) {
     lv_obj_add_flag(notification_label_, LV_OBJ_FLAG_HIDDEN);
 
     last_status_update_time_ = std::chrono::system_clock::now();
+    clock_shown_ = false;
+    // The clock may replace the status when the device is idle
+    ScheduleStatusBarUpdate(STATUS_BAR_CLOCK_DELAY_SECONDS * 1000000LL);
 }
 
 void Display::ShowNotification(const std::string &notification, int duration_ms) {
@@ -90,108 +493,170 @@ void Display::ShowNotification(const char* notification, int duration_ms) {
     ESP_ERROR_CHECK(esp_timer_start_once(notification_timer_, duration_ms * 1000));
 }
 
+void Display::MarkStatusBarDirty(uint32_t items) {
+    if (status_bar_dirty_.fetch_or(items) == 0) {
+        ScheduleStatusBarUpdate(0);
+    }
+}
+
+void Display::ScheduleStatusBarUpdate(int64_t delay_us) {
+    if (status_bar_timer_ == nullptr) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(status_bar_timer_mutex_);
+    int64_t due_time = esp_timer_get_time() + delay_us;
+    if (esp_timer_is_active(status_bar_timer_) && status_bar_due_time_ <= due_time) {
+        return;
+    }
+    esp_timer_stop(status_bar_timer_);
+    esp_timer_start_once(status_bar_timer_, delay_us);
+    status_bar_due_time_ = due_time;
+}
+
 void Display::UpdateStatusBar(bool update_all) {
+    if (mute_label_ == nullptr) {
+        return;
+    }
     auto& app = Application::GetInstance();
     auto& board = Board::GetInstance();
-    auto codec = board.GetAudioCodec();
-
-    // Update mute icon
-    {
-        DisplayLockGuard lock(this);
-        if (mute_label_ == nullptr) {
-            return;
-        }
 
-        // 如果静音状态改变，则更新图标
-        if (codec->output_volume() == 0 && !muted_) {
-            muted_ = true;
-            lv_label_set_text(mute_label_, FONT_AWESOME_VOLUME_MUTE);
-        } else if (codec->output_volume() > 0 && muted_) {
-            muted_ = false;
-            lv_label_set_text(mute_label_, "");
-        }
+    // The battery and the network may take an ADC read or an AT command round trip, besides their
+    // change events they are only polled every few seconds
+    uint32_t dirty = status_bar_dirty_.exchange(0) | (update_all ? kStatusBarAll : 0);
+    int64_t now_us = esp_timer_get_time();
+    if (has_battery_ && now_us >= battery_poll_time_) {
+        dirty |= kStatusBarBattery;
+    }
+    if (now_us >= network_poll_time_) {
+        dirty |= kStatusBarNetwork;
+    }
+    if (dirty & kStatusBarBattery) {
+        battery_poll_time_ = now_us + STATUS_BAR_BATTERY_POLL_SECONDS * 1000000LL;
     }
+    if (dirty & kStatusBarNetwork) {
+        network_poll_time_ = now_us + STATUS_BAR_NETWORK_POLL_SECONDS * 1000000LL;
+    }
+    int64_t next_update_us = std::min(network_poll_time_, has_battery_ ? battery_poll_time_ : INT64_MAX) - now_us;
 
-    // Update time
+    // Show the clock "HH:MM" 10 seconds after the last status, then only when the minute changes
+    char time_str[16];
+    bool show_clock = false;
     if (app.GetDeviceState() == kDeviceStateIdle) {
-        if (last_status_update_time_ + std::chrono::seconds(10) < std::chrono::system_clock::now()) {
-            // Set status to clock "HH:MM"
-            time_t now = time(NULL);
-            struct tm* tm = localtime(&now);
-            // Check if the we have already set the time
-            if (tm->tm_year >= 2025 - 1900) {
-                char time_str[16];
-                strftime(time_str, sizeof(time_str), "%H:%M  ", tm);
-                SetStatus(time_str);
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        // Check if the we have already set the time
+        if (tm.tm_year >= 2025 - 1900) {
+            auto clock_time = last_status_update_time_ + std::chrono::seconds(STATUS_BAR_CLOCK_DELAY_SECONDS);
+            if (clock_shown_) {
+                show_clock = tm.tm_min != clock_minute_;
+            } else {
+                show_clock = clock_time < std::chrono::system_clock::now();
+            }
+            if (clock_shown_ || show_clock) {
+                // Wake up when the minute changes
+                next_update_us = std::min<int64_t>(next_update_us, (60 - tm.tm_sec) * 1000000LL);
             } else {
-                ESP_LOGW(TAG, "System time is not set, tm_year: %d", tm->tm_year);
+                auto wait = std::chrono::duration_cast<std::chrono::microseconds>(clock_time - std::chrono::system_clock::now());
+                next_update_us = std::min<int64_t>(next_update_us, wait.count() + 1000);
             }
         }
+        if (show_clock) {
+            strftime(time_str, sizeof(time_str), "%H:%M  ", &tm);
+            clock_minute_ = tm.tm_min;
+        }
     }
 
-    esp_pm_lock_acquire(pm_lock_);
-    // 更新电池图标
-    int battery_level;
-    bool charging, discharging;
-    const char* icon = nullptr;
-    if (board.GetBatteryLevel(battery_level, charging, discharging)) {
-        if (charging) {
-            icon = FONT_AWESOME_BATTERY_CHARGING;
-        } else {
-            const char* levels[] = {
-                FONT_AWESOME_BATTERY_EMPTY, // 0-19%
-                FONT_AWESOME_BATTERY_1,    // 20-39%
-                FONT_AWESOME_BATTERY_2,    // 40-59%
-                FONT_AWESOME_BATTERY_3,    // 60-79%
-                FONT_AWESOME_BATTERY_FULL, // 80-99%
-                FONT_AWESOME_BATTERY_FULL, // 100%
+    // The mute icon follows the volume, whoever sets the volume marks it dirty
+    bool muted = muted_;
+    if (dirty & kStatusBarMute) {
+        muted = board.GetAudioCodec()->output_volume() == 0;
+    }
+
+    const char* battery_icon = nullptr;
+    bool low_battery = false;
+    const char* network_icon = nullptr;
+    if (dirty & (kStatusBarBattery | kStatusBarNetwork)) {
+        esp_pm_lock_acquire(pm_lock_);
+        int battery_level;
+        bool charging, discharging;
+        if ((dirty & kStatusBarBattery) && !board.GetBatteryLevel(battery_level, charging, discharging)) {
+            // The boards without a battery fail the first read, a read error after that is transient
+            if (battery_icon_ == nullptr) {
+                has_battery_ = false;
+            }
+        } else if (dirty & kStatusBarBattery) {
+            if (charging) {
+                battery_icon = FONT_AWESOME_BATTERY_CHARGING;
+            } else {
+                const char* levels[] = {
+                    FONT_AWESOME_BATTERY_EMPTY, // 0-19%
+                    FONT_AWESOME_BATTERY_1,    // 20-39%
+                    FONT_AWESOME_BATTERY_2,    // 40-59%
+                    FONT_AWESOME_BATTERY_3,    // 60-79%
+                    FONT_AWESOME_BATTERY_FULL, // 80-99%
+                    FONT_AWESOME_BATTERY_FULL, // 100%
+                };
+                battery_icon = levels[battery_level / 20];
+            }
+            low_battery = strcmp(battery_icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging;
+        }
+
+        // 升级固件时，不读取 4G 网络状态，避免占用 UART 资源
+        if (dirty & kStatusBarNetwork) {
+            auto device_state = app.GetDeviceState();
+            static const std::vector<DeviceState> allowed_states = {
+                kDeviceStateIdle,
+                kDeviceStateStarting,
+                kDeviceStateWifiConfiguring,
+                kDeviceStateListening,
+                kDeviceStateActivating,
             };
-            icon = levels[battery_level / 20];
+            if (std::find(allowed_states.begin(), allowed_states.end(), device_state) != allowed_states.end()) {
+                network_icon = board.GetNetworkStateIcon();
+            }
         }
-        DisplayLockGuard lock(this);
-        if (battery_label_ != nullptr && battery_icon_ != icon) {
-            battery_icon_ = icon;
+        esp_pm_lock_release(pm_lock_);
+    }
+
+    bool battery_changed = battery_icon != nullptr && (battery_icon != battery_icon_ || low_battery != low_battery_);
+    bool network_changed = network_icon != nullptr && network_icon != network_icon_;
+    bool mute_changed = (dirty & kStatusBarMute) && (muted != muted_ || update_all);
+    ScheduleStatusBarUpdate(std::max<int64_t>(next_update_us, 0));
+    if (!mute_changed && !show_clock && !battery_changed && !network_changed) {
+        return;
+    }
+
+    DisplayLockGuard lock(this);
+    if (mute_changed) {
+        muted_ = muted;
+        lv_label_set_text(mute_label_, muted_ ? FONT_AWESOME_VOLUME_MUTE : "");
+    }
+    if (show_clock) {
+        SetStatus(time_str);
+        clock_shown_ = true;
+    }
+    if (battery_changed) {
+        battery_icon_ = battery_icon;
+        low_battery_ = low_battery;
+        if (battery_label_ != nullptr) {
             lv_label_set_text(battery_label_, battery_icon_);
         }
-
         if (low_battery_popup_ != nullptr) {
-            if (strcmp(icon, FONT_AWESOME_BATTERY_EMPTY) == 0 && discharging) {
+            if (low_battery_) {
                 if (lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // 如果低电量提示框隐藏，则显示
                     lv_obj_clear_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
                     app.PlaySound(Lang::Sounds::P3_LOW_BATTERY);
                 }
-            } else {
-                // Hide the low battery popup when the battery is not empty
-                if (!lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // 如果低电量提示框显示，则隐藏
-                    lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
-                }
+            } else if (!lv_obj_has_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN)) { // 如果低电量提示框显示，则隐藏
+                lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
             }
         }
     }
-
-    // 每 10 秒更新一次网络图标
-    static int seconds_counter = 0;
-    if (update_all || seconds_counter++ % 10 == 0) {
-        // 升级固件时，不读取 4G 网络状态，避免占用 UART 资源
-        auto device_state = Application::GetInstance().GetDeviceState();
-        static const std::vector<DeviceState> allowed_states = {
-            kDeviceStateIdle,
-            kDeviceStateStarting,
-            kDeviceStateWifiConfiguring,
-            kDeviceStateListening,
-            kDeviceStateActivating,
-        };
-        if (std::find(allowed_states.begin(), allowed_states.end(), device_state) != allowed_states.end()) {
-            icon = board.GetNetworkStateIcon();
-            if (network_label_ != nullptr && icon != nullptr && network_icon_ != icon) {
-                DisplayLockGuard lock(this);
-                network_icon_ = icon;
-                lv_label_set_text(network_label_, network_icon_);
-            }
-        }
+    if (network_changed && network_label_ != nullptr) {
+        network_icon_ = network_icon;
+        lv_label_set_text(network_label_, network_icon_);
     }
-
-    esp_pm_lock_release(pm_lock_);
 }
 
 
@@ -251,7 +716,7 @@ void Display::SetIcon(const char* icon) {
     lv_label_set_text(emotion_label_, icon);
 }
 
-void Display::SetPreviewImage(const lv_img_dsc_t* image) {
+void Display::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     // Do nothing
 }
 
@@ -263,10 +728,16 @@ void Display::SetChatMessage(const char* role, const char* content) {
     lv_label_set_text(chat_message_label_, content);
 }
 
+void Display::AppendChatMessage(const char* role, const char* content) {
+    SetChatMessage(role, content);
+}
+
 void Display::SetTheme(const std::string& theme_name) {
     current_theme_name_ = theme_name;
-    Settings settings("display", true);
-    settings.SetString("theme", theme_name);
+    if (save_theme_) {
+        Settings settings("display", true);
+        settings.SetString("theme", theme_name);
+    }
 }
 
 void Display::SetPowerSaveMode(bool on) {
@@ -8,6 +8,13 @@
 
 #include <string>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "heap_profiler.h"
+#include "preview_image.h"
+#include "display_stats.h"
 
 struct DisplayFonts {
     const lv_font_t* text_font = nullptr;
@@ -15,6 +22,14 @@ struct DisplayFonts {
     const lv_font_t* emoji_font = nullptr;
 };
 
+// The status bar items that are read from the board, their sources mark them dirty on changes
+enum StatusBarItem : uint32_t {
+    kStatusBarMute = 1 << 0,
+    kStatusBarBattery = 1 << 1,
+    kStatusBarNetwork = 1 << 2,
+    kStatusBarAll = kStatusBarMute | kStatusBarBattery | kStatusBarNetwork,
+};
+
 class Display {
 public:
     Display();
@@ -25,12 +40,28 @@ public:
     virtual void ShowNotification(const std::string &notification, int duration_ms = 3000);
     virtual void SetEmotion(const char* emotion);
     virtual void SetChatMessage(const char* role, const char* content);
+    // Append to the current message of the same role, the displays that show one message replace it
+    virtual void AppendChatMessage(const char* role, const char* content);
     virtual void SetIcon(const char* icon);
-    virtual void SetPreviewImage(const lv_img_dsc_t* image);
+    // Show the image without copying it, the display keeps a reference while it is shown, nullptr hides it
+    virtual void SetPreviewImage(std::shared_ptr<PreviewImage> image);
+    // The largest preview that is shown without scaling, the cameras decimate their frames to fit
+    virtual void GetPreviewMaxSize(int& width, int& height) { width = width_ / 2; height = height_ / 2; }
     virtual void SetTheme(const std::string& theme_name);
     virtual std::string GetTheme() { return current_theme_name_; }
+    // Redraws the changed items in one lock, update_all re-reads every item. It runs on a one-shot timer
+    // when an item is marked dirty, a poll is due or the clock changes, not on a fixed tick.
     virtual void UpdateStatusBar(bool update_all = false);
+    // Called by the sources of the items on changes, the update runs right away
+    void MarkStatusBarDirty(uint32_t items);
     virtual void SetPowerSaveMode(bool on);
+    // Animate a standard scene over the UI for a few seconds, return the frame rate and render / flush times
+    std::string RunBenchmark(int seconds);
+    // Replay the display calls of a recorded conversation on an off-screen copy of the UI, return the cost
+    // of every call and its first frame. The shown UI and the saved theme are left untouched.
+    std::string RunReplayBenchmark();
+    // The lock waits and holds per caller and the frame times since the last reset
+    virtual std::string GetStatisticsJson(bool reset = false);
 
     inline int width() const { return width_; }
     inline int height() const { return height_; }
@@ -55,11 +86,35 @@ protected:
     const char* battery_icon_ = nullptr;
     const char* network_icon_ = nullptr;
     bool muted_ = false;
+    bool low_battery_ = false;
     std::string current_theme_name_;
+    bool save_theme_ = true;    // The replay display changes its theme without saving it
 
+    std::atomic<uint32_t> status_bar_dirty_ = kStatusBarAll;
+    esp_timer_handle_t status_bar_timer_ = nullptr;
+    std::mutex status_bar_timer_mutex_;
+    int64_t status_bar_due_time_ = 0;
+    int64_t battery_poll_time_ = 0;
+    int64_t network_poll_time_ = 0;
+    bool has_battery_ = true;    // Cleared when the board reports no battery, it is not polled then
+    bool clock_shown_ = false;
+    int clock_minute_ = -1;
     std::chrono::system_clock::time_point last_status_update_time_;
     esp_timer_handle_t notification_timer_ = nullptr;
 
+#if CONFIG_USE_DISPLAY_STATISTICS
+    DisplayStats stats_;
+#endif
+
+    // Record the LVGL refreshes and flushes of display_ in the trace buffer and the display statistics
+    void InstrumentRefresh();
+    // Run UpdateStatusBar() on the timer after the delay, unless it is already due earlier
+    void ScheduleStatusBarUpdate(int64_t delay_us);
+    // An off-screen copy of the UI with the same size, fonts and theme for RunReplayBenchmark(), called with
+    // the display locked, nullptr if the display can't make one
+    virtual std::unique_ptr<Display> CreateReplayDisplay() { return nullptr; }
+    std::string ReplayConversation(const std::shared_ptr<PreviewImage>& image, size_t& min_free);
+
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
@@ -68,17 +123,21 @@ protected:
 
 class DisplayLockGuard {
 public:
-    DisplayLockGuard(Display *display) : display_(display) {
-        if (!display_->Lock(30000)) {
-            ESP_LOGE("Display", "Failed to lock display");
-        }
-    }
-    ~DisplayLockGuard() {
-        display_->Unlock();
-    }
+    // The lock statistics are kept per tag and task, the tag is the calling function by default
+    DisplayLockGuard(Display *display, const char* tag = __builtin_FUNCTION());
+    ~DisplayLockGuard();
 
 private:
     Display *display_;
+    bool locked_ = false;
+#if CONFIG_USE_DISPLAY_STATISTICS
+    const char* tag_ = nullptr;
+    const char* previous_holder_ = nullptr;
+    DisplayLockCaller* caller_ = nullptr;
+    int64_t locked_time_ = 0;
+#endif
+    // The LVGL objects created while the display is locked are attributed to the display
+    HeapTagScope heap_tag_{kHeapTagDisplay};
 };
 
 class NoDisplay : public Display {
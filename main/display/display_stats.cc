@@ -0,0 +1,163 @@
+#include "display_stats.h"
+
+#if CONFIG_USE_DISPLAY_STATISTICS
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+DisplayStats::DisplayStats() {
+    Reset();
+}
+
+void DisplayStats::Reset() {
+    memset(callers_, 0, sizeof(callers_));
+    caller_count_ = 0;
+    timeouts_ = 0;
+    last_timeout_tag_ = nullptr;
+    frames_ = 0;
+    flushes_ = 0;
+    dropped_frames_ = 0;
+    render_us_ = 0;
+    flush_us_ = 0;
+    flush_wait_us_ = 0;
+    max_frame_us_ = 0;
+    start_time_ = esp_timer_get_time();
+}
+
+DisplayLockCaller* DisplayStats::RecordWait(const char* tag, const char* holder, int64_t wait_us) {
+    // The tags are string literals, the same function called from another task is another caller
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    DisplayLockCaller* caller = nullptr;
+    for (int i = 0; i < caller_count_; i++) {
+        if (callers_[i].tag == tag && callers_[i].task == task) {
+            caller = &callers_[i];
+            break;
+        }
+    }
+    if (caller == nullptr) {
+        if (caller_count_ < DISPLAY_STATS_MAX_CALLERS - 1) {
+            // A guard that was open during Reset() may have written to the free entries
+            caller = &callers_[caller_count_++];
+            *caller = {};
+            caller->tag = tag;
+            caller->task = task;
+            strncpy(caller->task_name, pcTaskGetName(task), sizeof(caller->task_name) - 1);
+        } else {
+            // The last entry collects the callers that don't fit
+            caller = &callers_[DISPLAY_STATS_MAX_CALLERS - 1];
+            caller->tag = "other";
+            caller_count_ = DISPLAY_STATS_MAX_CALLERS;
+        }
+    }
+
+    caller->count++;
+    caller->wait_us += wait_us;
+    if (wait_us >= DISPLAY_LOCK_CONTENDED_US) {
+        caller->contended++;
+    }
+    if (wait_us > caller->max_wait_us) {
+        caller->max_wait_us = wait_us;
+        caller->max_wait_holder = holder;
+    }
+    return caller;
+}
+
+void DisplayStats::RecordHold(DisplayLockCaller* caller, int64_t hold_us) {
+    caller->hold_us += hold_us;
+    caller->max_hold_us = std::max(caller->max_hold_us, hold_us);
+}
+
+void DisplayStats::RecordTimeout(const char* tag) {
+    timeouts_++;
+    last_timeout_tag_ = tag;
+}
+
+void DisplayStats::OnRefreshEvent(lv_event_code_t code) {
+    int64_t now = esp_timer_get_time();
+    switch (code) {
+        case LV_EVENT_REFR_START:
+            refresh_start_ = now;
+            frame_flush_us_ = 0;
+            frame_flush_wait_us_ = 0;
+            frame_flushes_ = 0;
+            break;
+        case LV_EVENT_FLUSH_START:
+            flush_start_ = now;
+            frame_flushes_++;
+            break;
+        case LV_EVENT_FLUSH_FINISH:
+            frame_flush_us_ += now - flush_start_;
+            break;
+        case LV_EVENT_FLUSH_WAIT_START:
+            flush_wait_start_ = now;
+            break;
+        case LV_EVENT_FLUSH_WAIT_FINISH:
+            frame_flush_wait_us_ += now - flush_wait_start_;
+            break;
+        case LV_EVENT_REFR_READY: {
+            // Only the refreshes that redrew something are frames
+            if (frame_flushes_ == 0) {
+                break;
+            }
+            int64_t frame_us = now - refresh_start_;
+            frames_++;
+            flushes_ += frame_flushes_;
+            flush_us_ += frame_flush_us_;
+            flush_wait_us_ += frame_flush_wait_us_;
+            render_us_ += frame_us - frame_flush_us_ - frame_flush_wait_us_;
+            max_frame_us_ = std::max(max_frame_us_, frame_us);
+            // The next refresh starts late by the whole periods the frame overran
+            dropped_frames_ += frame_us / (LV_DEF_REFR_PERIOD * 1000);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::string DisplayStats::GetJson() {
+    int64_t elapsed_ms = std::max<int64_t>((esp_timer_get_time() - start_time_) / 1000, 1);
+    uint32_t frames = std::max<uint32_t>(frames_, 1);
+    // newlib nano printf has no float formats, the frame rate is printed from tenths
+    uint32_t fps = frames_ * 10000LL / elapsed_ms;
+    const char* last_timeout_tag = last_timeout_tag_.load();
+
+    char buffer[384];
+    snprintf(buffer, sizeof(buffer), "{\"seconds\":%ld,\"frames\":{\"target_fps\":%d,\"fps\":%lu.%lu,\"frames\":%lu,"
+        "\"dropped\":%lu,\"flushes_per_frame\":%lu,\"render_us\":%ld,\"flush_us\":%ld,\"flush_wait_us\":%ld,"
+        "\"max_frame_us\":%ld},\"lock\":{\"timeouts\":%lu,\"last_timeout\":\"%s\",\"callers\":[",
+        (long)(elapsed_ms / 1000), 1000 / LV_DEF_REFR_PERIOD, (unsigned long)(fps / 10), (unsigned long)(fps % 10),
+        (unsigned long)frames_, (unsigned long)dropped_frames_, (unsigned long)(flushes_ / frames),
+        (long)(render_us_ / frames), (long)(flush_us_ / frames), (long)(flush_wait_us_ / frames), (long)max_frame_us_,
+        (unsigned long)timeouts_.load(), last_timeout_tag != nullptr ? last_timeout_tag : "");
+    std::string json = buffer;
+
+    // The callers that waited the longest first
+    DisplayLockCaller* sorted[DISPLAY_STATS_MAX_CALLERS];
+    for (int i = 0; i < caller_count_; i++) {
+        sorted[i] = &callers_[i];
+    }
+    std::sort(sorted, sorted + caller_count_, [](const DisplayLockCaller* a, const DisplayLockCaller* b) {
+        return a->wait_us > b->wait_us;
+    });
+    json.reserve(json.size() + caller_count_ * 220);
+    for (int i = 0; i < caller_count_; i++) {
+        auto caller = sorted[i];
+        if (caller->count == 0) {
+            continue;
+        }
+        // Without a guard, the lock is held by the LVGL task for its timers and refreshes
+        snprintf(buffer, sizeof(buffer), "%s{\"tag\":\"%s\",\"task\":\"%s\",\"count\":%lu,\"contended\":%lu,"
+            "\"avg_wait_us\":%ld,\"max_wait_us\":%ld,\"max_wait_holder\":\"%s\",\"avg_hold_us\":%ld,\"max_hold_us\":%ld}",
+            json.back() == '[' ? "" : ",", caller->tag, caller->task_name, (unsigned long)caller->count,
+            (unsigned long)caller->contended, (long)(caller->wait_us / caller->count), (long)caller->max_wait_us,
+            caller->max_wait_holder != nullptr ? caller->max_wait_holder : "lvgl",
+            (long)(caller->hold_us / caller->count), (long)caller->max_hold_us);
+        json += buffer;
+    }
+    json += "]}}";
+    return json;
+}
+
+#endif // CONFIG_USE_DISPLAY_STATISTICS
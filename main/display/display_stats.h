@@ -0,0 +1,87 @@
+#ifndef DISPLAY_STATS_H
+#define DISPLAY_STATS_H
+
+#include <lvgl.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "sdkconfig.h"
+
+/*
+ * Display lock and frame time statistics (CONFIG_USE_DISPLAY_STATISTICS)
+ *
+ * DisplayLockGuard records how long every caller waited for the display lock and how long it held it, per
+ * caller tag and task, and which tag held the lock when the longest wait started. The LVGL refresh events
+ * record the render and flush times of every frame, a frame that takes longer than the LVGL refresh period
+ * drops the frames it overlaps. Everything but the timeouts is updated with the display locked, so the
+ * statistics need no lock of their own, and the tables are fixed size.
+ */
+#define DISPLAY_STATS_MAX_CALLERS 32
+// The waits from this long are contended, they are recorded in the trace too
+#define DISPLAY_LOCK_CONTENDED_US 1000
+
+struct DisplayLockCaller {
+    const char* tag;
+    TaskHandle_t task;
+    char task_name[configMAX_TASK_NAME_LEN];
+    uint32_t count;
+    uint32_t contended;
+    int64_t wait_us;
+    int64_t max_wait_us;
+    const char* max_wait_holder;
+    int64_t hold_us;
+    int64_t max_hold_us;
+};
+
+class DisplayStats {
+public:
+    DisplayStats();
+    // 删除拷贝构造函数和赋值运算符
+    DisplayStats(const DisplayStats&) = delete;
+    DisplayStats& operator=(const DisplayStats&) = delete;
+
+    // The tag of the guard that holds the lock, nullptr while only the LVGL task holds it
+    inline const char* holder() const { return holder_.load(std::memory_order_relaxed); }
+    inline const char* SetHolder(const char* tag) { return holder_.exchange(tag, std::memory_order_relaxed); }
+
+    DisplayLockCaller* RecordWait(const char* tag, const char* holder, int64_t wait_us);
+    void RecordHold(DisplayLockCaller* caller, int64_t hold_us);
+    // Called without the lock
+    void RecordTimeout(const char* tag);
+    // Called from the LVGL display events
+    void OnRefreshEvent(lv_event_code_t code);
+
+    std::string GetJson();
+    void Reset();
+
+private:
+    std::atomic<const char*> holder_ = nullptr;
+    std::atomic<uint32_t> timeouts_ = 0;
+    std::atomic<const char*> last_timeout_tag_ = nullptr;
+
+    DisplayLockCaller callers_[DISPLAY_STATS_MAX_CALLERS];
+    int caller_count_ = 0;
+    int64_t start_time_ = 0;
+
+    // The frame being refreshed
+    int64_t refresh_start_ = 0;
+    int64_t flush_start_ = 0;
+    int64_t flush_wait_start_ = 0;
+    int64_t frame_flush_us_ = 0;
+    int64_t frame_flush_wait_us_ = 0;
+    uint32_t frame_flushes_ = 0;
+
+    uint32_t frames_ = 0;
+    uint32_t flushes_ = 0;
+    uint32_t dropped_frames_ = 0;
+    int64_t render_us_ = 0;
+    int64_t flush_us_ = 0;
+    int64_t flush_wait_us_ = 0;
+    int64_t max_frame_us_ = 0;
+};
+
+#endif // DISPLAY_STATS_H
@@ -0,0 +1,307 @@
+#include "emotion_player.h"
+
+#if CONFIG_USE_EMOTION_ANIMATIONS
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define TAG "EmotionPlayer"
+
+bool EmotionPlayer::Open(const char* partition_label) {
+    auto partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    if (partition == nullptr) {
+        ESP_LOGI(TAG, "No %s partition, the emotions are shown with the emoji font", partition_label);
+        return false;
+    }
+    const void* data = nullptr;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &data, &mmap_handle_);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to map the %s partition: %s", partition_label, esp_err_to_name(err));
+        return false;
+    }
+    pack_ = (const uint8_t*)data;
+    pack_size_ = partition->size;
+
+    // Check every offset once, the decoder trusts them afterwards
+    auto header = (const EmotionPackHeader*)pack_;
+    bool valid = memcmp(header->magic, EMOTION_PACK_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == EMOTION_PACK_VERSION && header->count > 0 &&
+        sizeof(EmotionPackHeader) + header->count * sizeof(EmotionPackEntry) <= pack_size_;
+    size_t max_pixels = 0;
+    if (valid) {
+        entries_ = (const EmotionPackEntry*)(pack_ + sizeof(EmotionPackHeader));
+        for (int i = 0; i < header->count && valid; i++) {
+            auto& entry = entries_[i];
+            valid = entry.width > 0 && entry.height > 0 && entry.fps > 0 && entry.frame_count > 0 &&
+                entry.frame_table % 4 == 0 && entry.frame_table + (entry.frame_count + 1) * 4 <= pack_size_;
+            if (valid) {
+                auto offsets = (const uint32_t*)(pack_ + entry.frame_table);
+                for (int frame = 0; frame < entry.frame_count && valid; frame++) {
+                    valid = offsets[frame] % 2 == 0 && offsets[frame] <= offsets[frame + 1] &&
+                        offsets[frame + 1] <= pack_size_;
+                }
+            }
+            max_pixels = std::max(max_pixels, (size_t)entry.width * entry.height);
+        }
+    }
+    if (!valid) {
+        ESP_LOGW(TAG, "No valid emotion pack in the %s partition", partition_label);
+        esp_partition_munmap(mmap_handle_);
+        pack_ = nullptr;
+        entries_ = nullptr;
+        return false;
+    }
+    for (auto& slot : slots_) {
+        auto pixels = heap_caps_malloc(max_pixels * 2, MALLOC_CAP_SPIRAM);
+        if (pixels == nullptr) {
+            pixels = heap_caps_malloc(max_pixels * 2, MALLOC_CAP_8BIT);
+        }
+        if (pixels == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate the frame buffers");
+            return false;
+        }
+        slot.dsc.header.magic = LV_IMAGE_HEADER_MAGIC;
+        slot.dsc.header.cf = LV_COLOR_FORMAT_RGB565;
+        slot.dsc.data = (const uint8_t*)pixels;
+        slot.state = kSlotFree;
+    }
+    entry_count_ = header->count;
+
+    xTaskCreate([](void* arg) {
+        EmotionPlayer* player = (EmotionPlayer*)arg;
+        player->DecoderTask();
+        vTaskDelete(NULL);
+    }, "emotion_decoder", 2048 + 1024, this, 2, &decoder_task_);
+    ESP_LOGI(TAG, "%d emotions in the %s partition, frame buffers: %d x %u bytes", entry_count_, partition_label,
+        EMOTION_PLAYER_FRAME_SLOTS, max_pixels * 2);
+    return true;
+}
+
+EmotionPlayer::~EmotionPlayer() {
+    if (timer_ != nullptr) {
+        lv_timer_delete(timer_);
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopped_ = true;
+        condition_.notify_all();
+        condition_.wait(lock, [this]() { return decoder_task_ == nullptr; });
+    }
+    for (auto& slot : slots_) {
+        heap_caps_free((void*)slot.dsc.data);
+    }
+    if (pack_ != nullptr) {
+        esp_partition_munmap(mmap_handle_);
+    }
+}
+
+const EmotionPackEntry* EmotionPlayer::FindEmotion(const char* name) const {
+    for (int i = 0; i < entry_count_; i++) {
+        if (strncmp(entries_[i].name, name, EMOTION_NAME_LENGTH) == 0) {
+            return &entries_[i];
+        }
+    }
+    return nullptr;
+}
+
+bool EmotionPlayer::Play(const char* name, lv_obj_t* image) {
+    auto entry = FindEmotion(name);
+    if (entry == nullptr || decoder_task_ == nullptr) {
+        return false;
+    }
+    image_ = image;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ == entry) {
+            return true;
+        }
+        current_ = entry;
+        generation_++;
+        start_time_ = esp_timer_get_time();
+        last_frame_ = -1;
+        frame_wanted_ = true;
+        // The shown frame stays until the first frame of the new animation replaces it
+        for (auto& slot : slots_) {
+            if (slot.state == kSlotReady) {
+                slot.state = kSlotFree;
+            }
+        }
+    }
+    condition_.notify_one();
+
+    uint32_t period = 1000 / entry->fps;
+    if (timer_ == nullptr) {
+        timer_ = lv_timer_create([](lv_timer_t* timer) {
+            auto player = (EmotionPlayer*)lv_timer_get_user_data(timer);
+            player->ShowNextFrame();
+        }, period, this);
+    } else {
+        lv_timer_set_period(timer_, period);
+        lv_timer_resume(timer_);
+    }
+    return true;
+}
+
+void EmotionPlayer::Stop() {
+    if (timer_ != nullptr) {
+        lv_timer_pause(timer_);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = nullptr;
+    generation_++;
+    for (auto& slot : slots_) {
+        if (slot.state == kSlotReady) {
+            slot.state = kSlotFree;
+        }
+    }
+}
+
+void EmotionPlayer::ShowNextFrame() {
+    FrameSlot* ready = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& slot : slots_) {
+            if (slot.state == kSlotReady) {
+                ready = &slot;
+            }
+        }
+        if (ready != nullptr) {
+            for (auto& slot : slots_) {
+                if (slot.state == kSlotShown) {
+                    slot.state = kSlotFree;
+                }
+            }
+            ready->state = kSlotShown;
+            frames_shown_++;
+        }
+        frame_wanted_ = true;
+    }
+    condition_.notify_one();
+
+    // The decoder doesn't touch the shown slot, it is read without the lock
+    if (ready != nullptr && image_ != nullptr) {
+        // The slots are reused, don't let the image cache keep the pixels of an older frame
+        lv_image_cache_drop(&ready->dsc);
+        lv_image_set_src(image_, &ready->dsc);
+    }
+}
+
+void EmotionPlayer::DecoderTask() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        condition_.wait(lock, [this]() { return stopped_ || (current_ != nullptr && frame_wanted_); });
+        if (stopped_) {
+            break;
+        }
+        frame_wanted_ = false;
+
+        // Decode the frame due at the next tick of the timer, the late frames are skipped
+        auto entry = current_;
+        auto generation = generation_;
+        int64_t elapsed_us = esp_timer_get_time() - start_time_ + 1000000 / entry->fps;
+        int frame = (int)(elapsed_us * entry->fps / 1000000 % entry->frame_count);
+        if (frame == last_frame_) {
+            continue;
+        }
+        // At most one slot is shown and one is ready, so one is free
+        FrameSlot* slot = nullptr;
+        for (auto& s : slots_) {
+            if (s.state == kSlotFree) {
+                slot = &s;
+                break;
+            }
+        }
+        if (slot == nullptr) {
+            continue;
+        }
+        slot->state = kSlotDecoding;
+        slot->dsc.header.w = entry->width;
+        slot->dsc.header.h = entry->height;
+        slot->dsc.header.stride = entry->width * 2;
+        slot->dsc.data_size = entry->width * entry->height * 2;
+
+        lock.unlock();
+        int64_t start_time = esp_timer_get_time();
+        bool decoded = DecodeFrame(entry, frame, (uint16_t*)slot->dsc.data);
+        int64_t decode_time_us = esp_timer_get_time() - start_time;
+        lock.lock();
+
+        if (!decoded || generation != generation_) {
+            if (!decoded) {
+                ESP_LOGE(TAG, "Failed to decode frame %d of %.*s", frame, EMOTION_NAME_LENGTH, entry->name);
+            }
+            slot->state = kSlotFree;
+            continue;
+        }
+        frames_decoded_++;
+        decode_time_us_ += decode_time_us;
+        max_decode_time_us_ = std::max(max_decode_time_us_, decode_time_us);
+        if (last_frame_ >= 0) {
+            int step = (frame - last_frame_ + entry->frame_count) % entry->frame_count;
+            frames_skipped_ += step > 1 ? step - 1 : 0;
+        }
+        // A ready frame that was not shown in time is replaced
+        for (auto& s : slots_) {
+            if (s.state == kSlotReady) {
+                s.state = kSlotFree;
+                frames_skipped_++;
+            }
+        }
+        slot->frame = frame;
+        slot->state = kSlotReady;
+        last_frame_ = frame;
+    }
+    decoder_task_ = nullptr;
+    condition_.notify_all();
+}
+
+/*
+ * A frame is a sequence of 16-bit tokens: a token with the high bit set repeats the next pixel
+ * (token & 0x7FFF) + 1 times, otherwise (token + 1) literal pixels follow.
+ */
+bool EmotionPlayer::DecodeFrame(const EmotionPackEntry* entry, int frame, uint16_t* pixels) {
+    auto offsets = (const uint32_t*)(pack_ + entry->frame_table);
+    auto src = (const uint16_t*)(pack_ + offsets[frame]);
+    auto end = (const uint16_t*)(pack_ + offsets[frame + 1]);
+    size_t pixel_count = (size_t)entry->width * entry->height;
+    size_t n = 0;
+    while (n < pixel_count) {
+        if (src >= end) {
+            return false;
+        }
+        uint16_t token = *src++;
+        size_t count = (token & 0x7FFF) + 1;
+        if (n + count > pixel_count) {
+            return false;
+        }
+        if (token & 0x8000) {
+            if (src >= end) {
+                return false;
+            }
+            std::fill(pixels + n, pixels + n + count, *src++);
+        } else {
+            if (src + count > end) {
+                return false;
+            }
+            memcpy(pixels + n, src, count * 2);
+            src += count;
+        }
+        n += count;
+    }
+    return true;
+}
+
+std::string EmotionPlayer::GetStatisticsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "{\"frames_shown\":%lu,\"frames_decoded\":%lu,\"frames_skipped\":%lu,"
+        "\"avg_decode_us\":%ld,\"max_decode_us\":%ld}",
+        (unsigned long)frames_shown_, (unsigned long)frames_decoded_, (unsigned long)frames_skipped_,
+        (long)(frames_decoded_ > 0 ? decode_time_us_ / frames_decoded_ : 0), (long)max_decode_time_us_);
+    return buffer;
+}
+
+#endif // CONFIG_USE_EMOTION_ANIMATIONS
@@ -0,0 +1,112 @@
+#ifndef EMOTION_PLAYER_H
+#define EMOTION_PLAYER_H
+
+#include <lvgl.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+#include "sdkconfig.h"
+
+/*
+ * Animated emotions from a flash partition (CONFIG_USE_EMOTION_ANIMATIONS)
+ *
+ * The partition holds a pack made by scripts/pack_emotions.py, it is memory mapped and never copied.
+ * Every frame of an animation is RLE compressed RGB565 and can be decoded on its own. A background
+ * task decodes the frame due at the current time into a small cache of frame buffers, and an LVGL
+ * timer shows the latest decoded frame at the frame rate of the animation. When decoding falls behind,
+ * the frames that are already late are skipped instead of slowing the animation down.
+ */
+#define EMOTION_PACK_MAGIC "EMOT"
+#define EMOTION_PACK_VERSION 1
+#define EMOTION_NAME_LENGTH 16
+// One frame shown, one decoded and waiting for its turn, one being decoded
+#define EMOTION_PLAYER_FRAME_SLOTS 3
+
+struct EmotionPackHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+};
+
+struct EmotionPackEntry {
+    char name[EMOTION_NAME_LENGTH];
+    uint16_t width;
+    uint16_t height;
+    uint16_t fps;
+    uint16_t frame_count;
+    uint32_t frame_table;   // Offset of frame_count + 1 frame offsets, from the start of the pack
+};
+
+class EmotionPlayer {
+public:
+    EmotionPlayer() = default;
+    ~EmotionPlayer();
+    // 删除拷贝构造函数和赋值运算符
+    EmotionPlayer(const EmotionPlayer&) = delete;
+    EmotionPlayer& operator=(const EmotionPlayer&) = delete;
+
+    // Map the pack in the partition and start the decoder task, false if there is no valid pack
+    bool Open(const char* partition_label);
+    bool HasEmotion(const char* name) const { return FindEmotion(name) != nullptr; }
+
+    // Called from the LVGL task with the display locked
+    bool Play(const char* name, lv_obj_t* image);
+    void Stop();
+    std::string GetStatisticsJson();
+
+private:
+    enum SlotState : uint8_t {
+        kSlotFree,
+        kSlotDecoding,
+        kSlotReady,
+        kSlotShown,
+    };
+
+    struct FrameSlot {
+        lv_img_dsc_t dsc;
+        SlotState state;
+        int frame;
+    };
+
+    esp_partition_mmap_handle_t mmap_handle_ = 0;
+    const uint8_t* pack_ = nullptr;
+    size_t pack_size_ = 0;
+    const EmotionPackEntry* entries_ = nullptr;
+    int entry_count_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    TaskHandle_t decoder_task_ = nullptr;
+    bool stopped_ = false;
+    FrameSlot slots_[EMOTION_PLAYER_FRAME_SLOTS] = {};
+
+    // Protected by mutex_, a new generation discards the frames of the last animation
+    const EmotionPackEntry* current_ = nullptr;
+    uint32_t generation_ = 0;
+    int64_t start_time_ = 0;
+    int last_frame_ = -1;
+    bool frame_wanted_ = false;
+
+    // Only used by the LVGL task
+    lv_obj_t* image_ = nullptr;
+    lv_timer_t* timer_ = nullptr;
+
+    uint32_t frames_shown_ = 0;
+    uint32_t frames_skipped_ = 0;
+    uint32_t frames_decoded_ = 0;
+    int64_t decode_time_us_ = 0;
+    int64_t max_decode_time_us_ = 0;
+
+    const EmotionPackEntry* FindEmotion(const char* name) const;
+    void DecoderTask();
+    void ShowNextFrame();
+    bool DecodeFrame(const EmotionPackEntry* entry, int frame, uint16_t* pixels);
+};
+
+#endif // EMOTION_PLAYER_H
@@ -16,7 +16,7 @@ public:
     virtual void SetEmotion(const char* emotion) override;
     virtual void SetChatMessage(const char* role, const char* content) override; 
     virtual void SetIcon(const char* icon) override;
-    virtual inline void SetPreviewImage(const lv_img_dsc_t* image) override {}
+    virtual inline void SetPreviewImage(std::shared_ptr<PreviewImage> image) override {}
     virtual inline void SetTheme(const std::string& theme_name) override {}
     virtual inline void UpdateStatusBar(bool update_all = false) override {}
 
@@ -0,0 +1,201 @@
+#include "glyph_cache.h"
+
+#if CONFIG_USE_DISPLAY_GLYPH_CACHE
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstdio>
+#include <cstring>
+
+#define TAG "GlyphCache"
+
+// Don't let one large glyph evict many small ones
+#define GLYPH_CACHE_MAX_BITMAP_SHARE 8
+
+template <typename T>
+static T* AllocateTable(size_t count) {
+    auto table = (T*)heap_caps_calloc(count, sizeof(T), MALLOC_CAP_SPIRAM);
+    if (table == nullptr) {
+        table = (T*)heap_caps_calloc(count, sizeof(T), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    return table;
+}
+
+// The least recently used entry of a set, an empty one first
+template <typename T>
+static T* FindVictim(T* set) {
+    T* victim = &set[0];
+    for (int i = 1; i < GLYPH_CACHE_WAYS && victim->last_used != 0; i++) {
+        if (set[i].last_used < victim->last_used) {
+            victim = &set[i];
+        }
+    }
+    return victim;
+}
+
+GlyphCache::GlyphCache(const lv_font_t* font) : source_font_(font) {
+    cached_font_.font = *font;
+    cached_font_.font.get_glyph_dsc = GetGlyphDsc;
+    cached_font_.font.get_glyph_bitmap = GetGlyphBitmap;
+    cached_font_.cache = this;
+
+    // The metrics of the fonts without kerning don't depend on the next letter
+    if (font->get_glyph_dsc == lv_font_get_glyph_dsc_fmt_txt) {
+        auto fdsc = (const lv_font_fmt_txt_dsc_t*)font->dsc;
+        kerning_ = fdsc->kern_dsc != nullptr;
+    }
+
+    set_count_ = CONFIG_DISPLAY_GLYPH_CACHE_SIZE / GLYPH_CACHE_WAYS;
+    glyphs_ = AllocateTable<GlyphEntry>(set_count_ * GLYPH_CACHE_WAYS);
+#if CONFIG_DISPLAY_GLYPH_BITMAP_CACHE_KB > 0
+    bitmaps_ = AllocateTable<BitmapEntry>(set_count_ * GLYPH_CACHE_WAYS);
+#endif
+    if (glyphs_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the glyph cache");
+    }
+    ESP_LOGI(TAG, "Glyph cache: %lu entries, bitmaps: %d KB, kerning: %d",
+        (unsigned long)(set_count_ * GLYPH_CACHE_WAYS), bitmaps_ != nullptr ? CONFIG_DISPLAY_GLYPH_BITMAP_CACHE_KB : 0, kerning_);
+}
+
+GlyphCache::~GlyphCache() {
+    if (bitmaps_ != nullptr) {
+        for (uint32_t i = 0; i < set_count_ * GLYPH_CACHE_WAYS; i++) {
+            heap_caps_free(bitmaps_[i].data);
+        }
+        heap_caps_free(bitmaps_);
+    }
+    heap_caps_free(glyphs_);
+}
+
+uint32_t GlyphCache::GetSet(uint32_t key) const {
+    return (key * 2654435761u) % set_count_;
+}
+
+bool GlyphCache::GetGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next) {
+    return ((const CachedFont*)font)->cache->LookupGlyph(dsc, letter, letter_next);
+}
+
+const void* GlyphCache::GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    return ((const CachedFont*)dsc->resolved_font)->cache->LookupBitmap(dsc, draw_buf);
+}
+
+bool GlyphCache::LookupGlyph(lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next) {
+    if (glyphs_ == nullptr) {
+        return source_font_->get_glyph_dsc(&cached_font_.font, dsc, letter, letter_next);
+    }
+    if (!kerning_) {
+        letter_next = 0;
+    }
+
+    auto set = &glyphs_[GetSet(letter ^ (letter_next << 16)) * GLYPH_CACHE_WAYS];
+    tick_++;
+    for (int i = 0; i < GLYPH_CACHE_WAYS; i++) {
+        auto& entry = set[i];
+        if (entry.last_used != 0 && entry.letter == letter && entry.letter_next == letter_next) {
+            entry.last_used = tick_;
+            *dsc = entry.dsc;
+            glyph_hits_++;
+            return entry.found;
+        }
+    }
+
+    glyph_misses_++;
+    bool found = source_font_->get_glyph_dsc(&cached_font_.font, dsc, letter, letter_next);
+    // The glyphs with a cache entry of the font itself are not copied
+    if (dsc->entry == nullptr) {
+        auto victim = FindVictim(set);
+        victim->letter = letter;
+        victim->letter_next = letter_next;
+        victim->last_used = tick_;
+        victim->found = found;
+        victim->dsc = *dsc;
+    }
+    return found;
+}
+
+const void* GlyphCache::LookupBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf) {
+    // Only the alpha bitmaps that the font writes into the draw buffer are copied
+    if (bitmaps_ == nullptr || draw_buf == nullptr ||
+        dsc->format == LV_FONT_GLYPH_FORMAT_NONE || dsc->format > LV_FONT_GLYPH_FORMAT_A8) {
+        return source_font_->get_glyph_bitmap(dsc, draw_buf);
+    }
+
+    uint32_t gid = dsc->gid.index;
+    uint32_t stride = draw_buf->header.stride;
+    auto set = &bitmaps_[GetSet(gid) * GLYPH_CACHE_WAYS];
+    tick_++;
+    for (int i = 0; i < GLYPH_CACHE_WAYS; i++) {
+        auto& entry = set[i];
+        if (entry.last_used != 0 && entry.gid == gid && entry.stride == stride) {
+            entry.last_used = tick_;
+            memcpy(draw_buf->data, entry.data, entry.size);
+            bitmap_hits_++;
+            return entry.returns_draw_buf ? (const void*)draw_buf : (const void*)draw_buf->data;
+        }
+    }
+
+    bitmap_misses_++;
+    auto bitmap = source_font_->get_glyph_bitmap(dsc, draw_buf);
+    if (bitmap != draw_buf && bitmap != draw_buf->data) {
+        return bitmap;
+    }
+    uint32_t size = stride * dsc->box_h;
+    const size_t budget = CONFIG_DISPLAY_GLYPH_BITMAP_CACHE_KB * 1024;
+    if (size == 0 || size > budget / GLYPH_CACHE_MAX_BITMAP_SHARE) {
+        return bitmap;
+    }
+
+    auto victim = FindVictim(set);
+    if (victim->data != nullptr) {
+        heap_caps_free(victim->data);
+        victim->data = nullptr;
+        victim->last_used = 0;
+        bitmap_bytes_ -= victim->size;
+    }
+    if (bitmap_bytes_ + size > budget) {
+        return bitmap;
+    }
+    victim->data = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (victim->data == nullptr) {
+        return bitmap;
+    }
+    memcpy(victim->data, draw_buf->data, size);
+    victim->gid = gid;
+    victim->last_used = tick_;
+    victim->stride = stride;
+    victim->size = size;
+    victim->returns_draw_buf = bitmap == draw_buf;
+    bitmap_bytes_ += size;
+    return bitmap;
+}
+
+lv_coord_t GlyphCache::GetTextWidth(const char* text, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    }
+    auto& entry = text_widths_[hash % GLYPH_CACHE_TEXT_WIDTHS];
+    if (entry.hash == hash && entry.length == length) {
+        text_hits_++;
+        return entry.width;
+    }
+    text_misses_++;
+    entry.hash = hash;
+    entry.length = length;
+    entry.width = lv_txt_get_width(text, length, font(), 0);
+    return entry.width;
+}
+
+std::string GlyphCache::GetStatisticsJson() {
+    char buffer[200];
+    snprintf(buffer, sizeof(buffer), "{\"glyph_hits\":%lu,\"glyph_misses\":%lu,\"bitmap_hits\":%lu,\"bitmap_misses\":%lu,"
+        "\"bitmap_bytes\":%lu,\"text_hits\":%lu,\"text_misses\":%lu}",
+        (unsigned long)glyph_hits_, (unsigned long)glyph_misses_, (unsigned long)bitmap_hits_,
+        (unsigned long)bitmap_misses_, (unsigned long)bitmap_bytes_, (unsigned long)text_hits_, (unsigned long)text_misses_);
+    return buffer;
+}
+
+#endif // CONFIG_USE_DISPLAY_GLYPH_CACHE
@@ -0,0 +1,90 @@
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <lvgl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "sdkconfig.h"
+
+/*
+ * Glyph cache of a font (CONFIG_USE_DISPLAY_GLYPH_CACHE)
+ *
+ * font() is a copy of the font whose callbacks go through the cache: the glyph metrics of the recent
+ * code points, and the decompressed bitmaps of the recent glyphs up to a memory budget, are kept in
+ * set associative LRU tables. GetTextWidth() caches the widths of the recent texts too.
+ * LVGL runs without an OS here, so the cache is only used from the LVGL task with the display locked.
+ */
+#define GLYPH_CACHE_WAYS 4
+#define GLYPH_CACHE_TEXT_WIDTHS 32
+
+class GlyphCache {
+public:
+    explicit GlyphCache(const lv_font_t* font);
+    ~GlyphCache();
+    // 删除拷贝构造函数和赋值运算符
+    GlyphCache(const GlyphCache&) = delete;
+    GlyphCache& operator=(const GlyphCache&) = delete;
+
+    inline const lv_font_t* font() const { return &cached_font_.font; }
+    // Width of the text on one line, like lv_txt_get_width() without letter spacing
+    lv_coord_t GetTextWidth(const char* text, size_t length);
+    std::string GetStatisticsJson();
+
+private:
+    // The cache is found from the font pointer, the font user data belongs to the font
+    struct CachedFont {
+        lv_font_t font;
+        GlyphCache* cache;
+    };
+
+    struct GlyphEntry {
+        uint32_t letter;
+        uint32_t letter_next;   // 0 if the font has no kerning
+        uint32_t last_used;     // 0 for an empty entry
+        bool found;
+        lv_font_glyph_dsc_t dsc;
+    };
+
+    struct BitmapEntry {
+        uint32_t gid;
+        uint32_t last_used;     // 0 for an empty entry
+        uint32_t stride;
+        uint32_t size;
+        bool returns_draw_buf;  // The font returned the draw buffer, otherwise its data
+        uint8_t* data;
+    };
+
+    struct TextWidth {
+        uint32_t hash;
+        uint32_t length;
+        lv_coord_t width;
+    };
+
+    CachedFont cached_font_;
+    const lv_font_t* source_font_;
+    bool kerning_ = true;
+    uint32_t set_count_ = 0;
+    GlyphEntry* glyphs_ = nullptr;
+    BitmapEntry* bitmaps_ = nullptr;
+    size_t bitmap_bytes_ = 0;
+    uint32_t tick_ = 0;
+    TextWidth text_widths_[GLYPH_CACHE_TEXT_WIDTHS] = {};
+
+    uint32_t glyph_hits_ = 0;
+    uint32_t glyph_misses_ = 0;
+    uint32_t bitmap_hits_ = 0;
+    uint32_t bitmap_misses_ = 0;
+    uint32_t text_hits_ = 0;
+    uint32_t text_misses_ = 0;
+
+    static bool GetGlyphDsc(const lv_font_t* font, lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next);
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf);
+    bool LookupGlyph(lv_font_glyph_dsc_t* dsc, uint32_t letter, uint32_t letter_next);
+    const void* LookupBitmap(lv_font_glyph_dsc_t* dsc, lv_draw_buf_t* draw_buf);
+    uint32_t GetSet(uint32_t key) const;
+};
+
+#endif // GLYPH_CACHE_H
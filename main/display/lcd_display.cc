@@ -15,6 +15,9 @@
 
 #define TAG "LcdDisplay"
 
+// The band height of the off-screen replay display, the default of the SPI displays
+#define REPLAY_BUFFER_LINES 20
+
 // Color definitions for dark theme
 #define DARK_BACKGROUND_COLOR       lv_color_hex(0x121212)     // Dark background
 #define DARK_TEXT_COLOR             lv_color_white()           // White text
@@ -67,6 +70,34 @@ const ThemeColors LIGHT_THEME = {
 
 LV_FONT_DECLARE(font_awesome_30_4);
 
+// Apply the render options of the board (DISPLAY_* in Kconfig) to the buffers of the LVGL port display
+static void ApplyRenderConfig(lvgl_port_display_cfg_t& display_cfg) {
+    // 0 keeps the buffer height the display was created with
+    uint32_t lines = CONFIG_DISPLAY_BUFFER_LINES > 0 ? CONFIG_DISPLAY_BUFFER_LINES : display_cfg.buffer_size / display_cfg.hres;
+    lines = std::min<uint32_t>(lines, display_cfg.vres);
+#if CONFIG_DISPLAY_DOUBLE_BUFFER
+    display_cfg.double_buffer = true;
+#else
+    display_cfg.double_buffer = false;
+#endif
+#if CONFIG_DISPLAY_BUFFER_IN_PSRAM
+    // Render into PSRAM, the port copies each band into an internal DMA buffer for the transfer
+    display_cfg.flags.buff_dma = 0;
+    display_cfg.flags.buff_spiram = 1;
+    display_cfg.trans_size = display_cfg.hres * CONFIG_DISPLAY_TRANS_LINES;
+#if CONFIG_DISPLAY_FULL_REFRESH
+    lines = display_cfg.vres;
+    display_cfg.flags.full_refresh = 1;
+#endif
+#else
+    display_cfg.flags.buff_dma = 1;
+    display_cfg.flags.buff_spiram = 0;
+#endif
+    display_cfg.buffer_size = display_cfg.hres * lines;
+    ESP_LOGI(TAG, "Render buffer: %lu lines, double buffer: %d, psram: %d, full refresh: %d", (unsigned long)lines,
+        display_cfg.double_buffer, display_cfg.flags.buff_spiram, display_cfg.flags.full_refresh);
+}
+
 LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel, DisplayFonts fonts, int width, int height)
     : panel_io_(panel_io), panel_(panel), fonts_(fonts) {
     width_ = width;
@@ -82,6 +113,114 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
     } else if (current_theme_name_ == "light") {
         current_theme_ = LIGHT_THEME;
     }
+
+#if CONFIG_USE_DISPLAY_GLYPH_CACHE
+    glyph_cache_ = std::make_unique<GlyphCache>(fonts_.text_font);
+    fonts_.text_font = glyph_cache_->font();
+#endif
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    emotion_player_.Open("emotions");
+#endif
+}
+
+LcdDisplay::LcdDisplay(const LcdDisplay* source) : fonts_(source->fonts_), current_theme_(source->current_theme_) {
+    width_ = source->width_;
+    height_ = source->height_;
+    current_theme_name_ = source->current_theme_name_;
+    save_theme_ = false;
+}
+
+// The LCD UI of LcdDisplay::SetupUI() on an LVGL display without a panel. The frames are rendered into
+// a band buffer in internal RAM like the SPI displays, the flush returns right away. The emotion
+// animations are not played, the emoji labels are shown instead.
+class ReplayLcdDisplay : public LcdDisplay {
+public:
+    explicit ReplayLcdDisplay(const LcdDisplay* source) : LcdDisplay(source) {
+        // The status bar of the replay UI is not updated from the board
+        esp_timer_delete(status_bar_timer_);
+        status_bar_timer_ = nullptr;
+
+        size_t buffer_size = width_ * REPLAY_BUFFER_LINES * sizeof(uint16_t);
+        buffer_ = heap_caps_malloc(buffer_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (buffer_ == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate the replay buffer");
+            return;
+        }
+        display_ = lv_display_create(width_, height_);
+        lv_display_set_color_format(display_, LV_COLOR_FORMAT_RGB565);
+        lv_display_set_buffers(display_, buffer_, nullptr, buffer_size, LV_DISPLAY_RENDER_MODE_PARTIAL);
+        lv_display_set_flush_cb(display_, [](lv_display_t* display, const lv_area_t* area, uint8_t* px_map) {
+            lv_display_flush_ready(display);
+        });
+
+        // SetupUI() builds on the active screen of the default display
+        auto default_display = lv_display_get_default();
+        lv_display_set_default(display_);
+        SetupUI();
+        lv_display_set_default(default_display);
+    }
+
+    virtual ~ReplayLcdDisplay() {
+        // The base destructors delete the widgets one by one, delete the whole display instead
+        DisplayLockGuard lock(this);
+        esp_timer_stop(notification_timer_);
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+        if (chat_stream_timer_ != nullptr) {
+            lv_timer_delete(chat_stream_timer_);
+            chat_stream_timer_ = nullptr;
+        }
+#endif
+        if (display_ != nullptr) {
+            lv_display_delete(display_);
+            display_ = nullptr;
+        }
+        heap_caps_free(buffer_);
+        container_ = nullptr;
+        status_bar_ = nullptr;
+        content_ = nullptr;
+        side_bar_ = nullptr;
+        network_label_ = nullptr;
+        low_battery_popup_ = nullptr;
+    }
+
+private:
+    void* buffer_ = nullptr;
+};
+
+std::unique_ptr<Display> LcdDisplay::CreateReplayDisplay() {
+    auto replay = std::make_unique<ReplayLcdDisplay>(this);
+    if (replay->display_ == nullptr) {
+        return nullptr;
+    }
+    return replay;
+}
+
+std::string LcdDisplay::GetStatisticsJson(bool reset) {
+    auto json = Display::GetStatisticsJson(reset);
+#if CONFIG_USE_DISPLAY_GLYPH_CACHE
+    {
+        DisplayLockGuard lock(this);
+        json.pop_back();
+        json += ",\"glyph_cache\":" + glyph_cache_->GetStatisticsJson() + "}";
+    }
+#endif
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    json.pop_back();
+    json += ",\"emotions\":" + emotion_player_.GetStatisticsJson() + "}";
+#endif
+    return json;
+}
+
+lv_coord_t LcdDisplay::GetTextWidth(const char* text, size_t length) {
+#if CONFIG_USE_DISPLAY_GLYPH_CACHE
+    // The replay display has no cache of its own, its font goes through the cache of the source
+    if (glyph_cache_ != nullptr) {
+        return glyph_cache_->GetTextWidth(text, length);
+    }
+    return lv_txt_get_width(text, length, fonts_.text_font, 0);
+#else
+    return lv_txt_get_width(text, length, fonts_.text_font, 0);
+#endif
 }
 
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
@@ -109,7 +248,7 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding LCD display");
-    const lvgl_port_display_cfg_t display_cfg = {
+    lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
@@ -134,12 +273,14 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
             .direct_mode = 0,
         },
     };
+    ApplyRenderConfig(display_cfg);
 
     display_ = lvgl_port_add_disp(&display_cfg);
     if (display_ == nullptr) {
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    InstrumentRefresh();
 
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
@@ -203,6 +344,7 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         ESP_LOGE(TAG, "Failed to add RGB display");
         return;
     }
+    InstrumentRefresh();
     
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
@@ -229,7 +371,7 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding LCD display");
-    const lvgl_port_display_cfg_t disp_cfg = {
+    lvgl_port_display_cfg_t disp_cfg = {
             .io_handle = panel_io,
             .panel_handle = panel,
             .control_handle = nullptr,
@@ -250,6 +392,7 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
             .sw_rotate = false,
         },
     };
+    ApplyRenderConfig(disp_cfg);
 
     const lvgl_port_display_dsi_cfg_t dpi_cfg = {
         .flags = {
@@ -261,6 +404,7 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+    InstrumentRefresh();
 
     if (offset_x != 0 || offset_y != 0) {
         lv_display_set_offset(display_, offset_x, offset_y);
@@ -270,6 +414,14 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
 }
 
 LcdDisplay::~LcdDisplay() {
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    emotion_player_.Stop();
+#endif
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    if (chat_stream_timer_ != nullptr) {
+        lv_timer_delete(chat_stream_timer_);
+    }
+#endif
     // 然后再清理 LVGL 对象
     if (content_ != nullptr) {
         lv_obj_del(content_);
@@ -350,6 +502,16 @@ void LcdDisplay::SetupUI() {
     // We'll create chat messages dynamically in SetChatMessage
     chat_message_label_ = nullptr;
 
+    // Flushes the text of AppendChatMessage, paused while there is nothing to flush
+    chat_stream_timer_ = lv_timer_create([](lv_timer_t* timer) {
+        auto display = (LcdDisplay*)lv_timer_get_user_data(timer);
+        display->FlushChatStream();
+        if (display->pending_chat_text_.empty() && !display->chat_scroll_pending_) {
+            lv_timer_pause(timer);
+        }
+    }, LV_DEF_REFR_PERIOD, this);
+    lv_timer_pause(chat_stream_timer_);
+
     /* Status bar */
     lv_obj_set_flex_flow(status_bar_, LV_FLEX_FLOW_ROW);
     lv_obj_set_style_pad_all(status_bar_, 0, 0);
@@ -413,11 +575,47 @@ void LcdDisplay::SetupUI() {
     lv_obj_center(low_battery_label_);
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
 }
-#if CONFIG_IDF_TARGET_ESP32P4
-#define  MAX_MESSAGES 40
-#else
-#define  MAX_MESSAGES 20
-#endif
+LcdDisplay::ChatRow* LcdDisplay::AcquireChatRow() {
+    if (chat_row_count_ < MAX_MESSAGES) {
+        auto chat_row = &chat_rows_[chat_row_count_++];
+        // A full-width container to align the bubble to the left, right or center
+        chat_row->row = lv_obj_create(content_);
+        lv_obj_set_width(chat_row->row, LV_HOR_RES);
+        lv_obj_set_height(chat_row->row, LV_SIZE_CONTENT);
+        lv_obj_set_scrollbar_mode(chat_row->row, LV_SCROLLBAR_MODE_OFF);
+        lv_obj_set_style_bg_opa(chat_row->row, LV_OPA_TRANSP, 0);
+        lv_obj_set_style_border_width(chat_row->row, 0, 0);
+        lv_obj_set_style_pad_all(chat_row->row, 0, 0);
+
+        chat_row->bubble = lv_obj_create(chat_row->row);
+        lv_obj_set_style_radius(chat_row->bubble, 8, 0);
+        lv_obj_set_scrollbar_mode(chat_row->bubble, LV_SCROLLBAR_MODE_OFF);
+        lv_obj_set_style_border_width(chat_row->bubble, 1, 0);
+        lv_obj_set_style_border_color(chat_row->bubble, current_theme_.border, 0);
+        lv_obj_set_style_pad_all(chat_row->bubble, 8, 0);
+        lv_obj_set_size(chat_row->bubble, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
+        lv_obj_set_style_flex_grow(chat_row->bubble, 0, 0);
+
+        chat_row->label = lv_label_create(chat_row->bubble);
+        lv_label_set_long_mode(chat_row->label, LV_LABEL_LONG_WRAP);
+        lv_obj_set_style_text_font(chat_row->label, fonts_.text_font, 0);
+        return chat_row;
+    }
+
+    // Recycle the oldest row by moving it to the end, nothing is allocated or deleted
+    auto chat_row = &chat_rows_[oldest_chat_row_];
+    oldest_chat_row_ = (oldest_chat_row_ + 1) % MAX_MESSAGES;
+    lv_obj_move_foreground(chat_row->row);
+
+    // Drop the image previews older than the oldest message
+    lv_obj_t* first_child = lv_obj_get_child(content_, 0);
+    while (first_child != nullptr && first_child != chat_rows_[oldest_chat_row_].row) {
+        lv_obj_delete(first_child);
+        first_child = lv_obj_get_child(content_, 0);
+    }
+    return chat_row;
+}
+
 void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     DisplayLockGuard lock(this);
     if (content_ == nullptr) {
@@ -426,188 +624,159 @@ void LcdDisplay::SetChatMessage(const char* role, const char* content) {
     
     //避免出现空的消息框
     if(strlen(content) == 0) return;
+
+    // A new message ends the streaming one, flush its remaining text first
+    FlushChatStream();
+    streaming_chat_row_ = nullptr;
     
-    // 检查消息数量是否超过限制
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // 删除最早的消息（第一个子对象）
-        lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-        }
-    }
-    
-    // 折叠系统消息（如果是系统消息，检查最后一个消息是否也是系统消息）
-    if (strcmp(role, "system") == 0 && child_count > 0) {
-        // 获取最后一个消息容器
-        lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-        if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-            // 获取容器内的气泡
-            lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-            if (last_bubble != nullptr) {
-                // 检查气泡类型是否为系统消息
-                void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                    // 如果最后一个消息也是系统消息，则删除它
-                    lv_obj_del(last_container);
-                }
-            }
-        }
+    // 折叠系统消息（如果最后一个消息也是系统消息，则直接复用它）
+    ChatRow* chat_row = nullptr;
+    if (strcmp(role, "system") == 0 && last_chat_row_ != nullptr &&
+        lv_obj_get_child(content_, -1) == last_chat_row_->row &&
+        strcmp((const char*)lv_obj_get_user_data(last_chat_row_->bubble), "system") == 0) {
+        chat_row = last_chat_row_;
+    } else {
+        chat_row = AcquireChatRow();
     }
-    
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 1, 0);
-    lv_obj_set_style_border_color(msg_bubble, current_theme_.border, 0);
-    lv_obj_set_style_pad_all(msg_bubble, 8, 0);
-
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
+    last_chat_row_ = chat_row;
+
+    lv_label_set_text(chat_row->label, content);
     
     // 计算文本实际宽度
-    lv_coord_t text_width = lv_txt_get_width(content, strlen(content), fonts_.text_font, 0);
+    lv_coord_t text_width = GetTextWidth(content, strlen(content));
 
     // 计算气泡宽度
     lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 屏幕宽度的85%
     lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
     
     // 确保文本宽度不小于最小宽度
     if (text_width < min_width) {
         text_width = min_width;
     }
+    // 设置消息文本的宽度，气泡宽度随内容变化
+    chat_row->text_width = text_width;
+    lv_obj_set_width(chat_row->label, text_width < max_width ? text_width : max_width);
 
-    // 如果文本宽度小于最大宽度，使用文本宽度
-    if (text_width < max_width) {
-        bubble_width = text_width; 
+    // Restyle the row for the message role, only the properties that differ between roles are set
+    if (strcmp(role, "user") == 0) {
+        // User messages are right-aligned
+        lv_obj_set_style_bg_color(chat_row->bubble, current_theme_.user_bubble, 0);
+        lv_obj_set_style_text_color(chat_row->label, current_theme_.text, 0);
+        lv_obj_set_user_data(chat_row->bubble, (void*)"user");
+        lv_obj_align(chat_row->bubble, LV_ALIGN_RIGHT_MID, -25, 0);
+    } else if (strcmp(role, "system") == 0) {
+        // System messages are center-aligned
+        lv_obj_set_style_bg_color(chat_row->bubble, current_theme_.system_bubble, 0);
+        lv_obj_set_style_text_color(chat_row->label, current_theme_.system_text, 0);
+        lv_obj_set_user_data(chat_row->bubble, (void*)"system");
+        lv_obj_align(chat_row->bubble, LV_ALIGN_CENTER, 0, 0);
     } else {
-        bubble_width = max_width;
+        // Assistant messages are left-aligned
+        lv_obj_set_style_bg_color(chat_row->bubble, current_theme_.assistant_bubble, 0);
+        lv_obj_set_style_text_color(chat_row->label, current_theme_.text, 0);
+        lv_obj_set_user_data(chat_row->bubble, (void*)"assistant");
+        lv_obj_align(chat_row->bubble, LV_ALIGN_LEFT_MID, 0, 0);
     }
+
+    // Auto-scroll to the message
+    lv_obj_scroll_to_view_recursive(chat_row->row, LV_ANIM_ON);
     
-    // 设置消息文本的宽度
-    lv_obj_set_width(msg_text, bubble_width);  // 减去padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
-    lv_obj_set_style_text_font(msg_text, fonts_.text_font, 0);
+    // Store reference to the latest message label
+    chat_message_label_ = chat_row->label;
+}
 
-    // 设置气泡宽度
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
+void LcdDisplay::AppendChatMessage(const char* role, const char* content) {
+    DisplayLockGuard lock(this);
+    if (content_ == nullptr || content[0] == '\0') {
+        return;
+    }
 
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.user_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.assistant_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, current_theme_.system_bubble, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, current_theme_.system_text, 0);
-        
-        // 设置自定义属性标记气泡类型
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
+    // Start a new message unless the last message is the streaming one and has the same role
+    auto chat_row = streaming_chat_row_;
+    if (chat_row == nullptr || lv_obj_get_child(content_, -1) != chat_row->row ||
+        strcmp((const char*)lv_obj_get_user_data(chat_row->bubble), role) != 0) {
+        SetChatMessage(role, content);
+        streaming_chat_row_ = last_chat_row_;
+        return;
     }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // 为系统消息创建全宽容器以确保居中对齐
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // 使容器透明且无边框
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // 将消息气泡移入此容器
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // 将气泡居中对齐在容器中
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        
-        // 自动滚动底部
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
+    // Separate the sentences of languages that use spaces
+    const char* text = pending_chat_text_.empty() ? lv_label_get_text(chat_row->label) : pending_chat_text_.c_str();
+    size_t length = pending_chat_text_.empty() ? strlen(text) : pending_chat_text_.size();
+    if (length > 0 && (uint8_t)text[length - 1] < 0x80 && text[length - 1] != ' ' && (uint8_t)content[0] < 0x80) {
+        pending_chat_text_ += ' ';
     }
-    
-    // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    pending_chat_text_ += content;
+    lv_timer_resume(chat_stream_timer_);
+}
+
+// Runs on the LVGL task, or with the display locked
+void LcdDisplay::FlushChatStream() {
+    auto chat_row = streaming_chat_row_;
+    if (chat_row == nullptr) {
+        pending_chat_text_.clear();
+        chat_scroll_pending_ = false;
+        return;
+    }
+
+    if (!pending_chat_text_.empty()) {
+        lv_label_ins_text(chat_row->label, LV_LABEL_POS_LAST, pending_chat_text_.c_str());
+        // Only the appended text is measured, and only until the message wraps at the maximum width
+        lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;
+        if (chat_row->text_width < max_width) {
+            chat_row->text_width += GetTextWidth(pending_chat_text_.c_str(), pending_chat_text_.size());
+            lv_obj_set_width(chat_row->label, chat_row->text_width < max_width ? chat_row->text_width : max_width);
+        }
+        pending_chat_text_.clear();
+        chat_scroll_pending_ = true;
+    }
+
+    // Follow the end of the message with one scroll animation at a time
+    if (chat_scroll_pending_ && lv_anim_get(content_, nullptr) == nullptr) {
+        chat_scroll_pending_ = false;
+        lv_obj_update_layout(content_);
+        lv_coord_t scroll_bottom = lv_obj_get_scroll_bottom(content_);
+        if (scroll_bottom > 0) {
+            lv_obj_scroll_by(content_, 0, -scroll_bottom, LV_ANIM_ON);
+        }
+    }
+}
+
+void LcdDisplay::GetPreviewMaxSize(int& width, int& height) {
+    width = width_ * 70 / 100;      // 70% of screen width
+    height = height_ * 50 / 100;    // 50% of screen height
 }
 
-void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
+void LcdDisplay::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     DisplayLockGuard lock(this);
     if (content_ == nullptr) {
         return;
     }
     
-    if (img_dsc != nullptr) {
+    // The image bubbles are not in the chat row ring, they have their own cap. Each one keeps its frame
+    // alive, so the oldest is deleted before a new one is added, and nullptr deletes them all.
+    int image_count = 0;
+    lv_obj_t* oldest_image = nullptr;
+    for (int i = (int)lv_obj_get_child_count(content_) - 1; i >= 0; i--) {
+        lv_obj_t* child = lv_obj_get_child(content_, i);
+        // Only the image bubbles have user data, the chat rows keep the role on their bubble
+        auto type = (const char*)lv_obj_get_user_data(child);
+        if (type == nullptr || strcmp(type, "image") != 0) {
+            continue;
+        }
+        if (image == nullptr) {
+            lv_obj_delete(child);
+        } else {
+            oldest_image = child;
+            image_count++;
+        }
+    }
+    if (image_count >= MAX_PREVIEW_IMAGES) {
+        lv_obj_delete(oldest_image);
+    }
+
+    if (image != nullptr) {
+
         // Create a message bubble for image preview
         lv_obj_t* img_bubble = lv_obj_create(content_);
         lv_obj_set_style_radius(img_bubble, 8, 0);
@@ -625,41 +794,18 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
         // Create the image object inside the bubble
         lv_obj_t* preview_image = lv_image_create(img_bubble);
         
-        // Copy the image descriptor and data to avoid source data changes
-        lv_img_dsc_t* copied_img_dsc = (lv_img_dsc_t*)heap_caps_malloc(sizeof(lv_img_dsc_t), MALLOC_CAP_8BIT);
-        if (copied_img_dsc == nullptr) {
-            ESP_LOGE(TAG, "Failed to allocate memory for image descriptor");
-            lv_obj_del(img_bubble);
-            return;
-        }
-        
-        // Copy the header
-        copied_img_dsc->header = img_dsc->header;
-        copied_img_dsc->data_size = img_dsc->data_size;
-        
-        // Copy the image data
-        uint8_t* copied_data = (uint8_t*)heap_caps_malloc(img_dsc->data_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-        if (copied_data == nullptr) {
-            // Fallback to internal RAM if SPIRAM allocation fails
-            copied_data = (uint8_t*)heap_caps_malloc(img_dsc->data_size, MALLOC_CAP_8BIT);
-        }
-        if (copied_data == nullptr) {
-            ESP_LOGE(TAG, "Failed to allocate memory for image data (size: %lu bytes)", img_dsc->data_size);
-            heap_caps_free(copied_img_dsc);
-            lv_obj_del(img_bubble);
-            return;
-        }
-        
-        memcpy(copied_data, img_dsc->data, img_dsc->data_size);
-        copied_img_dsc->data = copied_data;
-        
-        // Calculate appropriate size for the image
-        lv_coord_t max_width = LV_HOR_RES * 70 / 100;  // 70% of screen width
-        lv_coord_t max_height = LV_VER_RES * 50 / 100; // 50% of screen height
+        // The image object keeps a reference to the pixels until it is deleted, the camera writes
+        // its next frame into a new buffer meanwhile
+        auto image_ref = new std::shared_ptr<PreviewImage>(image);
+        lv_obj_add_event_cb(preview_image, [](lv_event_t* e) {
+            delete (std::shared_ptr<PreviewImage>*)lv_event_get_user_data(e);
+        }, LV_EVENT_DELETE, image_ref);
         
-        // Calculate zoom factor to fit within maximum dimensions
-        lv_coord_t img_width = copied_img_dsc->header.w;
-        lv_coord_t img_height = copied_img_dsc->header.h;
+        // The cameras scale their frames to GetPreviewMaxSize(), zoom out the larger images only
+        int max_width, max_height;
+        GetPreviewMaxSize(max_width, max_height);
+        lv_coord_t img_width = image->width();
+        lv_coord_t img_height = image->height();
         
         lv_coord_t zoom_w = (max_width * 256) / img_width;
         lv_coord_t zoom_h = (max_height * 256) / img_height;
@@ -669,17 +815,10 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
         if (zoom > 256) zoom = 256;
         
         // Set image properties
-        lv_image_set_src(preview_image, copied_img_dsc);
-        lv_image_set_scale(preview_image, zoom);
-        
-        // Add event handler to clean up copied data when image is deleted
-        lv_obj_add_event_cb(preview_image, [](lv_event_t* e) {
-            lv_img_dsc_t* copied_img_dsc = (lv_img_dsc_t*)lv_event_get_user_data(e);
-            if (copied_img_dsc != nullptr) {
-                heap_caps_free((void*)copied_img_dsc->data);
-                heap_caps_free(copied_img_dsc);
-            }
-        }, LV_EVENT_DELETE, (void*)copied_img_dsc);
+        lv_image_set_src(preview_image, image->dsc());
+        if (zoom < 256) {
+            lv_image_set_scale(preview_image, zoom);
+        }
         
         // Calculate actual scaled image dimensions
         lv_coord_t scaled_width = (img_width * zoom) / 256;
@@ -807,19 +946,19 @@ void LcdDisplay::SetupUI() {
     lv_obj_add_flag(low_battery_popup_, LV_OBJ_FLAG_HIDDEN);
 }
 
-void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
+void LcdDisplay::SetPreviewImage(std::shared_ptr<PreviewImage> image) {
     DisplayLockGuard lock(this);
     if (preview_image_ == nullptr) {
         return;
     }
     
-    if (img_dsc != nullptr) {
-        // zoom factor 0.5
-        lv_image_set_scale(preview_image_, 128 * width_ / img_dsc->header.w);
+    if (image != nullptr) {
+        // The cameras scale their frames to GetPreviewMaxSize(), the image is shown unscaled
         // 设置图片源并显示预览图片
-        lv_image_set_src(preview_image_, img_dsc);
+        lv_image_set_src(preview_image_, image->dsc());
         lv_obj_clear_flag(preview_image_, LV_OBJ_FLAG_HIDDEN);
         // 隐藏emotion_label_
+        StopEmotionAnimation();
         if (emotion_label_ != nullptr) {
             lv_obj_add_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
         }
@@ -830,6 +969,8 @@ void LcdDisplay::SetPreviewImage(const lv_img_dsc_t* img_dsc) {
             lv_obj_clear_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
         }
     }
+    // Hold the pixels while the image object shows them
+    preview_image_data_ = image;
 }
 #endif
 
@@ -881,6 +1022,16 @@ void LcdDisplay::SetEmotion(const char* emotion) {
         lv_label_set_text(emotion_label_, "😶");
     }
 
+    // 表情分区中有该表情的动画时，用动画代替表情图标
+    if (PlayEmotionAnimation(emotion)) {
+#if !CONFIG_USE_WECHAT_MESSAGE_STYLE
+        if (preview_image_ != nullptr) {
+            lv_obj_add_flag(preview_image_, LV_OBJ_FLAG_HIDDEN);
+        }
+#endif
+        return;
+    }
+
 #if !CONFIG_USE_WECHAT_MESSAGE_STYLE
     // 显示emotion_label_，隐藏preview_image_
     lv_obj_clear_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
@@ -895,6 +1046,7 @@ void LcdDisplay::SetIcon(const char* icon) {
     if (emotion_label_ == nullptr) {
         return;
     }
+    StopEmotionAnimation();
     lv_obj_set_style_text_font(emotion_label_, &font_awesome_30_4, 0);
     lv_label_set_text(emotion_label_, icon);
 
@@ -907,6 +1059,39 @@ void LcdDisplay::SetIcon(const char* icon) {
 #endif
 }
 
+bool LcdDisplay::PlayEmotionAnimation(const char* emotion) {
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    if (!emotion_player_.HasEmotion(emotion)) {
+        StopEmotionAnimation();
+        return false;
+    }
+    if (emotion_image_ == nullptr) {
+        // Take the place of emotion_label_ in its parent
+        emotion_image_ = lv_image_create(lv_obj_get_parent(emotion_label_));
+        lv_obj_move_to_index(emotion_image_, lv_obj_get_index(emotion_label_));
+    }
+    if (!emotion_player_.Play(emotion, emotion_image_)) {
+        StopEmotionAnimation();
+        return false;
+    }
+    lv_obj_add_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_clear_flag(emotion_image_, LV_OBJ_FLAG_HIDDEN);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LcdDisplay::StopEmotionAnimation() {
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    emotion_player_.Stop();
+    if (emotion_image_ != nullptr && !lv_obj_has_flag(emotion_image_, LV_OBJ_FLAG_HIDDEN)) {
+        lv_obj_add_flag(emotion_image_, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_clear_flag(emotion_label_, LV_OBJ_FLAG_HIDDEN);
+    }
+#endif
+}
+
 void LcdDisplay::SetTheme(const std::string& theme_name) {
     DisplayLockGuard lock(this);
     
@@ -2,12 +2,15 @@
 #define LCD_DISPLAY_H
 
 #include "display.h"
+#include "glyph_cache.h"
+#include "emotion_player.h"
 
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
 #include <font_emoji.h>
 
 #include <atomic>
+#include <memory>
 
 // Theme color structure
 struct ThemeColors {
@@ -23,6 +26,14 @@ struct ThemeColors {
 };
 
 
+#if CONFIG_IDF_TARGET_ESP32P4
+#define  MAX_MESSAGES 40
+#define  MAX_PREVIEW_IMAGES 4
+#else
+#define  MAX_MESSAGES 20
+#define  MAX_PREVIEW_IMAGES 2
+#endif
+
 class LcdDisplay : public Display {
 protected:
     esp_lcd_panel_io_handle_t panel_io_ = nullptr;
@@ -34,25 +45,70 @@ protected:
     lv_obj_t* container_ = nullptr;
     lv_obj_t* side_bar_ = nullptr;
     lv_obj_t* preview_image_ = nullptr;
+    std::shared_ptr<PreviewImage> preview_image_data_;
 
     DisplayFonts fonts_;
     ThemeColors current_theme_;
+#if CONFIG_USE_DISPLAY_GLYPH_CACHE
+    // Wraps the text font in fonts_, the labels measure and draw their text through it
+    std::unique_ptr<GlyphCache> glyph_cache_;
+#endif
+#if CONFIG_USE_EMOTION_ANIMATIONS
+    // Plays the animations of the emotions partition in place of emotion_label_
+    EmotionPlayer emotion_player_;
+    lv_obj_t* emotion_image_ = nullptr;
+#endif
+
+#if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    // A chat message row: a transparent full-width row, the bubble and its text label
+    struct ChatRow {
+        lv_obj_t* row = nullptr;
+        lv_obj_t* bubble = nullptr;
+        lv_obj_t* label = nullptr;
+        lv_coord_t text_width = 0;      // Single-line width of the text, measured until it wraps
+    };
+    // The rows are created on demand up to MAX_MESSAGES, then the oldest one is recycled
+    ChatRow chat_rows_[MAX_MESSAGES];
+    int chat_row_count_ = 0;
+    int oldest_chat_row_ = 0;
+    ChatRow* last_chat_row_ = nullptr;
+
+    // The text appended to the streaming row is coalesced and flushed once per display refresh
+    ChatRow* streaming_chat_row_ = nullptr;
+    std::string pending_chat_text_;
+    bool chat_scroll_pending_ = false;
+    lv_timer_t* chat_stream_timer_ = nullptr;
+
+    ChatRow* AcquireChatRow();
+    void FlushChatStream();
+#endif
 
     void SetupUI();
+    lv_coord_t GetTextWidth(const char* text, size_t length);
+    bool PlayEmotionAnimation(const char* emotion);
+    void StopEmotionAnimation();
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
+    virtual std::unique_ptr<Display> CreateReplayDisplay() override;
+
 protected:
     // 添加protected构造函数
     LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel, DisplayFonts fonts, int width, int height);
+    // Without a panel, shares the fonts (and their glyph cache) and the theme of the source display
+    explicit LcdDisplay(const LcdDisplay* source);
     
 public:
     ~LcdDisplay();
     virtual void SetEmotion(const char* emotion) override;
     virtual void SetIcon(const char* icon) override;
-    virtual void SetPreviewImage(const lv_img_dsc_t* img_dsc) override;
+    virtual void SetPreviewImage(std::shared_ptr<PreviewImage> image) override;
+    // Adds the glyph cache and emotion animation statistics
+    virtual std::string GetStatisticsJson(bool reset = false) override;
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
+    virtual void GetPreviewMaxSize(int& width, int& height) override;
     virtual void SetChatMessage(const char* role, const char* content) override; 
+    virtual void AppendChatMessage(const char* role, const char* content) override;
 #endif  
 
     // Add theme switching function
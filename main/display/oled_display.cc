@@ -8,6 +8,7 @@
 #include <esp_log.h>
 #include <esp_err.h>
 #include <esp_lvgl_port.h>
+#include <esp_heap_caps.h>
 
 #define TAG "OledDisplay"
 
@@ -27,6 +28,40 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
     lvgl_port_init(&port_cfg);
 
     ESP_LOGI(TAG, "Adding OLED display");
+#if CONFIG_OLED_NATIVE_1BPP
+    // The panel mirrors the image itself, LVGL renders the unrotated screen
+    esp_lcd_panel_mirror(panel_, mirror_x, mirror_y);
+    // Clear the panel, then only the pages that differ from pages_ are sent
+    pages_.assign(width_ * height_ / 8, 0);
+    esp_lcd_panel_draw_bitmap(panel_, 0, 0, width_, height_, pages_.data());
+
+    // The I1 buffer starts with the 8-byte palette
+    size_t buffer_size = width_ * height_ / 8 + 8;
+    draw_buffer_ = (uint8_t*)heap_caps_malloc(buffer_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (draw_buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the draw buffer");
+        return;
+    }
+    lvgl_port_lock(0);
+    display_ = lv_display_create(width_, height_);
+    lv_display_set_color_format(display_, LV_COLOR_FORMAT_I1);
+    lv_display_set_buffers(display_, draw_buffer_, nullptr, buffer_size, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lv_display_set_user_data(display_, this);
+    lv_display_set_flush_cb(display_, [](lv_display_t* display, const lv_area_t* area, uint8_t* px_map) {
+        auto self = (OledDisplay*)lv_display_get_user_data(display);
+        self->FlushPages(area, px_map + 8);
+        lv_display_flush_ready(display);
+    });
+    // Round the invalidated areas to whole bytes of the rows and whole pages
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto area = (lv_area_t*)lv_event_get_param(e);
+        area->x1 &= ~7;
+        area->x2 |= 7;
+        area->y1 &= ~7;
+        area->y2 |= 7;
+    }, LV_EVENT_INVALIDATE_AREA, nullptr);
+    lvgl_port_unlock();
+#else
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
@@ -56,6 +91,8 @@ OledDisplay::OledDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handl
         ESP_LOGE(TAG, "Failed to add display");
         return;
     }
+#endif
+    InstrumentRefresh();
 
     if (height_ == 64) {
         SetupUI_128x64();
@@ -78,6 +115,13 @@ OledDisplay::~OledDisplay() {
         lv_obj_del(container_);
     }
 
+#if CONFIG_OLED_NATIVE_1BPP
+    if (display_ != nullptr) {
+        lv_display_delete(display_);
+    }
+    heap_caps_free(draw_buffer_);
+#endif
+
     if (panel_ != nullptr) {
         esp_lcd_panel_del(panel_);
     }
@@ -87,6 +131,38 @@ OledDisplay::~OledDisplay() {
     lvgl_port_deinit();
 }
 
+#if CONFIG_OLED_NATIVE_1BPP
+void OledDisplay::FlushPages(const lv_area_t* area, const uint8_t* pixels) {
+    int area_width = lv_area_get_width(area);
+    int stride = (area_width + 7) / 8;
+    for (int page = area->y1 / 8; page <= area->y2 / 8; page++) {
+        uint8_t* page_data = &pages_[page * width_];
+        int changed_x1 = width_;
+        int changed_x2 = -1;
+        for (int x = area->x1; x <= area->x2; x++) {
+            // Gather the column byte of the page, a dark pixel lights up the OLED like before
+            int column = x - area->x1;
+            uint8_t mask = 0x80 >> (column & 7);
+            const uint8_t* src = pixels + (page * 8 - area->y1) * stride + column / 8;
+            uint8_t value = 0;
+            for (int bit = 0; bit < 8; bit++, src += stride) {
+                if (!(*src & mask)) {
+                    value |= 1 << bit;
+                }
+            }
+            if (page_data[x] != value) {
+                page_data[x] = value;
+                changed_x1 = std::min(changed_x1, x);
+                changed_x2 = x;
+            }
+        }
+        if (changed_x2 >= 0) {
+            esp_lcd_panel_draw_bitmap(panel_, changed_x1, page * 8, changed_x2 + 1, page * 8 + 8, page_data + changed_x1);
+        }
+    }
+}
+#endif
+
 bool OledDisplay::Lock(int timeout_ms) {
     return lvgl_port_lock(timeout_ms);
 }
@@ -6,6 +6,8 @@
 #include <esp_lcd_panel_io.h>
 #include <esp_lcd_panel_ops.h>
 
+#include <vector>
+
 class OledDisplay : public Display {
 private:
     esp_lcd_panel_io_handle_t panel_io_ = nullptr;
@@ -20,6 +22,15 @@ private:
 
     DisplayFonts fonts_;
 
+#if CONFIG_OLED_NATIVE_1BPP
+    // LVGL renders 1 bit per pixel in rows, the panel takes 8-row pages of column bytes
+    uint8_t* draw_buffer_ = nullptr;
+    // The pages as last sent to the panel, only the changed column ranges are sent again
+    std::vector<uint8_t> pages_;
+
+    void FlushPages(const lv_area_t* area, const uint8_t* pixels);
+#endif
+
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
@@ -0,0 +1,48 @@
+#ifndef PREVIEW_IMAGE_H
+#define PREVIEW_IMAGE_H
+
+#include <lvgl.h>
+#include <esp_heap_caps.h>
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * An RGB565 preview image shared by the camera and the displays with std::shared_ptr.
+ * The displays show the pixels without copying them, and the pixels are freed with the last
+ * reference, so the camera can write the next frame into the same buffer once no display holds it.
+ */
+class PreviewImage {
+public:
+    PreviewImage(int width, int height) {
+        memset(&dsc_, 0, sizeof(dsc_));
+        dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
+        dsc_.header.cf = LV_COLOR_FORMAT_RGB565;
+        dsc_.header.w = width;
+        dsc_.header.h = height;
+        dsc_.header.stride = width * 2;
+        dsc_.data_size = width * height * 2;
+        auto data = heap_caps_malloc(dsc_.data_size, MALLOC_CAP_SPIRAM);
+        if (data == nullptr) {
+            data = heap_caps_malloc(dsc_.data_size, MALLOC_CAP_8BIT);
+        }
+        dsc_.data = (const uint8_t*)data;
+    }
+    ~PreviewImage() {
+        heap_caps_free((void*)dsc_.data);
+    }
+    // 删除拷贝构造函数和赋值运算符
+    PreviewImage(const PreviewImage&) = delete;
+    PreviewImage& operator=(const PreviewImage&) = delete;
+
+    inline bool valid() const { return dsc_.data != nullptr; }
+    inline int width() const { return dsc_.header.w; }
+    inline int height() const { return dsc_.header.h; }
+    inline uint16_t* pixels() { return (uint16_t*)dsc_.data; }
+    inline const lv_img_dsc_t* dsc() const { return &dsc_; }
+
+private:
+    lv_img_dsc_t dsc_;
+};
+
+#endif // PREVIEW_IMAGE_H
@@ -0,0 +1,216 @@
+#include "heap_profiler.h"
+
+#if CONFIG_USE_HEAP_PROFILER
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+#include <cstdio>
+#include <cstring>
+
+#define TAG "HeapProfiler"
+
+// Stop tracking new allocations when the table is this full, to keep the probe sequences short
+#define HEAP_PROFILER_MAX_LOAD_PERCENT 75
+
+static const char* const HEAP_TAG_NAMES[] = { "other", "audio", "protocol", "display", "mcp", "camera" };
+static const char* const HEAP_REGION_NAMES[] = { "internal", "spiram", "dma" };
+
+// Plain thread_local with a constant initializer, it is safe to read from the heap hooks
+static thread_local HeapTag current_heap_tag = kHeapTagOther;
+
+HeapTagScope::HeapTagScope(HeapTag tag) : previous_tag_(current_heap_tag) {
+    current_heap_tag = tag;
+}
+
+HeapTagScope::~HeapTagScope() {
+    current_heap_tag = previous_tag_;
+}
+
+// Set by Start(), the hooks must not run the guarded initialization of GetInstance() inside the allocator
+static HeapProfiler* active_profiler = nullptr;
+
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps) {
+    if (active_profiler != nullptr) {
+        active_profiler->OnAlloc(ptr, size, caps);
+    }
+}
+
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void* ptr) {
+    if (active_profiler != nullptr) {
+        active_profiler->OnFree(ptr);
+    }
+}
+
+static inline uint32_t HashAddress(uintptr_t address, uint32_t capacity) {
+    return (uint32_t)((address >> 2) * 2654435761u) % capacity;
+}
+
+void HeapProfiler::Start() {
+    if (allocations_ != nullptr) {
+        return;
+    }
+    uint32_t capacity = CONFIG_HEAP_PROFILER_MAX_ALLOCATIONS;
+    auto table = (Allocation*)heap_caps_calloc(capacity, sizeof(Allocation), MALLOC_CAP_SPIRAM);
+    if (table == nullptr) {
+        table = (Allocation*)heap_caps_calloc(capacity, sizeof(Allocation), MALLOC_CAP_INTERNAL);
+    }
+    if (table == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the table of %lu allocations", (unsigned long)capacity);
+        return;
+    }
+
+    portENTER_CRITICAL(&lock_);
+    capacity_ = capacity;
+    allocations_ = table;
+    portEXIT_CRITICAL(&lock_);
+    active_profiler = this;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            auto profiler = (HeapProfiler*)arg;
+            ESP_LOGI(TAG, "Snapshot: %s", profiler->GetSnapshotJson().c_str());
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "heap_snapshot",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&timer_args, &snapshot_timer_);
+    esp_timer_start_periodic(snapshot_timer_, CONFIG_HEAP_PROFILER_SNAPSHOT_INTERVAL * 1000000LL);
+    ESP_LOGI(TAG, "Started, tracking up to %lu allocations", (unsigned long)capacity);
+}
+
+void IRAM_ATTR HeapProfiler::OnAlloc(void* ptr, size_t size, uint32_t caps) {
+    if (allocations_ == nullptr || ptr == nullptr) {
+        return;
+    }
+    uint8_t region = esp_ptr_external_ram(ptr) ? kHeapRegionSpiram :
+        ((caps & MALLOC_CAP_DMA) ? kHeapRegionDma : kHeapRegionInternal);
+    uint8_t tag = current_heap_tag;
+    auto address = (uintptr_t)ptr;
+
+    portENTER_CRITICAL_SAFE(&lock_);
+    uint32_t index = HashAddress(address, capacity_);
+    while (allocations_[index].address != 0 && allocations_[index].address != address) {
+        index = (index + 1) % capacity_;
+    }
+    auto& allocation = allocations_[index];
+    if (allocation.address == address) {
+        // A realloc in place only reports the new allocation, replace the old one
+        auto& old_usage = usage_[allocation.tag][allocation.region];
+        old_usage.live_bytes -= allocation.size;
+        old_usage.live_count--;
+        count_--;
+    } else if (count_ >= capacity_ * HEAP_PROFILER_MAX_LOAD_PERCENT / 100) {
+        untracked_++;
+        portEXIT_CRITICAL_SAFE(&lock_);
+        return;
+    }
+    allocation.address = address;
+    allocation.size = size;
+    allocation.tag = tag;
+    allocation.region = region;
+    count_++;
+
+    auto& usage = usage_[tag][region];
+    usage.live_bytes += size;
+    usage.live_count++;
+    usage.allocs++;
+    if (usage.live_bytes > usage.peak_bytes) {
+        usage.peak_bytes = usage.live_bytes;
+    }
+    portEXIT_CRITICAL_SAFE(&lock_);
+}
+
+void IRAM_ATTR HeapProfiler::OnFree(void* ptr) {
+    if (allocations_ == nullptr || ptr == nullptr) {
+        return;
+    }
+    auto address = (uintptr_t)ptr;
+
+    portENTER_CRITICAL_SAFE(&lock_);
+    uint32_t index = HashAddress(address, capacity_);
+    while (allocations_[index].address != 0 && allocations_[index].address != address) {
+        index = (index + 1) % capacity_;
+    }
+    if (allocations_[index].address == 0) {
+        // Allocated before Start() or not tracked
+        portEXIT_CRITICAL_SAFE(&lock_);
+        return;
+    }
+
+    auto& usage = usage_[allocations_[index].tag][allocations_[index].region];
+    usage.live_bytes -= allocations_[index].size;
+    usage.live_count--;
+    count_--;
+
+    // Backward shift deletion, move the following entries of the probe sequence into the hole
+    uint32_t hole = index;
+    uint32_t next = (hole + 1) % capacity_;
+    while (allocations_[next].address != 0) {
+        uint32_t home = HashAddress(allocations_[next].address, capacity_);
+        // Move the entry if its home slot is not in the cyclic range (hole, next]
+        bool in_range = hole < next ? (home > hole && home <= next) : (home > hole || home <= next);
+        if (!in_range) {
+            allocations_[hole] = allocations_[next];
+            hole = next;
+        }
+        next = (next + 1) % capacity_;
+    }
+    allocations_[hole].address = 0;
+    portEXIT_CRITICAL_SAFE(&lock_);
+}
+
+std::string HeapProfiler::GetSnapshotJson() {
+    HeapUsage usage[kHeapTagCount][kHeapRegionCount];
+    uint32_t count, untracked;
+    portENTER_CRITICAL(&lock_);
+    memcpy(usage, usage_, sizeof(usage));
+    count = count_;
+    untracked = untracked_;
+    portEXIT_CRITICAL(&lock_);
+
+    static const uint32_t region_caps[] = { MALLOC_CAP_INTERNAL, MALLOC_CAP_SPIRAM, MALLOC_CAP_DMA };
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "{\"uptime_s\":%lu,\"tracked\":%lu,\"untracked\":%lu,\"regions\":{",
+        (unsigned long)(esp_timer_get_time() / 1000000), (unsigned long)count, (unsigned long)untracked);
+    std::string json = buffer;
+    bool first = true;
+    for (int region = 0; region < kHeapRegionCount; region++) {
+        size_t free_size = heap_caps_get_free_size(region_caps[region]);
+        if (free_size == 0) {
+            continue;
+        }
+        size_t largest_free_block = heap_caps_get_largest_free_block(region_caps[region]);
+        // The share of the free memory that can't be allocated in one block
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"free\":%u,\"min_free\":%u,\"largest_free_block\":%u,\"fragmentation\":%u}",
+            first ? "" : ",", HEAP_REGION_NAMES[region], free_size, heap_caps_get_minimum_free_size(region_caps[region]),
+            largest_free_block, (unsigned)(100 - largest_free_block * 100 / free_size));
+        json += buffer;
+        first = false;
+    }
+
+    json += "},\"tags\":{";
+    for (int tag = 0; tag < kHeapTagCount; tag++) {
+        json += tag == 0 ? "\"" : ",\"";
+        json += HEAP_TAG_NAMES[tag];
+        json += "\":{";
+        first = true;
+        for (int region = 0; region < kHeapRegionCount; region++) {
+            auto& u = usage[tag][region];
+            if (u.allocs == 0) {
+                continue;
+            }
+            snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"live_bytes\":%lu,\"live_count\":%lu,\"peak_bytes\":%lu,\"allocs\":%lu}",
+                first ? "" : ",", HEAP_REGION_NAMES[region], (unsigned long)u.live_bytes, (unsigned long)u.live_count,
+                (unsigned long)u.peak_bytes, (unsigned long)u.allocs);
+            json += buffer;
+            first = false;
+        }
+        json += "}";
+    }
+    json += "}}";
+    return json;
+}
+
+#endif // CONFIG_USE_HEAP_PROFILER
@@ -0,0 +1,98 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include "sdkconfig.h"
+
+/*
+ * Heap allocation profiler (CONFIG_USE_HEAP_PROFILER)
+ *
+ * The ESP-IDF heap hooks record every allocation with the heap tag of the calling task, the live
+ * allocations are kept in a preallocated table so that the frees can be attributed too. A snapshot of
+ * the live bytes per tag and memory region, and of the fragmentation of every region, is logged
+ * periodically and returned by the MCP tool `self.get_heap_stats`. scripts/heap_diff.py compares two
+ * snapshots.
+ */
+enum HeapTag : uint8_t {
+    kHeapTagOther,
+    kHeapTagAudio,
+    kHeapTagProtocol,
+    kHeapTagDisplay,
+    kHeapTagMcp,
+    kHeapTagCamera,
+    kHeapTagCount
+};
+
+enum HeapRegion : uint8_t {
+    kHeapRegionInternal,
+    kHeapRegionSpiram,
+    kHeapRegionDma,         // Internal memory requested with MALLOC_CAP_DMA
+    kHeapRegionCount
+};
+
+struct HeapUsage {
+    uint32_t live_bytes = 0;
+    uint32_t live_count = 0;
+    uint32_t peak_bytes = 0;
+    uint32_t allocs = 0;
+};
+
+class HeapProfiler {
+public:
+    static HeapProfiler& GetInstance() {
+        static HeapProfiler instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    HeapProfiler(const HeapProfiler&) = delete;
+    HeapProfiler& operator=(const HeapProfiler&) = delete;
+
+    // Allocate the allocation table and start the periodic snapshots, the allocations before are not tracked
+    void Start();
+    std::string GetSnapshotJson();
+
+    // Called by the heap hooks
+    void OnAlloc(void* ptr, size_t size, uint32_t caps);
+    void OnFree(void* ptr);
+
+private:
+    HeapProfiler() = default;
+
+    struct Allocation {
+        uintptr_t address;
+        uint32_t size : 24;
+        uint32_t tag : 4;
+        uint32_t region : 4;
+    };
+
+    portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+    Allocation* allocations_ = nullptr;
+    uint32_t capacity_ = 0;
+    uint32_t count_ = 0;
+    uint32_t untracked_ = 0;
+    HeapUsage usage_[kHeapTagCount][kHeapRegionCount];
+    esp_timer_handle_t snapshot_timer_ = nullptr;
+};
+
+// Attributes the allocations of the current task to a tag until the scope ends
+class HeapTagScope {
+public:
+#if CONFIG_USE_HEAP_PROFILER
+    explicit HeapTagScope(HeapTag tag);
+    ~HeapTagScope();
+#else
+    explicit HeapTagScope(HeapTag tag) {}
+#endif
+    HeapTagScope(const HeapTagScope&) = delete;
+    HeapTagScope& operator=(const HeapTagScope&) = delete;
+
+private:
+    HeapTag previous_tag_ = kHeapTagOther;
+};
+
+#endif // HEAP_PROFILER_H
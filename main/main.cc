@@ -7,15 +7,26 @@
 
 #include "application.h"
 #include "system_info.h"
+#include "boot_profiler.h"
+#include "heap_profiler.h"
 
 #define TAG "main"
 
 extern "C" void app_main(void)
 {
+    auto& profiler = BootProfiler::GetInstance();
+    profiler.Mark("app_main");
+
+#if CONFIG_USE_HEAP_PROFILER
+    // Start as early as possible, the allocations before are not attributed
+    HeapProfiler::GetInstance().Start();
+#endif
+
     // Initialize the default event loop
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     // Initialize NVS flash for WiFi configuration
+    int nvs_span = profiler.Begin("nvs");
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_LOGW(TAG, "Erasing NVS flash to fix corruption");
@@ -23,6 +34,7 @@ extern "C" void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    profiler.End(nvs_span);
 
     // Launch the application
     auto& app = Application::GetInstance();
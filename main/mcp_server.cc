@@ -8,20 +8,67 @@
 #include <esp_app_desc.h>
 #include <algorithm>
 #include <cstring>
-#include <esp_pthread.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
 #include "application.h"
 #include "display.h"
 #include "board.h"
+#include "boot_profiler.h"
+#include "trace_buffer.h"
+#include "task_monitor.h"
+#include "heap_profiler.h"
 
 #define TAG "MCP"
 
 #define DEFAULT_TOOLCALL_STACK_SIZE 6144
 
+// Worker stack sizes and counts of each stack class, workers are created on first use and then kept
+#define TOOLCALL_SMALL_STACK_SIZE DEFAULT_TOOLCALL_STACK_SIZE
+#define TOOLCALL_MEDIUM_STACK_SIZE 8192
+#define TOOLCALL_LARGE_STACK_SIZE 16384
+#define TOOLCALL_SMALL_WORKERS 2
+#define TOOLCALL_MEDIUM_WORKERS 1
+#define TOOLCALL_LARGE_WORKERS 1
+#define MAX_TOOLCALLS_IN_QUEUE 4
+#define MAX_TOOLS_LIST_PAYLOAD_SIZE 8000
+#define TOOLCALL_DEADLINE_CHECK_INTERVAL_MS 500
+#define TOOLCALL_CAMERA_TIMEOUT_MS 45000
+#define TOOLCALL_BENCHMARK_TIMEOUT_MS 40000
+
+// The tool call running on the current worker task
+static thread_local McpToolCall* current_tool_call = nullptr;
+
 McpServer::McpServer() {
+    tool_call_workers_[kMcpToolStackSmall].stack_class = kMcpToolStackSmall;
+    tool_call_workers_[kMcpToolStackSmall].stack_size = TOOLCALL_SMALL_STACK_SIZE;
+    tool_call_workers_[kMcpToolStackSmall].max_workers = TOOLCALL_SMALL_WORKERS;
+    tool_call_workers_[kMcpToolStackMedium].stack_class = kMcpToolStackMedium;
+    tool_call_workers_[kMcpToolStackMedium].stack_size = TOOLCALL_MEDIUM_STACK_SIZE;
+    tool_call_workers_[kMcpToolStackMedium].max_workers = TOOLCALL_MEDIUM_WORKERS;
+    tool_call_workers_[kMcpToolStackLarge].stack_class = kMcpToolStackLarge;
+    tool_call_workers_[kMcpToolStackLarge].stack_size = TOOLCALL_LARGE_STACK_SIZE;
+    tool_call_workers_[kMcpToolStackLarge].max_workers = TOOLCALL_LARGE_WORKERS;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            auto server = (McpServer*)arg;
+            server->CheckDeadlines();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "mcp_deadline",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&timer_args, &deadline_timer_);
 }
 
 McpServer::~McpServer() {
+    if (deadline_timer_ != nullptr) {
+        esp_timer_stop(deadline_timer_);
+        esp_timer_delete(deadline_timer_);
+    }
     for (auto tool : tools_) {
         delete tool;
     }
@@ -31,8 +78,8 @@ McpServer::~McpServer() {
 void McpServer::AddCommonTools() {
     // To speed up the response time, we add the common tools to the beginning of
     // the tools list to utilize the prompt cache.
-    // Backup the original tools list and restore it after adding the common tools.
-    auto original_tools = std::move(tools_);
+    // Remember the original tools and move them behind the common tools afterwards.
+    size_t original_count = tools_.size();
     auto& board = Board::GetInstance();
 
     AddTool("self.get_device_status",
@@ -40,89 +87,199 @@ void McpServer::AddCommonTools() {
         "Use this tool for: \n"
         "1. Answering questions about current condition (e.g. what is the current volume of the audio speaker?)\n"
         "2. As the first step to control the device (e.g. turn up / down the volume of the audio speaker, etc.)",
-        PropertyList(),
-        [&board](const PropertyList& properties) -> ReturnValue {
+        [&board]() -> ReturnValue {
             return board.GetDeviceStatusJson();
         });
 
-    AddTool("self.audio_speaker.set_volume", 
+    AddTool<McpInt<"volume", 0, 100>>("self.audio_speaker.set_volume", 
         "Set the volume of the audio speaker. If the current volume is unknown, you must call `self.get_device_status` tool first and then call this tool.",
-        PropertyList({
-            Property("volume", kPropertyTypeInteger, 0, 100)
-        }), 
-        [&board](const PropertyList& properties) -> ReturnValue {
+        [&board](int volume) -> ReturnValue {
             auto codec = board.GetAudioCodec();
-            codec->SetOutputVolume(properties["volume"].value<int>());
+            codec->SetOutputVolume(volume);
+            board.GetDisplay()->MarkStatusBarDirty(kStatusBarMute);
             return true;
         });
     
     auto backlight = board.GetBacklight();
     if (backlight) {
-        AddTool("self.screen.set_brightness",
+        AddTool<McpInt<"brightness", 0, 100>>("self.screen.set_brightness",
             "Set the brightness of the screen.",
-            PropertyList({
-                Property("brightness", kPropertyTypeInteger, 0, 100)
-            }),
-            [backlight](const PropertyList& properties) -> ReturnValue {
-                uint8_t brightness = static_cast<uint8_t>(properties["brightness"].value<int>());
-                backlight->SetBrightness(brightness, true);
+            [backlight](int brightness) -> ReturnValue {
+                backlight->SetBrightness(static_cast<uint8_t>(brightness), true);
                 return true;
             });
     }
 
     auto display = board.GetDisplay();
     if (display && !display->GetTheme().empty()) {
-        AddTool("self.screen.set_theme",
+        AddTool<McpString<"theme">>("self.screen.set_theme",
             "Set the theme of the screen. The theme can be `light` or `dark`.",
-            PropertyList({
-                Property("theme", kPropertyTypeString)
-            }),
-            [display](const PropertyList& properties) -> ReturnValue {
-                display->SetTheme(properties["theme"].value<std::string>().c_str());
+            [display](const std::string& theme) -> ReturnValue {
+                display->SetTheme(theme.c_str());
                 return true;
             });
     }
 
+    if (display) {
+        AddTool<McpInt<"seconds", 1, 30, 5>>("self.screen.benchmark",
+            "Run the screen render benchmark: animate a test scene over the UI and report the frame rate, the render "
+            "and flush time per frame and the LVGL load.\n"
+            "Only use this tool when the developer asks for the screen performance.\n"
+            "Args:\n"
+            "  `seconds`: How long the benchmark runs.",
+            [display](int seconds) -> ReturnValue {
+                return display->RunBenchmark(seconds);
+            }, TOOLCALL_BENCHMARK_TIMEOUT_MS);
+
+        AddTool("self.screen.replay_benchmark",
+            "Replay the screen updates of a recorded conversation (status, emotions, chat messages, a notification, "
+            "an image preview and a theme switch) on an off-screen copy of the UI and report the time of every call, "
+            "the time to render its first frame, the invalidated pixels and the heap used. The screen is not changed.\n"
+            "Only use this tool when the developer asks for the screen performance.",
+            [display]() -> ReturnValue {
+                return display->RunReplayBenchmark();
+            }, TOOLCALL_BENCHMARK_TIMEOUT_MS);
+
+#if CONFIG_USE_DISPLAY_STATISTICS
+        AddTool<McpBool<"reset", false>>("self.screen.get_stats",
+            "Provides the screen statistics since the last reset: the frame rate, dropped frames and render / flush "
+            "time per frame, and for every caller of the display lock (function and task) the lock count, the "
+            "contended count, the average and longest wait with the caller that held the lock, and the hold time.\n"
+            "Use this tool when the developer asks why the screen or the device state changes are slow.\n"
+            "Args:\n"
+            "  `reset`: Start a new measurement after this one.",
+            [display](bool reset) -> ReturnValue {
+                return display->GetStatisticsJson(reset);
+            });
+#endif
+    }
+
     auto camera = board.GetCamera();
     if (camera) {
-        AddTool("self.camera.take_photo",
+        AddTool<McpString<"question">>("self.camera.take_photo",
             "Take a photo and explain it. Use this tool after the user asks you to see something.\n"
             "Args:\n"
             "  `question`: The question that you want to ask about the photo.\n"
             "Return:\n"
             "  A JSON object that provides the photo information.",
-            PropertyList({
-                Property("question", kPropertyTypeString)
-            }),
-            [camera](const PropertyList& properties) -> ReturnValue {
+            [camera](const std::string& question) -> ReturnValue {
                 if (!camera->Capture()) {
                     return "{\"success\": false, \"message\": \"Failed to capture photo\"}";
                 }
-                auto question = properties["question"].value<std::string>();
+                // Explain() checks the cancellation and streams the answer as progress notifications
                 return camera->Explain(question);
-            });
+            }, TOOLCALL_CAMERA_TIMEOUT_MS);
     }
 
-    // Restore the original tools list to the end of the tools list
-    tools_.insert(tools_.end(), original_tools.begin(), original_tools.end());
+    AddTool("self.get_network_stats",
+        "Provides the network quality statistics of the current conversation session, including uplink / downlink bitrate, "
+        "packet loss, jitter, server round-trip time, time to first audio and the audio send queue occupancy.\n"
+        "Use this tool when the user asks why the conversation is slow or about the network quality.",
+        []() -> ReturnValue {
+            auto protocol = Application::GetInstance().GetProtocol();
+            if (protocol == nullptr) {
+                return "{}";
+            }
+            auto json = protocol->network_stats().ToJson();
+            json.pop_back();
+            json += ",\"send_queue\":" + Application::GetInstance().GetAudioService().GetSendQueueStatisticsJson() + "}";
+            return json;
+        });
+
+    AddTool("self.get_boot_timeline",
+        "Provides the timeline of the last boot: the named startup steps with their start time and duration "
+        "in microseconds, and the total time from power on to the idle state.\n"
+        "Use this tool when the user asks why the device starts slowly.",
+        []() -> ReturnValue {
+            return BootProfiler::GetInstance().GetTimelineJson();
+        });
+
+    AddTool("self.get_task_stats",
+        "Provides the CPU usage of every task over the last second and the last 10 seconds, and the stack bytes "
+        "that were never used (the stack high-water mark). Tasks with `stack_low` true are close to a stack overflow.\n"
+        "Use this tool when the developer asks about the CPU load or the task stack sizes.",
+        []() -> ReturnValue {
+            return TaskMonitor::GetInstance().GetStatisticsJson();
+        });
+
+#if CONFIG_USE_TRACE_BUFFER
+    AddTool<McpInt<"max_events", 1, CONFIG_TRACE_BUFFER_EVENTS * portNUM_PROCESSORS,
+        std::min(200, CONFIG_TRACE_BUFFER_EVENTS * portNUM_PROCESSORS)>>("self.get_trace",
+        "Dump the newest events of the trace buffer: audio read / encode / send / receive / decode / I2S write, "
+        "device state changes, MCP tool calls, display refreshes and display lock holds / waits, with timestamps in microseconds.\n"
+        "Only use this tool when the developer asks for the trace, the result is large.\n"
+        "Args:\n"
+        "  `max_events`: The number of the newest events to return.",
+        [](int max_events) -> ReturnValue {
+            return TraceBuffer::GetInstance().GetEventsJson(max_events);
+        });
+#endif
+
+#if CONFIG_USE_HEAP_PROFILER
+    AddTool("self.get_heap_stats",
+        "Provides a heap snapshot: the live bytes, live allocations and peak bytes of every module (audio, protocol, "
+        "display, mcp, camera, other) in every memory region, and the free size, largest free block and fragmentation "
+        "percentage of every region.\n"
+        "Use this tool when the developer asks about the memory usage, memory leaks or heap fragmentation.",
+        []() -> ReturnValue {
+            return HeapProfiler::GetInstance().GetSnapshotJson();
+        });
+#endif
+
+    // Move the original tools to the end of the tools list
+    std::rotate(tools_.begin(), tools_.begin() + original_count, tools_.end());
+    RebuildIndex();
 }
 
 void McpServer::AddTool(McpTool* tool) {
     // Prevent adding duplicate tools
-    if (std::find_if(tools_.begin(), tools_.end(), [tool](const McpTool* t) { return t->name() == tool->name(); }) != tools_.end()) {
+    if (tool_index_.find(tool->name()) != tool_index_.end()) {
         ESP_LOGW(TAG, "Tool %s already added", tool->name().c_str());
         return;
     }
 
     ESP_LOGI(TAG, "Add tool: %s", tool->name().c_str());
     tools_.push_back(tool);
+    tool_index_.emplace(tool->name(), tools_.size() - 1);
+    pages_dirty_ = true;
+}
+
+McpTool* McpServer::FindTool(const std::string& name) const {
+    auto it = tool_index_.find(name);
+    return it == tool_index_.end() ? nullptr : tools_[it->second];
+}
+
+void McpServer::RebuildIndex() {
+    tool_index_.clear();
+    tool_index_.reserve(tools_.size());
+    for (size_t i = 0; i < tools_.size(); i++) {
+        tool_index_.emplace(tools_[i]->name(), i);
+    }
+    pages_dirty_ = true;
+}
+
+// Split the tools into pages that fit in one tools/list reply, using the cached schema sizes
+void McpServer::BuildPages() {
+    page_starts_.clear();
+    size_t page_size = 0;
+    for (size_t i = 0; i < tools_.size(); i++) {
+        size_t tool_size = tools_[i]->to_json().length() + 1;
+        if (page_starts_.empty() || page_size + tool_size + 30 > MAX_TOOLS_LIST_PAYLOAD_SIZE) {
+            page_starts_.push_back(i);
+            page_size = 10;
+        }
+        page_size += tool_size;
+    }
+    pages_dirty_ = false;
 }
 
-void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback) {
-    AddTool(new McpTool(name, description, properties, callback));
+void McpServer::AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+    int timeout_ms) {
+    AddTool(new McpTool(name, description, properties, callback, timeout_ms));
 }
 
 void McpServer::ParseMessage(const std::string& message) {
+    HeapTagScope heap_tag(kHeapTagMcp);
     cJSON* json = cJSON_Parse(message.c_str());
     if (json == nullptr) {
         ESP_LOGE(TAG, "Failed to parse MCP message: %s", message.c_str());
@@ -152,6 +309,32 @@ void McpServer::ParseCapabilities(const cJSON* capabilities) {
 }
 
 void McpServer::ParseMessage(const cJSON* json) {
+    HeapTagScope heap_tag(kHeapTagMcp);
+    if (!cJSON_IsArray(json)) {
+        ParseRequest(json, nullptr);
+        return;
+    }
+
+    // Batch request, the replies are sent together when the last request of the batch is done
+    if (cJSON_GetArraySize(json) == 0) {
+        // JSON-RPC replies a single error, not an array, to an empty batch
+        ESP_LOGE(TAG, "Empty batch request");
+        ReplyInvalidRequest(nullptr);
+        return;
+    }
+    auto batch = std::make_shared<McpBatch>();
+    cJSON* item;
+    cJSON_ArrayForEach(item, json) {
+        if (cJSON_IsObject(item)) {
+            ParseRequest(item, batch);
+        } else {
+            ESP_LOGE(TAG, "Invalid batch request item");
+            ReplyInvalidRequest(batch);
+        }
+    }
+}
+
+void McpServer::ParseRequest(const cJSON* json, const std::shared_ptr<McpBatch>& batch) {
     // Check JSONRPC version
     auto version = cJSON_GetObjectItem(json, "jsonrpc");
     if (version == nullptr || !cJSON_IsString(version) || strcmp(version->valuestring, "2.0") != 0) {
@@ -167,10 +350,7 @@ void McpServer::ParseMessage(const cJSON* json) {
     }
     
     auto method_str = std::string(method->valuestring);
-    if (method_str.find("notifications") == 0) {
-        return;
-    }
-    
+
     // Check params
     auto params = cJSON_GetObjectItem(json, "params");
     if (params != nullptr && !cJSON_IsObject(params)) {
@@ -178,6 +358,17 @@ void McpServer::ParseMessage(const cJSON* json) {
         return;
     }
 
+    if (method_str.find("notifications") == 0) {
+        if (method_str == "notifications/cancelled" && params != nullptr) {
+            auto request_id = cJSON_GetObjectItem(params, "requestId");
+            auto reason = cJSON_GetObjectItem(params, "reason");
+            if (cJSON_IsNumber(request_id)) {
+                CancelToolCall(request_id->valueint, cJSON_IsString(reason) ? reason->valuestring : "");
+            }
+        }
+        return;
+    }
+
     auto id = cJSON_GetObjectItem(json, "id");
     if (id == nullptr || !cJSON_IsNumber(id)) {
         ESP_LOGE(TAG, "Invalid id for method: %s", method_str.c_str());
@@ -196,7 +387,7 @@ void McpServer::ParseMessage(const cJSON* json) {
         std::string message = "{\"protocolVersion\":\"2024-11-05\",\"capabilities\":{\"tools\":{}},\"serverInfo\":{\"name\":\"" BOARD_NAME "\",\"version\":\"";
         message += app_desc->version;
         message += "\"}}";
-        ReplyResult(id_int, message);
+        ReplyResult(id_int, message, batch);
     } else if (method_str == "tools/list") {
         std::string cursor_str = "";
         if (params != nullptr) {
@@ -205,163 +396,315 @@ void McpServer::ParseMessage(const cJSON* json) {
                 cursor_str = std::string(cursor->valuestring);
             }
         }
-        GetToolsList(id_int, cursor_str);
+        GetToolsList(id_int, cursor_str, batch);
     } else if (method_str == "tools/call") {
         if (!cJSON_IsObject(params)) {
             ESP_LOGE(TAG, "tools/call: Missing params");
-            ReplyError(id_int, "Missing params");
+            ReplyError(id_int, "Missing params", batch);
             return;
         }
         auto tool_name = cJSON_GetObjectItem(params, "name");
         if (!cJSON_IsString(tool_name)) {
             ESP_LOGE(TAG, "tools/call: Missing name");
-            ReplyError(id_int, "Missing name");
+            ReplyError(id_int, "Missing name", batch);
             return;
         }
         auto tool_arguments = cJSON_GetObjectItem(params, "arguments");
         if (tool_arguments != nullptr && !cJSON_IsObject(tool_arguments)) {
             ESP_LOGE(TAG, "tools/call: Invalid arguments");
-            ReplyError(id_int, "Invalid arguments");
+            ReplyError(id_int, "Invalid arguments", batch);
             return;
         }
         auto stack_size = cJSON_GetObjectItem(params, "stackSize");
         if (stack_size != nullptr && !cJSON_IsNumber(stack_size)) {
             ESP_LOGE(TAG, "tools/call: Invalid stackSize");
-            ReplyError(id_int, "Invalid stackSize");
+            ReplyError(id_int, "Invalid stackSize", batch);
             return;
         }
-        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE);
+        std::string progress_token;
+        auto meta = cJSON_GetObjectItem(params, "_meta");
+        if (cJSON_IsObject(meta)) {
+            auto token = cJSON_GetObjectItem(meta, "progressToken");
+            if (cJSON_IsString(token) || cJSON_IsNumber(token)) {
+                auto token_str = cJSON_PrintUnformatted(token);
+                progress_token = token_str;
+                cJSON_free(token_str);
+            }
+        }
+        DoToolCall(id_int, std::string(tool_name->valuestring), tool_arguments, stack_size ? stack_size->valueint : DEFAULT_TOOLCALL_STACK_SIZE,
+            std::move(progress_token), batch);
     } else {
         ESP_LOGE(TAG, "Method not implemented: %s", method_str.c_str());
-        ReplyError(id_int, "Method not implemented: " + method_str);
+        ReplyError(id_int, "Method not implemented: " + method_str, batch);
     }
 }
 
-void McpServer::ReplyResult(int id, const std::string& result) {
+void McpServer::ReplyResult(int id, const std::string& result, const std::shared_ptr<McpBatch>& batch) {
     std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id) + ",\"result\":";
     payload += result;
     payload += "}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(payload, batch);
 }
 
-void McpServer::ReplyError(int id, const std::string& message) {
+void McpServer::ReplyError(int id, const std::string& message, const std::shared_ptr<McpBatch>& batch) {
     std::string payload = "{\"jsonrpc\":\"2.0\",\"id\":";
     payload += std::to_string(id);
     payload += ",\"error\":{\"message\":\"";
     payload += message;
     payload += "\"}}";
-    Application::GetInstance().SendMcpMessage(payload);
+    SendReply(payload, batch);
 }
 
-void McpServer::GetToolsList(int id, const std::string& cursor) {
-    const int max_payload_size = 8000;
-    std::string json = "{\"tools\":[";
-    
-    bool found_cursor = cursor.empty();
-    auto it = tools_.begin();
-    std::string next_cursor = "";
-    
-    while (it != tools_.end()) {
-        // 如果我们还没有找到起始位置，继续搜索
-        if (!found_cursor) {
-            if ((*it)->name() == cursor) {
-                found_cursor = true;
-            } else {
-                ++it;
-                continue;
-            }
-        }
-        
-        // 添加tool前检查大小
-        std::string tool_json = (*it)->to_json() + ",";
-        if (json.length() + tool_json.length() + 30 > max_payload_size) {
-            // 如果添加这个tool会超出大小限制，设置next_cursor并退出循环
-            next_cursor = (*it)->name();
-            break;
+// The request id is unknown, the error is replied with a null id
+void McpServer::ReplyInvalidRequest(const std::shared_ptr<McpBatch>& batch) {
+    SendReply("{\"jsonrpc\":\"2.0\",\"id\":null,\"error\":{\"code\":-32600,\"message\":\"Invalid Request\"}}", batch);
+}
+
+void McpServer::SendReply(const std::string& payload, const std::shared_ptr<McpBatch>& batch) {
+    if (batch) {
+        batch->AddReply(payload);
+    } else {
+        Application::GetInstance().SendMcpMessage(payload);
+    }
+}
+
+void McpBatch::AddReply(const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    replies_ += replies_.empty() ? "[" : ",";
+    replies_ += payload;
+}
+
+// The last reference is dropped by the parser or the last tool call of the batch
+McpBatch::~McpBatch() {
+    if (!replies_.empty()) {
+        replies_ += "]";
+        Application::GetInstance().SendMcpMessage(replies_);
+    }
+}
+
+void McpServer::GetToolsList(int id, const std::string& cursor, const std::shared_ptr<McpBatch>& batch) {
+    if (pages_dirty_) {
+        BuildPages();
+    }
+
+    // The cursor is the name of the first tool of the page
+    size_t start = 0;
+    if (!cursor.empty()) {
+        auto it = tool_index_.find(cursor);
+        if (it == tool_index_.end()) {
+            ESP_LOGE(TAG, "tools/list: Invalid cursor: %s", cursor.c_str());
+            ReplyError(id, "Invalid cursor: " + cursor, batch);
+            return;
         }
-        
-        json += tool_json;
-        ++it;
+        start = it->second;
+    }
+    auto next_page = std::upper_bound(page_starts_.begin(), page_starts_.end(), start);
+    size_t end = next_page == page_starts_.end() ? tools_.size() : *next_page;
+
+    std::string json;
+    json.reserve(MAX_TOOLS_LIST_PAYLOAD_SIZE);
+    json = "{\"tools\":[";
+    for (size_t i = start; i < end; i++) {
+        json += tools_[i]->to_json();
+        json += ",";
     }
-    
     if (json.back() == ',') {
         json.pop_back();
     }
-    
-    if (json.back() == '[' && !tools_.empty()) {
-        // 如果没有添加任何tool，返回错误
-        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", next_cursor.c_str());
-        ReplyError(id, "Failed to add tool " + next_cursor + " because of payload size limit");
+
+    if (json.length() + 30 > MAX_TOOLS_LIST_PAYLOAD_SIZE) {
+        // A single tool that doesn't fit in a page
+        ESP_LOGE(TAG, "tools/list: Failed to add tool %s because of payload size limit", tools_[start]->name().c_str());
+        ReplyError(id, "Failed to add tool " + tools_[start]->name() + " because of payload size limit", batch);
         return;
     }
 
-    if (next_cursor.empty()) {
+    if (end >= tools_.size()) {
         json += "]}";
     } else {
-        json += "],\"nextCursor\":\"" + next_cursor + "\"}";
+        json += "],\"nextCursor\":\"" + tools_[end]->name() + "\"}";
     }
-    
-    ReplyResult(id, json);
+
+    ReplyResult(id, json, batch);
 }
 
-void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size) {
-    auto tool_iter = std::find_if(tools_.begin(), tools_.end(), 
-                                 [&tool_name](const McpTool* tool) { 
-                                     return tool->name() == tool_name; 
-                                 });
-    
-    if (tool_iter == tools_.end()) {
+void McpServer::DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size, std::string progress_token,
+    const std::shared_ptr<McpBatch>& batch) {
+    auto tool = FindTool(tool_name);
+    if (tool == nullptr) {
         ESP_LOGE(TAG, "tools/call: Unknown tool: %s", tool_name.c_str());
-        ReplyError(id, "Unknown tool: " + tool_name);
+        ReplyError(id, "Unknown tool: " + tool_name, batch);
+        return;
+    }
+
+    std::string error;
+    auto invoke = tool->Bind(tool_arguments, error);
+    if (!invoke) {
+        ESP_LOGE(TAG, "tools/call: %s", error.c_str());
+        ReplyError(id, error, batch);
         return;
     }
 
-    PropertyList arguments = (*tool_iter)->properties();
-    try {
-        for (auto& argument : arguments) {
-            bool found = false;
-            if (cJSON_IsObject(tool_arguments)) {
-                auto value = cJSON_GetObjectItem(tool_arguments, argument.name().c_str());
-                if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
-                    argument.set_value<bool>(value->valueint == 1);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
-                    argument.set_value<int>(value->valueint);
-                    found = true;
-                } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
-                    argument.set_value<std::string>(value->valuestring);
-                    found = true;
+    auto call = std::make_unique<McpToolCall>(id, tool, std::move(invoke), esp_timer_get_time(), std::move(progress_token), batch);
+    if (!QueueToolCall(std::move(call), stack_size)) {
+        ESP_LOGE(TAG, "tools/call: Too many pending tool calls");
+        ReplyError(id, "Too many pending tool calls", batch);
+    }
+}
+
+// Pick the smallest stack class that fits the requested stack size
+bool McpServer::QueueToolCall(std::unique_ptr<McpToolCall> call, int stack_size) {
+    int stack_class = kMcpToolStackLarge;
+    for (int i = 0; i < kMcpToolStackClassCount; i++) {
+        if (stack_size <= tool_call_workers_[i].stack_size) {
+            stack_class = i;
+            break;
+        }
+    }
+    if (stack_size > TOOLCALL_LARGE_STACK_SIZE) {
+        ESP_LOGW(TAG, "tools/call: stackSize %d exceeds the largest worker stack %d", stack_size, TOOLCALL_LARGE_STACK_SIZE);
+    }
+
+    auto& workers = tool_call_workers_[stack_class];
+    std::lock_guard<std::mutex> lock(tool_call_mutex_);
+    if (workers.queue.size() >= MAX_TOOLCALLS_IN_QUEUE) {
+        return false;
+    }
+    active_calls_.push_back(call.get());
+    if (call->deadline != 0 && !esp_timer_is_active(deadline_timer_)) {
+        esp_timer_start_periodic(deadline_timer_, TOOLCALL_DEADLINE_CHECK_INTERVAL_MS * 1000);
+    }
+    workers.queue.push_back(std::move(call));
+
+    if (workers.idle_workers < (int)workers.queue.size() && workers.workers < workers.max_workers) {
+        BaseType_t ret = xTaskCreate([](void* arg) {
+            auto workers = (ToolCallWorkers*)arg;
+            McpServer::GetInstance().ToolCallWorkerTask(*workers);
+        }, "tool_call", workers.stack_size, &workers, 1, nullptr);
+        if (ret == pdPASS) {
+            workers.workers++;
+        } else if (workers.workers == 0) {
+            ESP_LOGE(TAG, "Failed to create tool call worker, stack size: %d", workers.stack_size);
+            workers.queue.pop_back();
+            active_calls_.pop_back();
+            StopDeadlineTimerIfIdle();
+            return false;
+        }
+    }
+    tool_call_cv_.notify_all();
+    return true;
+}
+
+void McpServer::ToolCallWorkerTask(ToolCallWorkers& workers) {
+    HeapTagScope heap_tag(kHeapTagMcp);
+    while (true) {
+        std::unique_lock<std::mutex> lock(tool_call_mutex_);
+        workers.idle_workers++;
+        tool_call_cv_.wait(lock, [&workers]() { return !workers.queue.empty(); });
+        workers.idle_workers--;
+        auto call = std::move(workers.queue.front());
+        workers.queue.pop_front();
+        lock.unlock();
+
+        // Cancelled or timed out while waiting in the queue
+        int64_t start_time = esp_timer_get_time();
+        if (!call->IsCancelled()) {
+            current_tool_call = call.get();
+            // The tools are never deleted, their names outlive the trace events
+            TRACE_SCOPE(call->tool->name().c_str());
+            try {
+                auto result = McpTool::FormatResult(call->invoke());
+                if (!call->replied.exchange(true)) {
+                    ReplyResult(call->id, result, call->batch);
+                }
+            } catch (const std::exception& e) {
+                ESP_LOGE(TAG, "tools/call: %s", e.what());
+                if (!call->replied.exchange(true)) {
+                    ReplyError(call->id, e.what(), call->batch);
                 }
             }
+            current_tool_call = nullptr;
+        }
+        int64_t end_time = esp_timer_get_time();
+        ESP_LOGI(TAG, "tools/call %s: queued %ld ms, executed %ld ms%s", call->tool->name().c_str(),
+            (long)((start_time - call->queued_time) / 1000), (long)((end_time - start_time) / 1000),
+            call->IsCancelled() ? ", cancelled" : "");
+
+        lock.lock();
+        active_calls_.erase(std::find(active_calls_.begin(), active_calls_.end(), call.get()));
+        StopDeadlineTimerIfIdle();
+    }
+}
+
+// The timer only runs while a call with a deadline is pending, tool_call_mutex_ must be held
+void McpServer::StopDeadlineTimerIfIdle() {
+    bool has_deadline = std::any_of(active_calls_.begin(), active_calls_.end(), [](McpToolCall* call) {
+        return call->deadline != 0;
+    });
+    if (!has_deadline && esp_timer_is_active(deadline_timer_)) {
+        esp_timer_stop(deadline_timer_);
+    }
+}
+
+// Reply a timeout error for the calls past their deadline, the tool may keep running until
+// it notices the cancellation, its result is dropped then
+void McpServer::CheckDeadlines() {
+    std::lock_guard<std::mutex> lock(tool_call_mutex_);
+    int64_t now = esp_timer_get_time();
+    for (auto call : active_calls_) {
+        if (call->deadline == 0 || now < call->deadline || call->IsCancelled()) {
+            continue;
+        }
+        call->cancelled = true;
+        if (!call->replied.exchange(true)) {
+            ESP_LOGW(TAG, "tools/call %s: timed out after %d ms", call->tool->name().c_str(), call->tool->timeout_ms());
+            ReplyError(call->id, "Tool call timed out", call->batch);
+            // Don't hold back the other replies of the batch while the tool is still running
+            call->batch.reset();
+        }
+    }
+}
 
-            if (!argument.has_default_value() && !found) {
-                ESP_LOGE(TAG, "tools/call: Missing valid argument: %s", argument.name().c_str());
-                ReplyError(id, "Missing valid argument: " + argument.name());
-                return;
+// The client doesn't expect a reply for a cancelled request
+void McpServer::CancelToolCall(int id, const std::string& reason) {
+    std::lock_guard<std::mutex> lock(tool_call_mutex_);
+    for (auto call : active_calls_) {
+        if (call->id == id) {
+            ESP_LOGI(TAG, "tools/call %s: cancelled, reason: %s", call->tool->name().c_str(), reason.c_str());
+            if (!call->replied.exchange(true)) {
+                call->batch.reset();
             }
+            call->cancelled = true;
+            return;
         }
-    } catch (const std::exception& e) {
-        ESP_LOGE(TAG, "tools/call: %s", e.what());
-        ReplyError(id, e.what());
+    }
+    ESP_LOGW(TAG, "Cancel unknown or finished request: %d", id);
+}
+
+McpToolCall* McpToolCall::Current() {
+    return current_tool_call;
+}
+
+void McpToolCall::ReportProgress(int progress, int total, const std::string& message) {
+    if (progress_token.empty() || replied) {
         return;
     }
 
-    // Start a task to receive data with stack size
-    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
-    cfg.thread_name = "tool_call";
-    cfg.stack_size = stack_size;
-    cfg.prio = 1;
-    esp_pthread_set_cfg(&cfg);
-
-    // Use a thread to call the tool to avoid blocking the main thread
-    tool_call_thread_ = std::thread([this, id, tool_iter, arguments = std::move(arguments)]() {
-        try {
-            ReplyResult(id, (*tool_iter)->Call(arguments));
-        } catch (const std::exception& e) {
-            ESP_LOGE(TAG, "tools/call: %s", e.what());
-            ReplyError(id, e.what());
-        }
-    });
-    tool_call_thread_.detach();
+    cJSON* params = cJSON_CreateObject();
+    cJSON_AddRawToObject(params, "progressToken", progress_token.c_str());
+    cJSON_AddNumberToObject(params, "progress", progress);
+    if (total > 0) {
+        cJSON_AddNumberToObject(params, "total", total);
+    }
+    if (!message.empty()) {
+        cJSON_AddStringToObject(params, "message", message.c_str());
+    }
+    auto params_str = cJSON_PrintUnformatted(params);
+    std::string payload = "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/progress\",\"params\":";
+    payload += params_str;
+    payload += "}";
+    cJSON_free(params_str);
+    cJSON_Delete(params);
+    Application::GetInstance().SendMcpMessage(payload);
 }
\ No newline at end of file
@@ -2,15 +2,29 @@
 #define MCP_SERVER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <variant>
 #include <optional>
 #include <stdexcept>
-#include <thread>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <climits>
 
 #include <cJSON.h>
+#include <esp_timer.h>
+
+// The tools run to completion unless they are registered with a timeout
+#define DEFAULT_TOOLCALL_TIMEOUT_MS 0
 
 // 添加类型别名
 using ReturnValue = std::variant<bool, int, std::string>;
@@ -177,33 +191,46 @@ private:
     std::string description_;
     PropertyList properties_;
     std::function<ReturnValue(const PropertyList&)> callback_;
+    std::string json_;  // Schema serialized once at registration
+    int timeout_ms_;    // The call is abandoned with a timeout error after this time, 0 for no timeout
 
 public:
     McpTool(const std::string& name, 
             const std::string& description, 
             const PropertyList& properties, 
-            std::function<ReturnValue(const PropertyList&)> callback)
+            std::function<ReturnValue(const PropertyList&)> callback,
+            int timeout_ms = DEFAULT_TOOLCALL_TIMEOUT_MS)
         : name_(name), 
         description_(description), 
         properties_(properties), 
-        callback_(callback) {}
+        callback_(callback),
+        timeout_ms_(timeout_ms) {
+        json_ = BuildJson(BuildInputSchema(properties_));
+    }
+    virtual ~McpTool() = default;
 
     inline const std::string& name() const { return name_; }
     inline const std::string& description() const { return description_; }
     inline const PropertyList& properties() const { return properties_; }
+    inline const std::string& to_json() const { return json_; }
+    inline int timeout_ms() const { return timeout_ms_; }
+
+protected:
+    // Used by the typed tools, the input schema is generated at compile time
+    McpTool(const std::string& name, const std::string& description, std::string_view input_schema, int timeout_ms)
+        : name_(name), description_(description), timeout_ms_(timeout_ms) {
+        json_ = BuildJson(input_schema);
+    }
+
+private:
+    static std::string BuildInputSchema(const PropertyList& properties) {
+        std::vector<std::string> required = properties.GetRequired();
 
-    std::string to_json() const {
-        std::vector<std::string> required = properties_.GetRequired();
-        
-        cJSON *json = cJSON_CreateObject();
-        cJSON_AddStringToObject(json, "name", name_.c_str());
-        cJSON_AddStringToObject(json, "description", description_.c_str());
-        
         cJSON *input_schema = cJSON_CreateObject();
         cJSON_AddStringToObject(input_schema, "type", "object");
         
-        cJSON *properties = cJSON_Parse(properties_.to_json().c_str());
-        cJSON_AddItemToObject(input_schema, "properties", properties);
+        cJSON *properties_json = cJSON_Parse(properties.to_json().c_str());
+        cJSON_AddItemToObject(input_schema, "properties", properties_json);
         
         if (!required.empty()) {
             cJSON *required_array = cJSON_CreateArray();
@@ -212,19 +239,66 @@ public:
             }
             cJSON_AddItemToObject(input_schema, "required", required_array);
         }
-        
-        cJSON_AddItemToObject(json, "inputSchema", input_schema);
+
+        char *json_str = cJSON_PrintUnformatted(input_schema);
+        std::string result(json_str);
+        cJSON_free(json_str);
+        cJSON_Delete(input_schema);
+        return result;
+    }
+
+    std::string BuildJson(std::string_view input_schema) const {
+        cJSON *json = cJSON_CreateObject();
+        cJSON_AddStringToObject(json, "name", name_.c_str());
+        cJSON_AddStringToObject(json, "description", description_.c_str());
         
         char *json_str = cJSON_PrintUnformatted(json);
         std::string result(json_str);
         cJSON_free(json_str);
         cJSON_Delete(json);
-        
+
+        // Append the input schema to the object
+        result.pop_back();
+        result += ",\"inputSchema\":";
+        result += input_schema;
+        result += "}";
         return result;
     }
 
-    std::string Call(const PropertyList& properties) {
-        ReturnValue return_value = callback_(properties);
+public:
+    // Parse the arguments of a call, returns the bound callback or nullptr with the error message
+    virtual std::function<ReturnValue()> Bind(const cJSON* arguments, std::string& error) {
+        PropertyList values = properties_;
+        try {
+            for (auto& argument : values) {
+                bool found = false;
+                if (cJSON_IsObject(arguments)) {
+                    auto value = cJSON_GetObjectItem(arguments, argument.name().c_str());
+                    if (argument.type() == kPropertyTypeBoolean && cJSON_IsBool(value)) {
+                        argument.set_value<bool>(value->valueint == 1);
+                        found = true;
+                    } else if (argument.type() == kPropertyTypeInteger && cJSON_IsNumber(value)) {
+                        argument.set_value<int>(value->valueint);
+                        found = true;
+                    } else if (argument.type() == kPropertyTypeString && cJSON_IsString(value)) {
+                        argument.set_value<std::string>(value->valuestring);
+                        found = true;
+                    }
+                }
+
+                if (!argument.has_default_value() && !found) {
+                    error = "Missing valid argument: " + argument.name();
+                    return nullptr;
+                }
+            }
+        } catch (const std::exception& e) {
+            error = e.what();
+            return nullptr;
+        }
+        return [this, values = std::move(values)]() { return callback_(values); };
+    }
+
+    static std::string FormatResult(const ReturnValue& return_value) {
         // 返回结果
         cJSON* result = cJSON_CreateObject();
         cJSON* content = cJSON_CreateArray();
@@ -249,6 +323,256 @@ public:
     }
 };
 
+/*
+ * Typed tool declarations
+ *
+ * The arguments are declared as template parameters in the same order as the callback parameters:
+ *
+ *   AddTool<McpInt<"volume", 0, 100>>("self.audio_speaker.set_volume", "...",
+ *       [](int volume) -> ReturnValue { ... });
+ *
+ * McpInt<Name, Min, Max>, McpBool<Name> and McpString<Name> are required arguments, a trailing
+ * default value (McpInt<"steps", 1, 100, 3>, McpBool<"enabled", true>, McpString<"mode", "auto">)
+ * makes the argument optional. The input schema is generated at compile time, the arguments are
+ * read straight from the request into the callback parameters, errors are reported without exceptions.
+ */
+template<size_t N>
+struct McpFixedString {
+    char value[N] {};
+
+    constexpr McpFixedString(const char (&str)[N]) {
+        for (size_t i = 0; i < N; i++) {
+            value[i] = str[i];
+        }
+    }
+    constexpr std::string_view view() const { return std::string_view(value, N - 1); }
+};
+
+constexpr void McpAppendJsonString(std::string& out, std::string_view str) {
+    out += '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+constexpr void McpAppendInt(std::string& out, int value) {
+    long long v = value;
+    if (v < 0) {
+        out += '-';
+        v = -v;
+    }
+    char digits[12] {};
+    int count = 0;
+    do {
+        digits[count++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    while (count > 0) {
+        out += digits[--count];
+    }
+}
+
+template<McpFixedString Name, int Min, int Max, int... Default>
+struct McpInt {
+    static_assert(sizeof...(Default) <= 1, "Only one default value is allowed");
+    static_assert(((Default >= Min && Default <= Max) && ...), "Default value must be within the specified range");
+    using type = int;
+    static constexpr std::string_view name = Name.view();
+    static constexpr bool required = sizeof...(Default) == 0;
+
+    static constexpr void AppendSchema(std::string& out) {
+        out += "{\"type\":\"integer\"";
+        ((out += ",\"default\":", McpAppendInt(out, Default)), ...);
+        if (Min != INT_MIN) {
+            out += ",\"minimum\":";
+            McpAppendInt(out, Min);
+        }
+        if (Max != INT_MAX) {
+            out += ",\"maximum\":";
+            McpAppendInt(out, Max);
+        }
+        out += "}";
+    }
+
+    static bool Parse(const cJSON* value, int& out, std::string& error) {
+        if (!cJSON_IsNumber(value)) {
+            ((out = Default), ...);
+            if (required) {
+                error = "Missing valid argument: " + std::string(name);
+            }
+            return !required;
+        }
+        out = value->valueint;
+        if (out < Min || out > Max) {
+            error = "Argument " + std::string(name) + " out of range [" + std::to_string(Min) + ", " + std::to_string(Max) + "]";
+            return false;
+        }
+        return true;
+    }
+};
+
+template<McpFixedString Name, bool... Default>
+struct McpBool {
+    static_assert(sizeof...(Default) <= 1, "Only one default value is allowed");
+    using type = bool;
+    static constexpr std::string_view name = Name.view();
+    static constexpr bool required = sizeof...(Default) == 0;
+
+    static constexpr void AppendSchema(std::string& out) {
+        out += "{\"type\":\"boolean\"";
+        ((out += Default ? ",\"default\":true" : ",\"default\":false"), ...);
+        out += "}";
+    }
+
+    static bool Parse(const cJSON* value, bool& out, std::string& error) {
+        if (!cJSON_IsBool(value)) {
+            ((out = Default), ...);
+            if (required) {
+                error = "Missing valid argument: " + std::string(name);
+            }
+            return !required;
+        }
+        out = cJSON_IsTrue(value);
+        return true;
+    }
+};
+
+template<McpFixedString Name, McpFixedString... Default>
+struct McpString {
+    static_assert(sizeof...(Default) <= 1, "Only one default value is allowed");
+    using type = std::string;
+    static constexpr std::string_view name = Name.view();
+    static constexpr bool required = sizeof...(Default) == 0;
+
+    static constexpr void AppendSchema(std::string& out) {
+        out += "{\"type\":\"string\"";
+        ((out += ",\"default\":", McpAppendJsonString(out, Default.view())), ...);
+        out += "}";
+    }
+
+    static bool Parse(const cJSON* value, std::string& out, std::string& error) {
+        if (!cJSON_IsString(value)) {
+            ((out = Default.view()), ...);
+            if (required) {
+                error = "Missing valid argument: " + std::string(name);
+            }
+            return !required;
+        }
+        out = value->valuestring;
+        return true;
+    }
+};
+
+template<typename... Args>
+constexpr std::string McpBuildInputSchema() {
+    std::string out = "{\"type\":\"object\",\"properties\":{";
+    bool first = true;
+    ((out += first ? "" : ",", first = false, McpAppendJsonString(out, Args::name), out += ":", Args::AppendSchema(out)), ...);
+    out += "}";
+    if constexpr ((Args::required || ...)) {
+        out += ",\"required\":[";
+        first = true;
+        ((Args::required ? (out += first ? "" : ",", first = false, McpAppendJsonString(out, Args::name)) : void()), ...);
+        out += "]";
+    }
+    out += "}";
+    return out;
+}
+
+// The schema text is kept in flash as a constant, no copy is made at registration
+template<typename... Args>
+inline constexpr auto McpInputSchemaStorage = [] {
+    std::array<char, McpBuildInputSchema<Args...>().size()> buffer {};
+    auto schema = McpBuildInputSchema<Args...>();
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = schema[i];
+    }
+    return buffer;
+}();
+
+template<typename... Args>
+inline constexpr std::string_view McpInputSchema(McpInputSchemaStorage<Args...>.data(), McpInputSchemaStorage<Args...>.size());
+
+template<typename Callback, typename... Args>
+class McpTypedTool : public McpTool {
+    static_assert(std::is_invocable_r_v<ReturnValue, Callback&, typename Args::type&...>,
+        "The callback parameters must match the declared arguments");
+
+public:
+    McpTypedTool(const std::string& name, const std::string& description, Callback callback, int timeout_ms)
+        : McpTool(name, description, McpInputSchema<Args...>, timeout_ms), callback_(std::move(callback)) {}
+
+    std::function<ReturnValue()> Bind(const cJSON* arguments, std::string& error) override {
+        if (!cJSON_IsObject(arguments)) {
+            arguments = nullptr;
+        }
+        std::tuple<typename Args::type...> values;
+        bool ok = std::apply([arguments, &error](auto&... value) {
+            return (Args::Parse(cJSON_GetObjectItem(arguments, Args::name.data()), value, error) && ...);
+        }, values);
+        if (!ok) {
+            return nullptr;
+        }
+        return [this, values = std::move(values)]() mutable { return std::apply(callback_, values); };
+    }
+
+private:
+    Callback callback_;
+};
+
+// Tool calls run on persistent worker tasks, grouped by stack size
+enum McpToolStackClass {
+    kMcpToolStackSmall,
+    kMcpToolStackMedium,
+    kMcpToolStackLarge,
+    kMcpToolStackClassCount
+};
+
+// Replies of a JSON-RPC batch request, sent as one array once the last request of the batch is done
+class McpBatch {
+public:
+    ~McpBatch();
+    void AddReply(const std::string& payload);
+
+private:
+    std::mutex mutex_;
+    std::string replies_;
+};
+
+/*
+ * A pending or running tool call, it also serves as the cancellation token of the tool.
+ * Long running tools get it with McpToolCall::Current(), poll IsCancelled() between their steps
+ * (the call is cancelled by notifications/cancelled or when the deadline passes, the reply has
+ * already been sent or suppressed then) and stream progress or partial results with ReportProgress().
+ */
+struct McpToolCall {
+    int id;
+    McpTool* tool;
+    std::function<ReturnValue()> invoke;  // The tool callback bound to the parsed arguments
+    int64_t queued_time;
+    int64_t deadline;  // 0 if the tool has no timeout
+    std::string progress_token;  // JSON encoded params._meta.progressToken, empty if not requested
+    std::shared_ptr<McpBatch> batch;  // Set if the call is part of a batch request
+    std::atomic<bool> cancelled = false;
+    std::atomic<bool> replied = false;
+
+    McpToolCall(int id, McpTool* tool, std::function<ReturnValue()>&& invoke, int64_t queued_time, std::string&& progress_token,
+        const std::shared_ptr<McpBatch>& batch)
+        : id(id), tool(tool), invoke(std::move(invoke)), queued_time(queued_time),
+        deadline(tool->timeout_ms() > 0 ? queued_time + tool->timeout_ms() * 1000LL : 0), progress_token(std::move(progress_token)), batch(batch) {}
+
+    inline bool IsCancelled() const { return cancelled.load(); }
+    // progress must increase with every call, total <= 0 means unknown
+    void ReportProgress(int progress, int total, const std::string& message = "");
+
+    // The tool call running on the current task, nullptr outside of tool calls
+    static McpToolCall* Current();
+};
+
 class McpServer {
 public:
     static McpServer& GetInstance() {
@@ -258,7 +582,13 @@ public:
 
     void AddCommonTools();
     void AddTool(McpTool* tool);
-    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback);
+    void AddTool(const std::string& name, const std::string& description, const PropertyList& properties, std::function<ReturnValue(const PropertyList&)> callback,
+        int timeout_ms = DEFAULT_TOOLCALL_TIMEOUT_MS);
+    // Typed tool, see McpTypedTool
+    template<typename... Args, typename Callback>
+    void AddTool(const std::string& name, const std::string& description, Callback callback, int timeout_ms = DEFAULT_TOOLCALL_TIMEOUT_MS) {
+        AddTool(new McpTypedTool<Callback, Args...>(name, description, std::move(callback), timeout_ms));
+    }
     void ParseMessage(const cJSON* json);
     void ParseMessage(const std::string& message);
 
@@ -266,16 +596,48 @@ private:
     McpServer();
     ~McpServer();
 
+    void ParseRequest(const cJSON* json, const std::shared_ptr<McpBatch>& batch);
     void ParseCapabilities(const cJSON* capabilities);
 
-    void ReplyResult(int id, const std::string& result);
-    void ReplyError(int id, const std::string& message);
+    void ReplyResult(int id, const std::string& result, const std::shared_ptr<McpBatch>& batch = nullptr);
+    void ReplyError(int id, const std::string& message, const std::shared_ptr<McpBatch>& batch = nullptr);
+    void ReplyInvalidRequest(const std::shared_ptr<McpBatch>& batch);
+    void SendReply(const std::string& payload, const std::shared_ptr<McpBatch>& batch);
 
-    void GetToolsList(int id, const std::string& cursor);
-    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size);
+    void GetToolsList(int id, const std::string& cursor, const std::shared_ptr<McpBatch>& batch);
+    void DoToolCall(int id, const std::string& tool_name, const cJSON* tool_arguments, int stack_size, std::string progress_token,
+        const std::shared_ptr<McpBatch>& batch);
+    void CancelToolCall(int id, const std::string& reason);
+    McpTool* FindTool(const std::string& name) const;
+    void RebuildIndex();
+    void BuildPages();
 
     std::vector<McpTool*> tools_;
-    std::thread tool_call_thread_;
+    // Tool name -> position in tools_, the keys point into the tools' own name strings
+    std::unordered_map<std::string_view, size_t> tool_index_;
+    // Positions in tools_ where each tools/list page starts, rebuilt when the tools change
+    std::vector<size_t> page_starts_;
+    bool pages_dirty_ = true;
+
+    struct ToolCallWorkers {
+        McpToolStackClass stack_class;
+        int stack_size;
+        int max_workers;
+        int workers = 0;
+        int idle_workers = 0;
+        std::deque<std::unique_ptr<McpToolCall>> queue;
+    };
+    std::mutex tool_call_mutex_;
+    std::condition_variable tool_call_cv_;
+    ToolCallWorkers tool_call_workers_[kMcpToolStackClassCount];
+    // Queued and running calls, guarded by tool_call_mutex_
+    std::vector<McpToolCall*> active_calls_;
+    esp_timer_handle_t deadline_timer_ = nullptr;
+
+    bool QueueToolCall(std::unique_ptr<McpToolCall> call, int stack_size);
+    void ToolCallWorkerTask(ToolCallWorkers& workers);
+    void CheckDeadlines();
+    void StopDeadlineTimerIfIdle();
 };
 
 #endif // MCP_SERVER_H
@@ -0,0 +1,543 @@
+#include "cbor_codec.h"
+
+#include <esp_log.h>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+
+#define TAG "CborCodec"
+
+#define CBOR_MAX_DEPTH 32
+
+void CborWriter::WriteHead(uint8_t major_type, uint64_t value) {
+    uint8_t head = major_type << 5;
+    if (value < 24) {
+        out_.push_back((char)(head | value));
+        return;
+    }
+    int bytes;
+    if (value <= 0xFF) {
+        head |= 24;
+        bytes = 1;
+    } else if (value <= 0xFFFF) {
+        head |= 25;
+        bytes = 2;
+    } else if (value <= 0xFFFFFFFF) {
+        head |= 26;
+        bytes = 4;
+    } else {
+        head |= 27;
+        bytes = 8;
+    }
+    out_.push_back((char)head);
+    for (int i = bytes - 1; i >= 0; i--) {
+        out_.push_back((char)(value >> (i * 8)));
+    }
+}
+
+void CborWriter::String(const char* str, size_t length) {
+    WriteHead(3, length);
+    out_.append(str, length);
+}
+
+void CborWriter::Int(int64_t value) {
+    if (value >= 0) {
+        WriteHead(0, value);
+    } else {
+        WriteHead(1, -1 - value);
+    }
+}
+
+void CborWriter::Double(double value) {
+    float f = (float)value;
+    if ((double)f == value) {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        out_.push_back((char)0xFA);
+        for (int i = 3; i >= 0; i--) {
+            out_.push_back((char)(bits >> (i * 8)));
+        }
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        out_.push_back((char)0xFB);
+        for (int i = 7; i >= 0; i--) {
+            out_.push_back((char)(bits >> (i * 8)));
+        }
+    }
+}
+
+/*
+ * Single pass JSON text -> CBOR transcoder
+ */
+class JsonTranscoder {
+public:
+    JsonTranscoder(const char* json, size_t length, std::string& out)
+        : p_(json), end_(json + length), writer_(out) {}
+
+    bool Run() {
+        if (!Value(0)) {
+            return false;
+        }
+        SkipSpaces();
+        return p_ == end_;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    CborWriter writer_;
+    std::string string_;
+
+    void SkipSpaces() {
+        while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')) {
+            p_++;
+        }
+    }
+
+    bool Literal(const char* literal) {
+        size_t length = strlen(literal);
+        if ((size_t)(end_ - p_) < length || memcmp(p_, literal, length) != 0) {
+            return false;
+        }
+        p_ += length;
+        return true;
+    }
+
+    bool Value(int depth) {
+        if (depth > CBOR_MAX_DEPTH) {
+            return false;
+        }
+        SkipSpaces();
+        if (p_ >= end_) {
+            return false;
+        }
+        switch (*p_) {
+        case '{':
+            return Object(depth);
+        case '[':
+            return Array(depth);
+        case '"':
+            if (!ParseString()) {
+                return false;
+            }
+            writer_.String(string_.data(), string_.size());
+            return true;
+        case 't':
+            writer_.Bool(true);
+            return Literal("true");
+        case 'f':
+            writer_.Bool(false);
+            return Literal("false");
+        case 'n':
+            writer_.Null();
+            return Literal("null");
+        default:
+            return Number();
+        }
+    }
+
+    bool Object(int depth) {
+        p_++;
+        writer_.BeginMap();
+        SkipSpaces();
+        if (p_ < end_ && *p_ == '}') {
+            p_++;
+            writer_.End();
+            return true;
+        }
+        while (true) {
+            SkipSpaces();
+            if (p_ >= end_ || *p_ != '"' || !ParseString()) {
+                return false;
+            }
+            writer_.String(string_.data(), string_.size());
+            SkipSpaces();
+            if (p_ >= end_ || *p_ != ':') {
+                return false;
+            }
+            p_++;
+            if (!Value(depth + 1)) {
+                return false;
+            }
+            SkipSpaces();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+            } else if (*p_ == '}') {
+                p_++;
+                writer_.End();
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    bool Array(int depth) {
+        p_++;
+        writer_.BeginArray();
+        SkipSpaces();
+        if (p_ < end_ && *p_ == ']') {
+            p_++;
+            writer_.End();
+            return true;
+        }
+        while (true) {
+            if (!Value(depth + 1)) {
+                return false;
+            }
+            SkipSpaces();
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == ',') {
+                p_++;
+            } else if (*p_ == ']') {
+                p_++;
+                writer_.End();
+                return true;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    bool Number() {
+        const char* start = p_;
+        bool is_integer = true;
+        while (p_ < end_ && (isdigit((unsigned char)*p_) || *p_ == '-' || *p_ == '+' || *p_ == '.' || *p_ == 'e' || *p_ == 'E')) {
+            if (*p_ == '.' || *p_ == 'e' || *p_ == 'E') {
+                is_integer = false;
+            }
+            p_++;
+        }
+        if (p_ == start || p_ - start > 32) {
+            return false;
+        }
+        char buffer[33];
+        memcpy(buffer, start, p_ - start);
+        buffer[p_ - start] = '\0';
+        char* number_end;
+        if (is_integer) {
+            errno = 0;
+            long long value = strtoll(buffer, &number_end, 10);
+            if (*number_end == '\0' && errno == 0) {
+                writer_.Int(value);
+                return true;
+            }
+        }
+        double value = strtod(buffer, &number_end);
+        if (*number_end != '\0') {
+            return false;
+        }
+        writer_.Double(value);
+        return true;
+    }
+
+    static int HexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool ParseHex4(uint32_t& value) {
+        if (end_ - p_ < 4) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            int digit = HexValue(*p_++);
+            if (digit < 0) {
+                return false;
+            }
+            value = (value << 4) | digit;
+        }
+        return true;
+    }
+
+    void AppendUtf8(uint32_t code) {
+        if (code < 0x80) {
+            string_.push_back((char)code);
+        } else if (code < 0x800) {
+            string_.push_back((char)(0xC0 | (code >> 6)));
+            string_.push_back((char)(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            string_.push_back((char)(0xE0 | (code >> 12)));
+            string_.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+            string_.push_back((char)(0x80 | (code & 0x3F)));
+        } else {
+            string_.push_back((char)(0xF0 | (code >> 18)));
+            string_.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+            string_.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+            string_.push_back((char)(0x80 | (code & 0x3F)));
+        }
+    }
+
+    // Unescapes the string at p_ into string_
+    bool ParseString() {
+        p_++;
+        string_.clear();
+        while (p_ < end_) {
+            // Copy the plain run in one go
+            const char* run = p_;
+            while (p_ < end_ && *p_ != '"' && *p_ != '\\') {
+                p_++;
+            }
+            string_.append(run, p_ - run);
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == '"') {
+                p_++;
+                return true;
+            }
+            p_++;
+            if (p_ >= end_) {
+                return false;
+            }
+            char c = *p_++;
+            switch (c) {
+            case '"': string_.push_back('"'); break;
+            case '\\': string_.push_back('\\'); break;
+            case '/': string_.push_back('/'); break;
+            case 'b': string_.push_back('\b'); break;
+            case 'f': string_.push_back('\f'); break;
+            case 'n': string_.push_back('\n'); break;
+            case 'r': string_.push_back('\r'); break;
+            case 't': string_.push_back('\t'); break;
+            case 'u': {
+                uint32_t code;
+                if (!ParseHex4(code)) {
+                    return false;
+                }
+                if (code >= 0xD800 && code <= 0xDBFF) {
+                    uint32_t low;
+                    if (end_ - p_ < 6 || p_[0] != '\\' || p_[1] != 'u') {
+                        return false;
+                    }
+                    p_ += 2;
+                    if (!ParseHex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                        return false;
+                    }
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                AppendUtf8(code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+};
+
+bool JsonToCbor(const char* json, size_t length, std::string& out) {
+    out.clear();
+    JsonTranscoder transcoder(json, length, out);
+    if (!transcoder.Run()) {
+        ESP_LOGE(TAG, "Failed to transcode json to cbor");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * CBOR -> cJSON decoder
+ */
+class CborDecoder {
+public:
+    CborDecoder(const uint8_t* data, size_t size) : p_(data), end_(data + size) {}
+
+    cJSON* Run() {
+        cJSON* item = Item(0);
+        if (item != nullptr && p_ != end_) {
+            cJSON_Delete(item);
+            return nullptr;
+        }
+        return item;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+
+    static constexpr uint64_t kIndefinite = UINT64_MAX;
+
+    bool ReadHead(uint8_t& major_type, uint8_t& info, uint64_t& value) {
+        if (p_ >= end_) {
+            return false;
+        }
+        uint8_t head = *p_++;
+        major_type = head >> 5;
+        info = head & 0x1F;
+        if (info < 24) {
+            value = info;
+            return true;
+        }
+        if (info == 31) {
+            value = kIndefinite;
+            return true;
+        }
+        if (info > 27) {
+            return false;
+        }
+        int bytes = 1 << (info - 24);
+        if (end_ - p_ < bytes) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value = (value << 8) | *p_++;
+        }
+        return true;
+    }
+
+    bool IsBreak() {
+        if (p_ < end_ && *p_ == 0xFF) {
+            p_++;
+            return true;
+        }
+        return false;
+    }
+
+    // Reads a (possibly chunked) text or byte string
+    bool ReadString(uint8_t major_type, uint64_t length, std::string& out) {
+        if (length != kIndefinite) {
+            if ((uint64_t)(end_ - p_) < length) {
+                return false;
+            }
+            out.append((const char*)p_, length);
+            p_ += length;
+            return true;
+        }
+        while (!IsBreak()) {
+            uint8_t chunk_type, chunk_info;
+            uint64_t chunk_length;
+            if (!ReadHead(chunk_type, chunk_info, chunk_length) || chunk_type != major_type || chunk_length == kIndefinite) {
+                return false;
+            }
+            if (!ReadString(major_type, chunk_length, out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static double HalfToDouble(uint16_t half) {
+        int exponent = (half >> 10) & 0x1F;
+        int mantissa = half & 0x3FF;
+        double value;
+        if (exponent == 0) {
+            value = ldexp(mantissa, -24);
+        } else if (exponent != 31) {
+            value = ldexp(mantissa + 1024, exponent - 25);
+        } else {
+            value = mantissa == 0 ? INFINITY : NAN;
+        }
+        return (half & 0x8000) ? -value : value;
+    }
+
+    cJSON* Item(int depth) {
+        if (depth > CBOR_MAX_DEPTH) {
+            return nullptr;
+        }
+        uint8_t major_type, info;
+        uint64_t value;
+        if (!ReadHead(major_type, info, value)) {
+            return nullptr;
+        }
+        switch (major_type) {
+        case 0:
+            return value == kIndefinite ? nullptr : cJSON_CreateNumber((double)value);
+        case 1:
+            return value == kIndefinite ? nullptr : cJSON_CreateNumber(-1.0 - (double)value);
+        case 2:
+        case 3: {
+            std::string str;
+            if (!ReadString(major_type, value, str)) {
+                return nullptr;
+            }
+            return cJSON_CreateString(str.c_str());
+        }
+        case 4: {
+            cJSON* array = cJSON_CreateArray();
+            for (uint64_t i = 0; value == kIndefinite ? !IsBreak() : i < value; i++) {
+                cJSON* child = Item(depth + 1);
+                if (child == nullptr) {
+                    cJSON_Delete(array);
+                    return nullptr;
+                }
+                cJSON_AddItemToArray(array, child);
+            }
+            return array;
+        }
+        case 5: {
+            cJSON* object = cJSON_CreateObject();
+            for (uint64_t i = 0; value == kIndefinite ? !IsBreak() : i < value; i++) {
+                uint8_t key_type, key_info;
+                uint64_t key_length;
+                std::string key;
+                if (!ReadHead(key_type, key_info, key_length) || key_type != 3 || !ReadString(3, key_length, key)) {
+                    cJSON_Delete(object);
+                    return nullptr;
+                }
+                cJSON* child = Item(depth + 1);
+                if (child == nullptr) {
+                    cJSON_Delete(object);
+                    return nullptr;
+                }
+                cJSON_AddItemToObject(object, key.c_str(), child);
+            }
+            return object;
+        }
+        case 6:
+            // Tags carry no meaning for us, decode the tagged item
+            return Item(depth + 1);
+        default:
+            break;
+        }
+
+        // Major type 7: simple values and floats
+        switch (info) {
+        case 20:
+            return cJSON_CreateFalse();
+        case 21:
+            return cJSON_CreateTrue();
+        case 22:
+        case 23:
+            return cJSON_CreateNull();
+        case 25:
+            return cJSON_CreateNumber(HalfToDouble((uint16_t)value));
+        case 26: {
+            uint32_t bits = (uint32_t)value;
+            float f;
+            memcpy(&f, &bits, sizeof(f));
+            return cJSON_CreateNumber(f);
+        }
+        case 27: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            return cJSON_CreateNumber(d);
+        }
+        default:
+            break;
+        }
+        return nullptr;
+    }
+};
+
+cJSON* CborToJson(const uint8_t* data, size_t size) {
+    CborDecoder decoder(data, size);
+    cJSON* root = decoder.Run();
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Failed to decode cbor message");
+    }
+    return root;
+}
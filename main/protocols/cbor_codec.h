@@ -0,0 +1,38 @@
+#ifndef CBOR_CODEC_H
+#define CBOR_CODEC_H
+
+#include <cJSON.h>
+#include <string>
+#include <cstdint>
+
+/*
+ * Compact binary encoding (CBOR, RFC 8949) for control and MCP messages.
+ *
+ * Outgoing messages are still built as JSON text by the protocol and MCP code, JsonToCbor()
+ * transcodes the text in a single pass straight into CBOR (indefinite-length maps / arrays),
+ * without building a cJSON tree. Incoming CBOR is decoded directly into the cJSON tree the
+ * message handlers consume, without going through JSON text.
+ */
+class CborWriter {
+public:
+    explicit CborWriter(std::string& out) : out_(out) {}
+
+    void BeginMap() { out_.push_back((char)0xBF); }
+    void BeginArray() { out_.push_back((char)0x9F); }
+    void End() { out_.push_back((char)0xFF); }
+    void String(const char* str, size_t length);
+    void Int(int64_t value);
+    void Double(double value);
+    void Bool(bool value) { out_.push_back((char)(value ? 0xF5 : 0xF4)); }
+    void Null() { out_.push_back((char)0xF6); }
+
+private:
+    std::string& out_;
+
+    void WriteHead(uint8_t major_type, uint64_t value);
+};
+
+bool JsonToCbor(const char* json, size_t length, std::string& out);
+cJSON* CborToJson(const uint8_t* data, size_t size);
+
+#endif // CBOR_CODEC_H
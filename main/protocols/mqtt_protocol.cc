@@ -2,9 +2,12 @@
 #include "board.h"
 #include "application.h"
 #include "settings.h"
+#include "cbor_codec.h"
+#include "heap_profiler.h"
 
 #include <esp_log.h>
 #include <cstring>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "assets/lang_config.h"
 
@@ -24,6 +27,7 @@ bool MqttProtocol::Start() {
 }
 
 bool MqttProtocol::StartMqttClient(bool report_error) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     if (mqtt_ != nullptr) {
         ESP_LOGW(TAG, "Mqtt client already started");
         mqtt_.reset();
@@ -54,9 +58,22 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
     });
 
     mqtt_->OnMessage([this](const std::string& topic, const std::string& payload) {
-        cJSON* root = cJSON_Parse(payload.c_str());
+        HeapTagScope heap_tag(kHeapTagProtocol);
+        // JSON messages start with '{', anything else is a CBOR message
+        cJSON* root = nullptr;
+        bool cbor = !payload.empty() && payload[0] != '{';
+        if (cbor) {
+            root = CborToJson((const uint8_t*)payload.data(), payload.size());
+        } else {
+            root = cJSON_Parse(payload.c_str());
+        }
         if (root == nullptr) {
-            ESP_LOGE(TAG, "Failed to parse json message %s", payload.c_str());
+            if (cbor) {
+                ESP_LOGE(TAG, "Failed to parse cbor message, %lu bytes", (unsigned long)payload.size());
+                ESP_LOG_BUFFER_HEXDUMP(TAG, payload.data(), std::min<size_t>(payload.size(), 64), ESP_LOG_DEBUG);
+            } else {
+                ESP_LOGE(TAG, "Failed to parse message %s", payload.c_str());
+            }
             return;
         }
         cJSON* type = cJSON_GetObjectItem(root, "type");
@@ -77,6 +94,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
                 });
             }
         } else if (on_incoming_json_ != nullptr) {
+            UpdateStatistics(root);
             on_incoming_json_(root);
         }
         cJSON_Delete(root);
@@ -104,6 +122,7 @@ bool MqttProtocol::StartMqttClient(bool report_error) {
 }
 
 bool MqttProtocol::SendText(const std::string& text) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     if (publish_topic_.empty()) {
         return false;
     }
@@ -115,12 +134,30 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
+// CBOR messages are published as binary payloads on the same topic
+bool MqttProtocol::SendCbor(const std::string& data) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
+    if (publish_topic_.empty()) {
+        return false;
+    }
+    if (!mqtt_->Publish(publish_topic_, data)) {
+        ESP_LOGE(TAG, "Failed to publish cbor message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
 bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
 
+    // Skip the sequence numbers of dropped packets so the server can see the gap
+    local_sequence_ += packet->gap;
+
     std::string nonce(aes_nonce_);
     *(uint16_t*)&nonce[2] = htons(packet->payload.size());
     *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
@@ -138,7 +175,11 @@ bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         return false;
     }
 
-    return udp_->Send(encrypted) > 0;
+    if (udp_->Send(encrypted) <= 0) {
+        return false;
+    }
+    network_stats_.OnAudioSent(packet->payload.size());
+    return true;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -149,9 +190,10 @@ void MqttProtocol::CloseAudioChannel() {
 
     std::string message = "{";
     message += "\"session_id\":\"" + session_id_ + "\",";
-    message += "\"type\":\"goodbye\"";
+    message += "\"type\":\"goodbye\",";
+    message += "\"stats\":" + network_stats_.ToJson();
     message += "}";
-    SendText(message);
+    SendMessage(message);
 
     if (on_audio_channel_closed_ != nullptr) {
         on_audio_channel_closed_();
@@ -159,6 +201,7 @@ void MqttProtocol::CloseAudioChannel() {
 }
 
 bool MqttProtocol::OpenAudioChannel() {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
         if (!StartMqttClient(true)) {
@@ -187,6 +230,7 @@ bool MqttProtocol::OpenAudioChannel() {
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
     udp_->OnMessage([this](const std::string& data) {
+        HeapTagScope heap_tag(kHeapTagProtocol);
         /*
          * UDP Encrypted OPUS Packet Format:
          * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
@@ -202,6 +246,7 @@ bool MqttProtocol::OpenAudioChannel() {
         }
         uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
         uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
+        network_stats_.OnSequence(sequence, remote_sequence_ + 1);
         if (sequence < remote_sequence_) {
             ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
             return;
@@ -225,6 +270,7 @@ bool MqttProtocol::OpenAudioChannel() {
             ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
             return;
         }
+        network_stats_.OnAudioReceived(decrypted_size, server_frame_duration_);
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
@@ -234,6 +280,7 @@ bool MqttProtocol::OpenAudioChannel() {
 
     udp_->Connect(udp_server_, udp_port_);
 
+    network_stats_.StartSession();
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -251,6 +298,9 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_USE_CBOR_MESSAGES
+    cJSON_AddBoolToObject(features, "cbor", true);
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
@@ -258,6 +308,9 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddNumberToObject(audio_params, "channels", 1);
     cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
+    if (network_stats_.HasSession()) {
+        cJSON_AddItemToObject(root, "last_session_stats", network_stats_.ToJsonObject());
+    }
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
     cJSON_free(json_str);
@@ -272,6 +325,8 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         return;
     }
 
+    ParseServerFeatures(root);
+
     auto session_id = cJSON_GetObjectItem(root, "session_id");
     if (cJSON_IsString(session_id)) {
         session_id_ = session_id->valuestring;
@@ -51,6 +51,7 @@ private:
     std::string DecodeHexString(const std::string& hex_string);
 
     bool SendText(const std::string& text) override;
+    bool SendCbor(const std::string& data) override;
     std::string GetHelloMessage();
 };
 
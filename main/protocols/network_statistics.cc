@@ -0,0 +1,159 @@
+#include "network_statistics.h"
+
+#include <esp_log.h>
+#include <cmath>
+
+#define TAG "NetworkStats"
+
+static const int kLatencyBuckets[] = NETWORK_STATS_LATENCY_BUCKETS;
+
+void LatencyHistogram::Add(int latency_ms) {
+    size_t i = 0;
+    while (i < sizeof(kLatencyBuckets) / sizeof(kLatencyBuckets[0]) && latency_ms > kLatencyBuckets[i]) {
+        i++;
+    }
+    buckets_[i]++;
+    count_++;
+    sum_ms_ += latency_ms;
+    last_ms_ = latency_ms;
+    if (latency_ms > max_ms_) {
+        max_ms_ = latency_ms;
+    }
+}
+
+cJSON* LatencyHistogram::ToJson() const {
+    cJSON* json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(json, "last", last_ms_);
+    cJSON_AddNumberToObject(json, "avg", count_ > 0 ? (int)(sum_ms_ / count_) : -1);
+    cJSON_AddNumberToObject(json, "max", max_ms_);
+    cJSON_AddNumberToObject(json, "count", count_);
+    cJSON* histogram = cJSON_CreateArray();
+    for (auto bucket : buckets_) {
+        cJSON_AddItemToArray(histogram, cJSON_CreateNumber(bucket));
+    }
+    cJSON_AddItemToObject(json, "histogram", histogram);
+    return json;
+}
+
+void NetworkStatistics::StartSession() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    session_start_time_ = Clock::now();
+    session_count_++;
+    turn_pending_ = false;
+    waiting_first_audio_ = false;
+    uplink_packets_ = 0;
+    uplink_bytes_ = 0;
+    downlink_packets_ = 0;
+    downlink_bytes_ = 0;
+    lost_packets_ = 0;
+    late_packets_ = 0;
+    jitter_ms_ = 0;
+    receiving_ = false;
+}
+
+void NetworkStatistics::OnAudioSent(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uplink_packets_++;
+    uplink_bytes_ += bytes;
+}
+
+void NetworkStatistics::OnAudioReceived(size_t bytes, int frame_duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = Clock::now();
+    if (receiving_) {
+        // Inter-arrival jitter (RFC 3550): deviation of the arrival interval from the frame duration
+        float interval_ms = std::chrono::duration<float, std::milli>(now - last_receive_time_).count();
+        if (interval_ms <= frame_duration_ms * NETWORK_STATS_MAX_JITTER_FRAMES) {
+            float deviation = std::fabs(interval_ms - frame_duration_ms);
+            jitter_ms_ += (deviation - jitter_ms_) / 16;
+        }
+    }
+    receiving_ = true;
+    last_receive_time_ = now;
+    downlink_packets_++;
+    downlink_bytes_ += bytes;
+
+    if (waiting_first_audio_) {
+        waiting_first_audio_ = false;
+        first_audio_.Add(std::chrono::duration_cast<std::chrono::milliseconds>(now - turn_end_time_).count());
+    }
+}
+
+void NetworkStatistics::OnSequence(uint32_t sequence, uint32_t expected) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sequence < expected) {
+        late_packets_++;
+    } else if (sequence > expected) {
+        lost_packets_ += sequence - expected;
+    }
+}
+
+void NetworkStatistics::OnTurnEnd() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    turn_end_time_ = Clock::now();
+    turn_pending_ = true;
+    waiting_first_audio_ = true;
+}
+
+void NetworkStatistics::OnSpeechRecognized() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // In auto / realtime mode the server decides the end of the turn
+    if (!turn_pending_) {
+        turn_end_time_ = Clock::now();
+        turn_pending_ = true;
+        waiting_first_audio_ = true;
+    }
+}
+
+void NetworkStatistics::OnTtsStart() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    receiving_ = false;
+    if (!turn_pending_) {
+        return;
+    }
+    turn_pending_ = false;
+    int rtt_ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - turn_end_time_).count();
+    server_rtt_.Add(rtt_ms);
+    ESP_LOGI(TAG, "Server RTT: %d ms", rtt_ms);
+}
+
+cJSON* NetworkStatistics::ToJsonObject() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - session_start_time_).count();
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "duration_ms", duration_ms);
+
+    cJSON* uplink = cJSON_CreateObject();
+    cJSON_AddNumberToObject(uplink, "packets", uplink_packets_);
+    cJSON_AddNumberToObject(uplink, "bytes", uplink_bytes_);
+    cJSON_AddNumberToObject(uplink, "kbps", duration_ms > 0 ? uplink_bytes_ * 8 / duration_ms : 0);
+    cJSON_AddItemToObject(root, "uplink", uplink);
+
+    cJSON* downlink = cJSON_CreateObject();
+    cJSON_AddNumberToObject(downlink, "packets", downlink_packets_);
+    cJSON_AddNumberToObject(downlink, "bytes", downlink_bytes_);
+    cJSON_AddNumberToObject(downlink, "kbps", duration_ms > 0 ? downlink_bytes_ * 8 / duration_ms : 0);
+    cJSON_AddNumberToObject(downlink, "lost", lost_packets_);
+    cJSON_AddNumberToObject(downlink, "late", late_packets_);
+    cJSON_AddNumberToObject(downlink, "jitter_ms", (int)jitter_ms_);
+    cJSON_AddItemToObject(root, "downlink", downlink);
+
+    cJSON* buckets = cJSON_CreateArray();
+    for (auto bucket : kLatencyBuckets) {
+        cJSON_AddItemToArray(buckets, cJSON_CreateNumber(bucket));
+    }
+    cJSON_AddItemToObject(root, "latency_buckets_ms", buckets);
+    cJSON_AddItemToObject(root, "server_rtt_ms", server_rtt_.ToJson());
+    cJSON_AddItemToObject(root, "first_audio_ms", first_audio_.ToJson());
+    return root;
+}
+
+std::string NetworkStatistics::ToJson() {
+    cJSON* root = ToJsonObject();
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
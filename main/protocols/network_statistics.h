@@ -0,0 +1,77 @@
+#ifndef NETWORK_STATISTICS_H
+#define NETWORK_STATISTICS_H
+
+#include <cJSON.h>
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Upper bounds (ms) of the latency histogram buckets, the last bucket is open-ended
+#define NETWORK_STATS_LATENCY_BUCKETS { 100, 200, 400, 800, 1600, 3200 }
+#define NETWORK_STATS_NUM_LATENCY_BUCKETS 7
+// Longer arrival intervals, in frame durations, are pauses of the server and not jitter
+#define NETWORK_STATS_MAX_JITTER_FRAMES 4
+
+class LatencyHistogram {
+public:
+    void Add(int latency_ms);
+    cJSON* ToJson() const;
+
+private:
+    std::array<uint32_t, NETWORK_STATS_NUM_LATENCY_BUCKETS> buckets_ = {};
+    uint32_t count_ = 0;
+    int64_t sum_ms_ = 0;
+    int last_ms_ = -1;
+    int max_ms_ = 0;
+};
+
+/*
+ * Per-session network quality telemetry, owned by Protocol.
+ *
+ * Server RTT is measured from the end of the user's turn (SendStopListening, or the
+ * `stt` result in auto / realtime mode) to the next `tts start`, time-to-first-audio
+ * from the same point to the first downlink audio packet. Latency histograms are
+ * cumulative since boot, everything else is reset when a new audio channel opens. The jitter only
+ * counts the intervals within a TTS stream.
+ */
+class NetworkStatistics {
+public:
+    void StartSession();
+    void OnAudioSent(size_t bytes);
+    void OnAudioReceived(size_t bytes, int frame_duration_ms);
+    void OnSequence(uint32_t sequence, uint32_t expected);
+    void OnTurnEnd();
+    void OnSpeechRecognized();
+    void OnTtsStart();
+
+    bool HasSession() const { return session_count_ > 0; }
+    std::string ToJson();
+    cJSON* ToJsonObject();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::mutex mutex_;
+    Clock::time_point session_start_time_ = Clock::now();
+    Clock::time_point turn_end_time_;
+    Clock::time_point last_receive_time_;
+    // False until the first packet of a TTS stream, the gaps between streams are not jitter
+    bool receiving_ = false;
+    bool turn_pending_ = false;
+    bool waiting_first_audio_ = false;
+    uint32_t session_count_ = 0;
+
+    uint32_t uplink_packets_ = 0;
+    uint64_t uplink_bytes_ = 0;
+    uint32_t downlink_packets_ = 0;
+    uint64_t downlink_bytes_ = 0;
+    uint32_t lost_packets_ = 0;
+    uint32_t late_packets_ = 0;
+    float jitter_ms_ = 0;
+
+    LatencyHistogram server_rtt_;
+    LatencyHistogram first_audio_;
+};
+
+#endif // NETWORK_STATISTICS_H
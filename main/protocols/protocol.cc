@@ -1,6 +1,8 @@
 #include "protocol.h"
+#include "cbor_codec.h"
 
 #include <esp_log.h>
+#include <cstring>
 
 #define TAG "Protocol"
 
@@ -31,19 +33,60 @@ void Protocol::SetError(const std::string& message) {
     }
 }
 
+// Control and MCP messages are built as JSON, and sent as CBOR once the server accepted it in hello
+bool Protocol::SendMessage(const std::string& json) {
+#if CONFIG_USE_CBOR_MESSAGES
+    if (cbor_enabled_) {
+        std::string cbor;
+        if (JsonToCbor(json.data(), json.size(), cbor) && CanSendCbor(cbor.size())) {
+            return SendCbor(cbor);
+        }
+    }
+#endif
+    return SendText(json);
+}
+
+void Protocol::ParseServerFeatures(const cJSON* root) {
+    cbor_enabled_ = false;
+#if CONFIG_USE_CBOR_MESSAGES
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        cbor_enabled_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "cbor"));
+    }
+    ESP_LOGI(TAG, "CBOR messages: %s", cbor_enabled_ ? "enabled" : "disabled");
+#endif
+}
+
+void Protocol::HandleIncomingCbor(const uint8_t* data, size_t size) {
+    auto root = CborToJson(data, size);
+    if (root == nullptr) {
+        return;
+    }
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (cJSON_IsString(type)) {
+        UpdateStatistics(root);
+        if (on_incoming_json_ != nullptr) {
+            on_incoming_json_(root);
+        }
+    } else {
+        ESP_LOGE(TAG, "Missing message type in cbor message");
+    }
+    cJSON_Delete(root);
+}
+
 void Protocol::SendAbortSpeaking(AbortReason reason) {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"abort\"";
     if (reason == kAbortReasonWakeWordDetected) {
         message += ",\"reason\":\"wake_word_detected\"";
     }
     message += "}";
-    SendText(message);
+    SendMessage(message);
 }
 
 void Protocol::SendWakeWordDetected(const std::string& wake_word) {
     std::string json = "{\"session_id\":\"" + session_id_ + 
                       "\",\"type\":\"listen\",\"state\":\"detect\",\"text\":\"" + wake_word + "\"}";
-    SendText(json);
+    SendMessage(json);
 }
 
 void Protocol::SendStartListening(ListeningMode mode) {
@@ -57,17 +100,18 @@ void Protocol::SendStartListening(ListeningMode mode) {
         message += ",\"mode\":\"manual\"";
     }
     message += "}";
-    SendText(message);
+    SendMessage(message);
 }
 
 void Protocol::SendStopListening() {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"listen\",\"state\":\"stop\"}";
-    SendText(message);
+    SendMessage(message);
+    network_stats_.OnTurnEnd();
 }
 
 void Protocol::SendMcpMessage(const std::string& payload) {
     std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"mcp\",\"payload\":" + payload + "}";
-    SendText(message);
+    SendMessage(message);
 }
 
 bool Protocol::IsTimeout() const {
@@ -80,3 +124,18 @@ bool Protocol::IsTimeout() const {
     }
     return timeout;
 }
+
+void Protocol::UpdateStatistics(const cJSON* root) {
+    auto type = cJSON_GetObjectItem(root, "type");
+    if (!cJSON_IsString(type)) {
+        return;
+    }
+    if (strcmp(type->valuestring, "stt") == 0) {
+        network_stats_.OnSpeechRecognized();
+    } else if (strcmp(type->valuestring, "tts") == 0) {
+        auto state = cJSON_GetObjectItem(root, "state");
+        if (cJSON_IsString(state) && strcmp(state->valuestring, "start") == 0) {
+            network_stats_.OnTtsStart();
+        }
+    }
+}
@@ -7,17 +7,25 @@
 #include <chrono>
 #include <vector>
 
+#include "network_statistics.h"
+
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t gap = 0;       // Number of packets dropped right before this one
     std::vector<uint8_t> payload;
 };
 
+// Binary message types of BinaryProtocol2 / BinaryProtocol3
+#define BINARY_PROTOCOL_TYPE_OPUS 0
+#define BINARY_PROTOCOL_TYPE_JSON 1
+#define BINARY_PROTOCOL_TYPE_CBOR 2
+
 struct BinaryProtocol2 {
     uint16_t version;
-    uint16_t type;          // Message type (0: OPUS, 1: JSON)
-    uint32_t reserved;      // Reserved for future use
+    uint16_t type;          // Message type (0: OPUS, 1: JSON, 2: CBOR)
+    uint32_t reserved;      // Uplink OPUS: the packets dropped right before this one, otherwise 0
     uint32_t timestamp;     // Timestamp in milliseconds (used for server-side AEC)
     uint32_t payload_size;  // Payload size in bytes
     uint8_t payload[];      // Payload data
@@ -25,7 +33,7 @@ struct BinaryProtocol2 {
 
 struct BinaryProtocol3 {
     uint8_t type;
-    uint8_t reserved;
+    uint8_t reserved;       // Uplink OPUS: the packets dropped right before this one (at most 255), otherwise 0
     uint16_t payload_size;
     uint8_t payload[];
 } __attribute__((packed));
@@ -54,6 +62,9 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    inline NetworkStatistics& network_stats() {
+        return network_stats_;
+    }
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
@@ -82,12 +93,21 @@ protected:
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
     bool error_occurred_ = false;
+    bool cbor_enabled_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
+    NetworkStatistics network_stats_;
 
     virtual bool SendText(const std::string& text) = 0;
+    virtual bool SendCbor(const std::string& data) { return false; }
+    // Whether a CBOR message of this size fits in one frame, the larger messages are sent as JSON text
+    virtual bool CanSendCbor(size_t size) const { return true; }
+    bool SendMessage(const std::string& json);
+    void ParseServerFeatures(const cJSON* root);
+    void HandleIncomingCbor(const uint8_t* data, size_t size);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
+    void UpdateStatistics(const cJSON* root);
 };
 
 #endif // PROTOCOL_H
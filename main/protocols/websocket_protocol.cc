@@ -3,8 +3,10 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "heap_profiler.h"
 
 #include <cstring>
+#include <algorithm>
 #include <cJSON.h>
 #include <esp_log.h>
 #include <arpa/inet.h>
@@ -26,6 +28,7 @@ bool WebsocketProtocol::Start() {
 }
 
 bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
@@ -36,28 +39,78 @@ bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
         auto bp2 = (BinaryProtocol2*)serialized.data();
         bp2->version = htons(version_);
         bp2->type = 0;
-        bp2->reserved = 0;
+        // The server can see the packets dropped by the send queue
+        bp2->reserved = htonl(packet->gap);
         bp2->timestamp = htonl(packet->timestamp);
         bp2->payload_size = htonl(packet->payload.size());
         memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        if (!websocket_->Send(serialized.data(), serialized.size(), true)) {
+            return false;
+        }
     } else if (version_ == 3) {
         std::string serialized;
         serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
         auto bp3 = (BinaryProtocol3*)serialized.data();
         bp3->type = 0;
-        bp3->reserved = 0;
+        bp3->reserved = std::min<uint32_t>(packet->gap, UINT8_MAX);
         bp3->payload_size = htons(packet->payload.size());
         memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        if (!websocket_->Send(serialized.data(), serialized.size(), true)) {
+            return false;
+        }
+    } else {
+        if (!websocket_->Send(packet->payload.data(), packet->payload.size(), true)) {
+            return false;
+        }
+    }
+    network_stats_.OnAudioSent(packet->payload.size());
+    return true;
+}
+
+// CBOR messages ride in the binary frames with type BINARY_PROTOCOL_TYPE_CBOR, only for protocol v2 / v3
+bool WebsocketProtocol::CanSendCbor(size_t size) const {
+    return version_ == 2 || (version_ == 3 && size <= UINT16_MAX);
+}
+
+bool WebsocketProtocol::SendCbor(const std::string& data) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
+    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+        return false;
+    }
+
+    std::string serialized;
+    if (version_ == 2) {
+        serialized.resize(sizeof(BinaryProtocol2) + data.size());
+        auto bp2 = (BinaryProtocol2*)serialized.data();
+        bp2->version = htons(version_);
+        bp2->type = htons(BINARY_PROTOCOL_TYPE_CBOR);
+        bp2->reserved = 0;
+        bp2->timestamp = 0;
+        bp2->payload_size = htonl(data.size());
+        memcpy(bp2->payload, data.data(), data.size());
+    } else if (version_ == 3 && data.size() <= UINT16_MAX) {
+        serialized.resize(sizeof(BinaryProtocol3) + data.size());
+        auto bp3 = (BinaryProtocol3*)serialized.data();
+        bp3->type = BINARY_PROTOCOL_TYPE_CBOR;
+        bp3->reserved = 0;
+        bp3->payload_size = htons(data.size());
+        memcpy(bp3->payload, data.data(), data.size());
     } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+        return false;
+    }
+
+    if (!websocket_->Send(serialized.data(), serialized.size(), true)) {
+        ESP_LOGE(TAG, "Failed to send cbor message");
+        SetError(Lang::Strings::SERVER_ERROR);
+        return false;
     }
+    return true;
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
@@ -80,6 +133,7 @@ void WebsocketProtocol::CloseAudioChannel() {
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
+    HeapTagScope heap_tag(kHeapTagProtocol);
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -109,15 +163,30 @@ bool WebsocketProtocol::OpenAudioChannel() {
     websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
     websocket_->OnData([this](const char* data, size_t len, bool binary) {
+        HeapTagScope heap_tag(kHeapTagProtocol);
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
                 if (version_ == 2) {
+                    if (len < sizeof(BinaryProtocol2)) {
+                        ESP_LOGE(TAG, "Binary frame too short: %u", len);
+                        return;
+                    }
                     BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
                     bp2->version = ntohs(bp2->version);
                     bp2->type = ntohs(bp2->type);
                     bp2->timestamp = ntohl(bp2->timestamp);
                     bp2->payload_size = ntohl(bp2->payload_size);
+                    if (bp2->payload_size > len - sizeof(BinaryProtocol2)) {
+                        ESP_LOGE(TAG, "Invalid payload size: %lu, frame size: %u", (unsigned long)bp2->payload_size, len);
+                        return;
+                    }
                     auto payload = (uint8_t*)bp2->payload;
+                    if (bp2->type == BINARY_PROTOCOL_TYPE_CBOR) {
+                        HandleIncomingCbor(payload, bp2->payload_size);
+                        last_incoming_time_ = std::chrono::steady_clock::now();
+                        return;
+                    }
+                    network_stats_.OnAudioReceived(bp2->payload_size, server_frame_duration_);
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
@@ -125,10 +194,24 @@ bool WebsocketProtocol::OpenAudioChannel() {
                         .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
                     }));
                 } else if (version_ == 3) {
+                    if (len < sizeof(BinaryProtocol3)) {
+                        ESP_LOGE(TAG, "Binary frame too short: %u", len);
+                        return;
+                    }
                     BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
                     bp3->type = bp3->type;
                     bp3->payload_size = ntohs(bp3->payload_size);
+                    if (bp3->payload_size > len - sizeof(BinaryProtocol3)) {
+                        ESP_LOGE(TAG, "Invalid payload size: %u, frame size: %u", bp3->payload_size, len);
+                        return;
+                    }
                     auto payload = (uint8_t*)bp3->payload;
+                    if (bp3->type == BINARY_PROTOCOL_TYPE_CBOR) {
+                        HandleIncomingCbor(payload, bp3->payload_size);
+                        last_incoming_time_ = std::chrono::steady_clock::now();
+                        return;
+                    }
+                    network_stats_.OnAudioReceived(bp3->payload_size, server_frame_duration_);
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
@@ -136,6 +219,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
                         .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
                     }));
                 } else {
+                    network_stats_.OnAudioReceived(len, server_frame_duration_);
                     on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
                         .sample_rate = server_sample_rate_,
                         .frame_duration = server_frame_duration_,
@@ -152,6 +236,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
                 if (strcmp(type->valuestring, "hello") == 0) {
                     ParseServerHello(root);
                 } else {
+                    UpdateStatistics(root);
                     if (on_incoming_json_ != nullptr) {
                         on_incoming_json_(root);
                     }
@@ -192,6 +277,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
         return false;
     }
 
+    network_stats_.StartSession();
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
     }
@@ -209,6 +295,11 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_USE_CBOR_MESSAGES
+    if (version_ >= 2) {
+        cJSON_AddBoolToObject(features, "cbor", true);
+    }
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
@@ -217,6 +308,9 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddNumberToObject(audio_params, "channels", 1);
     cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
+    if (network_stats_.HasSession()) {
+        cJSON_AddItemToObject(root, "last_session_stats", network_stats_.ToJsonObject());
+    }
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
     cJSON_free(json_str);
@@ -231,6 +325,8 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         return;
     }
 
+    ParseServerFeatures(root);
+
     auto session_id = cJSON_GetObjectItem(root, "session_id");
     if (cJSON_IsString(session_id)) {
         session_id_ = session_id->valuestring;
@@ -28,6 +28,8 @@ private:
 
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
+    bool SendCbor(const std::string& data) override;
+    bool CanSendCbor(size_t size) const override;
     std::string GetHelloMessage();
 };
 
@@ -88,6 +88,30 @@ void Settings::SetBool(const std::string& key, bool value) {
     }
 }
 
+bool Settings::GetBlob(const std::string& key, std::vector<uint8_t>& value) {
+    if (nvs_handle_ == 0) {
+        return false;
+    }
+
+    size_t length = 0;
+    if (nvs_get_blob(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
+        return false;
+    }
+
+    value.resize(length);
+    ESP_ERROR_CHECK(nvs_get_blob(nvs_handle_, key.c_str(), value.data(), &length));
+    return true;
+}
+
+void Settings::SetBlob(const std::string& key, const std::vector<uint8_t>& value) {
+    if (read_write_) {
+        ESP_ERROR_CHECK(nvs_set_blob(nvs_handle_, key.c_str(), value.data(), value.size()));
+        dirty_ = true;
+    } else {
+        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    }
+}
+
 void Settings::EraseKey(const std::string& key) {
     if (read_write_) {
         auto ret = nvs_erase_key(nvs_handle_, key.c_str());
@@ -0,0 +1,139 @@
+#include "task_monitor.h"
+#include "trace_buffer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#define TAG "TaskMonitor"
+
+TaskUsage* TaskMonitor::FindTask(TaskHandle_t handle) {
+    for (auto& task : tasks_) {
+        if (task.alive && task.handle == handle) {
+            return &task;
+        }
+    }
+    return nullptr;
+}
+
+void TaskMonitor::Sample() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    configRUN_TIME_COUNTER_TYPE total_run_time;
+    UBaseType_t count = uxTaskGetSystemState(status_, TASK_MONITOR_MAX_TASKS, &total_run_time);
+    if (count == 0) {
+        if (!overflow_warned_) {
+            ESP_LOGW(TAG, "More than %d tasks, increase TASK_MONITOR_MAX_TASKS", TASK_MONITOR_MAX_TASKS);
+            overflow_warned_ = true;
+        }
+        return;
+    }
+
+    sample_count_++;
+    int slot = sample_count_ % (TASK_MONITOR_WINDOW + 1);
+    total_run_time_[slot] = total_run_time;
+
+    bool seen[TASK_MONITOR_MAX_TASKS] = {};
+    for (UBaseType_t i = 0; i < count; i++) {
+        auto& status = status_[i];
+        auto task = FindTask(status.xHandle);
+        if (task == nullptr) {
+            // A new task takes the slot of a task that was gone in the last sample
+            for (int j = 0; j < TASK_MONITOR_MAX_TASKS; j++) {
+                if (!tasks_[j].alive && !seen[j]) {
+                    task = &tasks_[j];
+                    break;
+                }
+            }
+            if (task == nullptr) {
+                continue;
+            }
+            task->handle = status.xHandle;
+            strncpy(task->name, status.pcTaskName, sizeof(task->name) - 1);
+            task->first_sample = sample_count_;
+            task->stack_warned = false;
+            task->alive = true;
+        }
+        seen[task - tasks_] = true;
+        task->priority = status.uxCurrentPriority;
+        task->run_time[slot] = status.ulRunTimeCounter;
+        // The stack is counted in bytes on ESP-IDF
+        task->stack_high_water_mark = status.usStackHighWaterMark;
+        if (task->stack_high_water_mark < TASK_MONITOR_STACK_WARNING_BYTES && !task->stack_warned) {
+            task->stack_warned = true;
+            ESP_LOGW(TAG, "Task %s is close to a stack overflow, only %lu bytes were never used", task->name,
+                (unsigned long)task->stack_high_water_mark);
+            // The name stays valid until the slot is taken by another task
+            TRACE_INSTANT(task->name, task->stack_high_water_mark);
+        }
+    }
+    for (int j = 0; j < TASK_MONITOR_MAX_TASKS; j++) {
+        if (!seen[j]) {
+            tasks_[j].alive = false;
+        }
+    }
+
+#if CONFIG_USE_TRACE_BUFFER
+    static const char* load_names[] = { "cpu0_load", "cpu1_load" };
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES && core < 2; core++) {
+        auto idle = FindTask(xTaskGetIdleTaskHandleForCore(core));
+        if (idle != nullptr) {
+            // The idle task usage is in tenths of a percent of all the cores
+            int load = 1000 - (int)GetCpuUsage(*idle, 1) * CONFIG_FREERTOS_NUMBER_OF_CORES;
+            TRACE_COUNTER(load_names[core], std::max(load, 0) / 10);
+        }
+    }
+#endif
+}
+
+uint32_t TaskMonitor::GetCpuUsage(const TaskUsage& task, uint32_t samples) const {
+    samples = std::min<uint32_t>({ samples, sample_count_ - task.first_sample, TASK_MONITOR_WINDOW });
+    if (samples == 0) {
+        return 0;
+    }
+    int now = sample_count_ % (TASK_MONITOR_WINDOW + 1);
+    int then = (sample_count_ - samples) % (TASK_MONITOR_WINDOW + 1);
+    uint32_t elapsed = total_run_time_[now] - total_run_time_[then];
+    uint32_t used = task.run_time[now] - task.run_time[then];
+    if (elapsed == 0) {
+        return 0;
+    }
+    return (uint64_t)used * 1000 / ((uint64_t)elapsed * CONFIG_FREERTOS_NUMBER_OF_CORES);
+}
+
+std::string TaskMonitor::GetStatisticsJson() {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    struct Row {
+        const TaskUsage* task;
+        uint32_t cpu;
+        uint32_t cpu_window;
+    };
+    Row rows[TASK_MONITOR_MAX_TASKS];
+    int count = 0;
+    for (auto& task : tasks_) {
+        if (task.alive) {
+            rows[count++] = { &task, GetCpuUsage(task, 1), GetCpuUsage(task, TASK_MONITOR_WINDOW) };
+        }
+    }
+    std::sort(rows, rows + count, [](const Row& a, const Row& b) { return a.cpu_window > b.cpu_window; });
+
+    // newlib nano printf has no float formats, the percentages are printed from tenths
+    char buffer[192];
+    snprintf(buffer, sizeof(buffer), "{\"window_s\":%d,\"stack_warning_bytes\":%d,\"tasks\":[",
+        TASK_MONITOR_WINDOW, TASK_MONITOR_STACK_WARNING_BYTES);
+    std::string json = buffer;
+    for (int i = 0; i < count; i++) {
+        auto& row = rows[i];
+        snprintf(buffer, sizeof(buffer), "%s{\"name\":\"%s\",\"priority\":%u,\"cpu\":%lu.%lu,\"cpu_window\":%lu.%lu,"
+            "\"stack_free\":%lu,\"stack_low\":%s}", i == 0 ? "" : ",", row.task->name, (unsigned)row.task->priority,
+            (unsigned long)(row.cpu / 10), (unsigned long)(row.cpu % 10),
+            (unsigned long)(row.cpu_window / 10), (unsigned long)(row.cpu_window % 10),
+            (unsigned long)row.task->stack_high_water_mark,
+            row.task->stack_high_water_mark < TASK_MONITOR_STACK_WARNING_BYTES ? "true" : "false");
+        json += buffer;
+    }
+    json += "]}";
+    return json;
+}
@@ -0,0 +1,62 @@
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/*
+ * Per-task CPU usage and stack watermark monitor
+ *
+ * Sample() takes a snapshot of the FreeRTOS run time counters into preallocated arrays, it doesn't block
+ * or allocate, so it runs every second from the clock timer. The CPU usage is computed over the last
+ * sample and over a sliding window of TASK_MONITOR_WINDOW samples.
+ */
+#define TASK_MONITOR_MAX_TASKS 40
+#define TASK_MONITOR_WINDOW 10
+// Warn when the free stack of a task has ever dropped below this
+#define TASK_MONITOR_STACK_WARNING_BYTES 512
+
+struct TaskUsage {
+    TaskHandle_t handle = nullptr;
+    char name[configMAX_TASK_NAME_LEN] = {};
+    UBaseType_t priority = 0;
+    uint32_t stack_high_water_mark = 0;     // Bytes
+    uint32_t first_sample = 0;
+    uint32_t run_time[TASK_MONITOR_WINDOW + 1] = {};   // Run time counters of the last samples
+    bool alive = false;
+    bool stack_warned = false;
+};
+
+class TaskMonitor {
+public:
+    static TaskMonitor& GetInstance() {
+        static TaskMonitor instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TaskMonitor(const TaskMonitor&) = delete;
+    TaskMonitor& operator=(const TaskMonitor&) = delete;
+
+    void Sample();
+    std::string GetStatisticsJson();
+
+private:
+    TaskMonitor() = default;
+
+    std::mutex mutex_;
+    TaskStatus_t status_[TASK_MONITOR_MAX_TASKS];
+    TaskUsage tasks_[TASK_MONITOR_MAX_TASKS];
+    uint32_t total_run_time_[TASK_MONITOR_WINDOW + 1] = {};
+    uint32_t sample_count_ = 0;
+    bool overflow_warned_ = false;
+
+    TaskUsage* FindTask(TaskHandle_t handle);
+    // CPU usage of a task over the last samples, in tenths of a percent of all the cores
+    uint32_t GetCpuUsage(const TaskUsage& task, uint32_t samples) const;
+};
+
+#endif // TASK_MONITOR_H
@@ -0,0 +1,155 @@
+#include "task_queue.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+#define TAG "TaskQueue"
+
+// Log the tasks that block the main event loop for longer than this
+#define SLOW_TASK_THRESHOLD_US 50000
+
+void TaskQueue::Push(TaskNode* node) {
+    node->next.store(nullptr, std::memory_order_relaxed);
+    auto prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+TaskNode* TaskQueue::Pop() {
+    auto tail = tail_;
+    auto next = tail->next.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+        if (next == nullptr) {
+            return nullptr;
+        }
+        tail_ = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+    if (tail != head_.load(std::memory_order_acquire)) {
+        // A producer has swapped the head but not linked the node yet
+        return nullptr;
+    }
+    // tail is the last node, put the stub behind it so that it can be taken out
+    Push(&stub_);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next != nullptr) {
+        tail_ = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+TaskScheduler::TaskScheduler() {
+    for (auto& node : node_pool_) {
+        node.pooled = true;
+        node.next_free = free_nodes_;
+        free_nodes_ = &node;
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    for (auto& queue : queues_) {
+        while (auto node = queue.Pop()) {
+            FreeNode(node);
+        }
+    }
+}
+
+TaskNode* TaskScheduler::AllocateNode() {
+    taskENTER_CRITICAL(&lock_);
+    auto node = free_nodes_;
+    if (node != nullptr) {
+        free_nodes_ = node->next_free;
+    }
+    taskEXIT_CRITICAL(&lock_);
+    if (node == nullptr) {
+        // More tasks are pending than the pool holds
+        node = new TaskNode();
+    }
+    return node;
+}
+
+void TaskScheduler::FreeNode(TaskNode* node) {
+    if (!node->pooled) {
+        delete node;
+        return;
+    }
+    // Release the captures now rather than when the node is reused
+    node->task.Reset();
+    taskENTER_CRITICAL(&lock_);
+    node->next_free = free_nodes_;
+    free_nodes_ = node;
+    taskEXIT_CRITICAL(&lock_);
+}
+
+void TaskScheduler::Enqueue(TaskPriority priority, TaskNode* node) {
+    node->queued_time = esp_timer_get_time();
+    queues_[priority].Push(node);
+}
+
+bool TaskScheduler::RunOne(TaskPriority lowest_priority) {
+    for (int i = kTaskPriorityHigh; i <= lowest_priority; i++) {
+        auto node = queues_[i].Pop();
+        if (node == nullptr) {
+            continue;
+        }
+
+        int64_t start_time = esp_timer_get_time();
+        node->task();
+        int64_t end_time = esp_timer_get_time();
+
+        int64_t queue_delay = start_time - node->queued_time;
+        int64_t run_time = end_time - start_time;
+        taskENTER_CRITICAL(&lock_);
+        auto& stats = statistics_[i];
+        stats.count++;
+        stats.total_queue_delay += queue_delay;
+        stats.total_run_time += run_time;
+        if (queue_delay > stats.max_queue_delay) {
+            stats.max_queue_delay = queue_delay;
+        }
+        if (run_time > stats.max_run_time) {
+            stats.max_run_time = run_time;
+            stats.slowest_task = node->task.address();
+        }
+        taskEXIT_CRITICAL(&lock_);
+        if (run_time > SLOW_TASK_THRESHOLD_US) {
+            ESP_LOGW(TAG, "Slow task %p (priority %d): queued %ld ms, run %ld ms", node->task.address(), i,
+                (long)(queue_delay / 1000), (long)(run_time / 1000));
+        }
+        FreeNode(node);
+        return true;
+    }
+    return false;
+}
+
+std::string TaskScheduler::GetStatisticsJson() const {
+    static const char* names[] = { "high", "normal", "low" };
+    // The statistics are updated by the main event loop, format a consistent copy
+    TaskStatistics statistics[kTaskPriorityCount];
+    taskENTER_CRITICAL(&lock_);
+    std::copy(std::begin(statistics_), std::end(statistics_), statistics);
+    taskEXIT_CRITICAL(&lock_);
+
+    std::string json = "{";
+    for (int i = 0; i < kTaskPriorityCount; i++) {
+        auto& stats = statistics[i];
+        char buffer[192];
+        // newlib nano printf has no 64-bit formats, the delays fit in a long
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"count\":%lu,\"avg_queue_delay_us\":%ld,\"max_queue_delay_us\":%ld,"
+            "\"avg_run_time_us\":%ld,\"max_run_time_us\":%ld,\"slowest_task\":\"%p\"}",
+            i == 0 ? "" : ",", names[i], (unsigned long)stats.count,
+            (long)(stats.count ? stats.total_queue_delay / stats.count : 0), (long)stats.max_queue_delay,
+            (long)(stats.count ? stats.total_run_time / stats.count : 0), (long)stats.max_run_time, stats.slowest_task);
+        json += buffer;
+    }
+    json += "}";
+    return json;
+}
@@ -0,0 +1,143 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <freertos/FreeRTOS.h>
+
+/*
+ * Task queue of the main event loop
+ *
+ * Producers (any task) push with a single atomic exchange, the main event loop is the only consumer
+ * (Vyukov's intrusive MPSC queue). The callables are stored inline in the queue node, captures up to
+ * INLINE_TASK_SIZE bytes don't need a separate allocation. The nodes come from a preallocated pool,
+ * the heap is only used when more than TASK_NODE_POOL_SIZE tasks are pending.
+ *
+ * The tasks of the same priority run in the order they are pushed, but a task may overtake the tasks of
+ * a lower priority pushed before it. The low priority display updates (stt, llm emotion, tts sentences,
+ * custom messages) can run after a later normal priority state change, and the high priority tasks
+ * (abort, MCP replies) run before everything else that is pending. Tasks that depend on each other
+ * must be pushed with the same priority.
+ */
+#define INLINE_TASK_SIZE 48
+#define TASK_NODE_POOL_SIZE 32
+
+enum TaskPriority {
+    kTaskPriorityHigh,      // Abort, MCP replies and other control messages, also run between the audio packets
+    kTaskPriorityNormal,    // State changes and protocol work
+    kTaskPriorityLow,       // Display updates
+    kTaskPriorityCount
+};
+
+class InlineTask {
+public:
+    InlineTask() = default;
+    InlineTask(const InlineTask&) = delete;
+    InlineTask& operator=(const InlineTask&) = delete;
+    ~InlineTask() { Reset(); }
+
+    void Reset() {
+        if (destroy_ != nullptr) {
+            destroy_(storage_);
+            destroy_ = nullptr;
+            invoke_ = nullptr;
+        }
+    }
+
+    template<typename F>
+    void Emplace(F&& callable) {
+        using T = std::decay_t<F>;
+        Reset();
+        if constexpr (sizeof(T) <= INLINE_TASK_SIZE && alignof(T) <= alignof(std::max_align_t)) {
+            new (storage_) T(std::forward<F>(callable));
+            invoke_ = [](void* storage) { (*static_cast<T*>(storage))(); };
+            destroy_ = [](void* storage) { static_cast<T*>(storage)->~T(); };
+        } else {
+            new (storage_) T*(new T(std::forward<F>(callable)));
+            invoke_ = [](void* storage) { (**static_cast<T**>(storage))(); };
+            destroy_ = [](void* storage) { delete *static_cast<T**>(storage); };
+        }
+    }
+
+    void operator()() { invoke_(storage_); }
+
+    // The invoke thunk is unique for every lambda type, resolve it with addr2line to find the slow task
+    void* address() const { return (void*)invoke_; }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[INLINE_TASK_SIZE];
+    void (*invoke_)(void*) = nullptr;
+    void (*destroy_)(void*) = nullptr;
+};
+
+struct TaskNode {
+    std::atomic<TaskNode*> next = nullptr;
+    TaskNode* next_free = nullptr;  // Link of the pool free list
+    int64_t queued_time = 0;
+    bool pooled = false;
+    InlineTask task;
+};
+
+// The queue doesn't own the nodes, they are returned to the TaskScheduler pool after running
+class TaskQueue {
+public:
+    TaskQueue() : head_(&stub_), tail_(&stub_) {}
+
+    // Wait-free, safe to call from any task
+    void Push(TaskNode* node);
+    // Consumer only, returns nullptr if the queue is empty or a producer is in the middle of a push,
+    // the producer signals the consumer again after the push completes
+    TaskNode* Pop();
+
+private:
+    std::atomic<TaskNode*> head_;
+    TaskNode* tail_;
+    TaskNode stub_;
+};
+
+struct TaskStatistics {
+    uint32_t count = 0;
+    int64_t total_queue_delay = 0;
+    int64_t max_queue_delay = 0;
+    int64_t total_run_time = 0;
+    int64_t max_run_time = 0;
+    void* slowest_task = nullptr;
+};
+
+class TaskScheduler {
+public:
+    TaskScheduler();
+    ~TaskScheduler();
+
+    template<typename F>
+    void Push(TaskPriority priority, F&& callable) {
+        auto node = AllocateNode();
+        node->task.Emplace(std::forward<F>(callable));
+        Enqueue(priority, node);
+    }
+
+    // Consumer only, run the most urgent task not below the given priority, returns false if there is none
+    bool RunOne(TaskPriority lowest_priority = kTaskPriorityLow);
+    // Safe to call from any task, the statistics are copied under the lock
+    std::string GetStatisticsJson() const;
+
+private:
+    TaskQueue queues_[kTaskPriorityCount];
+    TaskNode node_pool_[TASK_NODE_POOL_SIZE];
+    // lock_ guards the free list and the statistics, it is only held for a few instructions
+    mutable portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+    TaskNode* free_nodes_ = nullptr;
+    TaskStatistics statistics_[kTaskPriorityCount];
+
+    TaskNode* AllocateNode();
+    void FreeNode(TaskNode* node);
+    void Enqueue(TaskPriority priority, TaskNode* node);
+};
+
+#endif // TASK_QUEUE_H
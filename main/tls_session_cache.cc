@@ -0,0 +1,253 @@
+#include "tls_session_cache.h"
+
+#if CONFIG_USE_TLS_SESSION_CACHE
+#include "settings.h"
+
+#include <esp_log.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mbedtls/ssl.h>
+
+#define TAG "TlsSessionCache"
+
+static TlsSession MakeSession(esp_tls_client_session_t* session) {
+    return TlsSession(session, esp_tls_free_client_session);
+}
+
+#if TLS_SESSION_CACHE_CAN_PERSIST
+// esp_tls_client_session_t is opaque in esp_tls.h, this is its definition in esp-tls (esp_tls_private.h)
+// of the versions TLS_SESSION_CACHE_CAN_PERSIST allows. Only the NVS persistence touches it.
+struct esp_tls_client_session {
+    mbedtls_ssl_session saved_session;
+};
+
+static std::vector<uint8_t> SerializeSession(esp_tls_client_session_t* session) {
+    size_t length = 0;
+    mbedtls_ssl_session_save(&session->saved_session, nullptr, 0, &length);
+    std::vector<uint8_t> data(length);
+    int ret = mbedtls_ssl_session_save(&session->saved_session, data.data(), data.size(), &length);
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Failed to serialize session, ret: -0x%x", -ret);
+        return {};
+    }
+    data.resize(length);
+    return data;
+}
+
+static TlsSession DeserializeSession(const std::vector<uint8_t>& data) {
+    // Freed by esp_tls_free_client_session() like the sessions of esp_tls_get_client_session()
+    auto session = (esp_tls_client_session_t*)calloc(1, sizeof(esp_tls_client_session_t));
+    if (session == nullptr) {
+        return nullptr;
+    }
+    mbedtls_ssl_session_init(&session->saved_session);
+    int ret = mbedtls_ssl_session_load(&session->saved_session, data.data(), data.size());
+    if (ret != 0) {
+        ESP_LOGW(TAG, "Failed to load session, ret: -0x%x", -ret);
+        esp_tls_free_client_session(session);
+        return nullptr;
+    }
+    return MakeSession(session);
+}
+#endif
+
+TlsSession TlsSessionCache::Restore(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadFromSettings();
+
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&host](const Entry& e) { return e.host == host; });
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+
+    if (time(NULL) - it->saved_time > TLS_SESSION_CACHE_LIFETIME_SECONDS) {
+        ESP_LOGI(TAG, "Session for %s expired", host.c_str());
+        EraseFromSettings(it->slot);
+        entries_.erase(it);
+        return nullptr;
+    }
+
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    if (it->session == nullptr) {
+        it->session = DeserializeSession(it->data);
+    }
+#endif
+    if (it->session == nullptr) {
+        EraseFromSettings(it->slot);
+        entries_.erase(it);
+        return nullptr;
+    }
+
+    // Move to the front of the list
+    entries_.splice(entries_.begin(), entries_, it);
+    ESP_LOGI(TAG, "Restored session for %s", host.c_str());
+    return it->session;
+}
+
+void TlsSessionCache::Save(const std::string& host, esp_tls_t* tls) {
+    auto ssl = (mbedtls_ssl_context*)esp_tls_get_ssl_context(tls);
+    if (ssl == nullptr) {
+        return;
+    }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    // The TLS 1.3 ticket arrives after the handshake, the session has nothing to resume yet
+    if (mbedtls_ssl_get_version_number(ssl) == MBEDTLS_SSL_VERSION_TLS1_3) {
+        ESP_LOGD(TAG, "TLS 1.3 session for %s is not cached", host.c_str());
+        return;
+    }
+#endif
+    auto session = MakeSession(esp_tls_get_client_session(tls));
+    if (session == nullptr) {
+        return;
+    }
+    std::vector<uint8_t> data;
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    data = SerializeSession(session.get());
+#endif
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadFromSettings();
+
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&host](const Entry& e) { return e.host == host; });
+    if (it != entries_.end()) {
+        entries_.splice(entries_.begin(), entries_, it);
+    } else if (entries_.size() >= TLS_SESSION_CACHE_MAX_ENTRIES) {
+        // Reuse the slot of the least recently used entry
+        Entry evicted = std::move(entries_.back());
+        entries_.pop_back();
+        entries_.push_front(Entry{host, nullptr, {}, 0, evicted.slot});
+    } else {
+        entries_.push_front(Entry{host, nullptr, {}, 0, AllocateSlot()});
+    }
+
+    auto& entry = entries_.front();
+    // A resumed session serializes the same, it is not written to NVS again
+    bool changed = entry.data != data;
+    entry.session = std::move(session);
+    entry.data = std::move(data);
+    entry.saved_time = time(NULL);
+    if (changed) {
+        SaveToSettings(entry);
+    }
+}
+
+void TlsSessionCache::Invalidate(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    LoadFromSettings();
+
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&host](const Entry& e) { return e.host == host; });
+    if (it != entries_.end()) {
+        ESP_LOGI(TAG, "Invalidate session for %s", host.c_str());
+        EraseFromSettings(it->slot);
+        entries_.erase(it);
+    }
+}
+
+void TlsSessionCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    loaded_ = true;
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    Settings settings("tls_session", true);
+    settings.EraseAll();
+#endif
+}
+
+int TlsSessionCache::AllocateSlot() {
+    for (int slot = 0; slot < TLS_SESSION_CACHE_MAX_ENTRIES; slot++) {
+        if (std::none_of(entries_.begin(), entries_.end(), [slot](const Entry& e) { return e.slot == slot; })) {
+            return slot;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Persisted entry format (key "s<slot>" in namespace "tls_session"):
+ * |saved_time 4u|host_len 1u|host host_len|session ...|
+ */
+void TlsSessionCache::LoadFromSettings() {
+    if (loaded_) {
+        return;
+    }
+    loaded_ = true;
+
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    Settings settings("tls_session", false);
+    for (int slot = 0; slot < TLS_SESSION_CACHE_MAX_ENTRIES; slot++) {
+        std::vector<uint8_t> blob;
+        if (!settings.GetBlob("s" + std::to_string(slot), blob) || blob.size() < 5) {
+            continue;
+        }
+        uint32_t saved_time;
+        memcpy(&saved_time, blob.data(), sizeof(saved_time));
+        size_t host_len = blob[4];
+        if (blob.size() <= 5 + host_len) {
+            continue;
+        }
+        Entry entry;
+        entry.host.assign((const char*)&blob[5], host_len);
+        entry.data.assign(blob.begin() + 5 + host_len, blob.end());
+        entry.saved_time = saved_time;
+        entry.slot = slot;
+        entries_.push_back(std::move(entry));
+    }
+    ESP_LOGI(TAG, "Loaded %u sessions from NVS", entries_.size());
+#endif
+}
+
+void TlsSessionCache::SaveToSettings(const Entry& entry) {
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    if (entry.host.size() > 255) {
+        return;
+    }
+    if (entry.data.empty()) {
+        return;
+    }
+    std::vector<uint8_t> blob(5 + entry.host.size() + entry.data.size());
+    uint32_t saved_time = entry.saved_time;
+    memcpy(blob.data(), &saved_time, sizeof(saved_time));
+    blob[4] = entry.host.size();
+    memcpy(&blob[5], entry.host.data(), entry.host.size());
+    memcpy(&blob[5 + entry.host.size()], entry.data.data(), entry.data.size());
+
+    Settings settings("tls_session", true);
+    settings.SetBlob("s" + std::to_string(entry.slot), blob);
+#endif
+}
+
+void TlsSessionCache::EraseFromSettings(int slot) {
+#if TLS_SESSION_CACHE_CAN_PERSIST
+    Settings settings("tls_session", true);
+    settings.EraseKey("s" + std::to_string(slot));
+#endif
+}
+
+extern "C" int __real_esp_tls_conn_new_sync(const char* hostname, int hostlen, int port, const esp_tls_cfg_t* cfg,
+    esp_tls_t* tls);
+
+// Linked in place of esp_tls_conn_new_sync() with -Wl,--wrap, see main/CMakeLists.txt
+extern "C" int __wrap_esp_tls_conn_new_sync(const char* hostname, int hostlen, int port, const esp_tls_cfg_t* cfg,
+    esp_tls_t* tls) {
+    if (cfg == nullptr || cfg->client_session != nullptr) {
+        return __real_esp_tls_conn_new_sync(hostname, hostlen, port, cfg, tls);
+    }
+
+    auto& cache = TlsSessionCache::GetInstance();
+    std::string host = std::string(hostname, hostlen) + ":" + std::to_string(port);
+    // Held until the handshake is done, a concurrent Save() may replace the cached session meanwhile
+    auto session = cache.Restore(host);
+    esp_tls_cfg_t session_cfg = *cfg;
+    session_cfg.client_session = session.get();
+    int ret = __real_esp_tls_conn_new_sync(hostname, hostlen, port, &session_cfg, tls);
+    if (ret == 1) {
+        cache.Save(host, tls);
+    } else if (session != nullptr) {
+        // A stale session may be the cause, force a full handshake next time
+        cache.Invalidate(host);
+    }
+    return ret;
+}
+
+#endif // CONFIG_USE_TLS_SESSION_CACHE
@@ -0,0 +1,84 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ctime>
+
+#include <esp_tls.h>
+#include <esp_idf_version.h>
+
+#include "sdkconfig.h"
+
+#define TLS_SESSION_CACHE_MAX_ENTRIES 4
+#define TLS_SESSION_CACHE_LIFETIME_SECONDS (24 * 3600)
+
+// Saving a session to NVS needs the layout of the opaque esp_tls_client_session_t, which is only known
+// for the esp-tls versions it was checked against
+#if CONFIG_TLS_SESSION_CACHE_PERSIST && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 4, 0) && \
+    ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 6, 0)
+#define TLS_SESSION_CACHE_CAN_PERSIST 1
+#else
+#define TLS_SESSION_CACHE_CAN_PERSIST 0
+#endif
+
+/*
+ * Caches negotiated TLS sessions (session ID / session ticket) per host, so that
+ * reconnecting to the same server can do an abbreviated handshake.
+ *
+ * The TLS transports created through NetworkInterface (esp-ml307) connect with
+ * esp_tls_conn_new_sync(), which main/CMakeLists.txt wraps: the wrapper passes the
+ * restored session in esp_tls_cfg_t::client_session, saves the session with
+ * esp_tls_get_client_session() after a successful handshake and invalidates it after
+ * a failed one. The host key is "host:port".
+ *
+ * Sessions are kept in RAM, and persisted to NVS (CONFIG_TLS_SESSION_CACHE_PERSIST)
+ * when TLS_SESSION_CACHE_CAN_PERSIST. Only TLS 1.2 sessions are cached: a TLS 1.3
+ * server sends its ticket after the handshake, with the first application data, so
+ * there is nothing to resume when the wrapper returns.
+ */
+#if CONFIG_USE_TLS_SESSION_CACHE
+using TlsSession = std::shared_ptr<esp_tls_client_session_t>;
+
+class TlsSessionCache {
+public:
+    static TlsSessionCache& GetInstance() {
+        static TlsSessionCache instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    // The session for esp_tls_cfg_t::client_session, it stays valid while the caller holds it
+    TlsSession Restore(const std::string& host);
+    void Save(const std::string& host, esp_tls_t* tls);
+    void Invalidate(const std::string& host);
+    void Clear();
+
+private:
+    TlsSessionCache() = default;
+
+    struct Entry {
+        std::string host;
+        TlsSession session;         // nullptr until an entry loaded from NVS is restored
+        std::vector<uint8_t> data;  // The serialized session, only kept to persist it
+        time_t saved_time;
+        int slot;
+    };
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;  // Most recently used first
+    bool loaded_ = false;
+
+    void LoadFromSettings();
+    void SaveToSettings(const Entry& entry);
+    void EraseFromSettings(int slot);
+    int AllocateSlot();
+};
+#endif // CONFIG_USE_TLS_SESSION_CACHE
+
+#endif // TLS_SESSION_CACHE_H
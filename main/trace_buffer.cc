@@ -0,0 +1,87 @@
+#include "trace_buffer.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define TAG "TraceBuffer"
+
+void TraceBuffer::Record(TraceEventType type, const char* name, int32_t value) {
+    int core = xPortGetCoreID();
+    uint32_t index = write_index_[core].fetch_add(1, std::memory_order_relaxed);
+    auto& event = events_[core][index % CONFIG_TRACE_BUFFER_EVENTS];
+    event.timestamp = (uint32_t)esp_timer_get_time();
+    event.name = name;
+    event.task = xTaskGetCurrentTaskHandle();
+    event.value = value;
+    event.type = type;
+}
+
+std::string TraceBuffer::GetEventsJson(int max_events) const {
+    static const char* phases[] = { "B", "E", "i", "C" };
+
+    struct Snapshot {
+        TraceEvent event;
+        int64_t time;
+        int core;
+    };
+    std::vector<Snapshot> snapshots;
+    snapshots.reserve(portNUM_PROCESSORS * CONFIG_TRACE_BUFFER_EVENTS);
+    uint32_t dropped = 0;
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        uint32_t end = write_index_[core].load(std::memory_order_relaxed);
+        uint32_t count = std::min<uint32_t>(end, CONFIG_TRACE_BUFFER_EVENTS);
+        dropped += end - count;
+        for (uint32_t i = end - count; i != end; i++) {
+            snapshots.push_back({ events_[core][i % CONFIG_TRACE_BUFFER_EVENTS], 0, core });
+        }
+    }
+
+    // Recover the 64-bit time, all the events are at most one wrap older than now
+    int64_t now = esp_timer_get_time();
+    for (auto& snapshot : snapshots) {
+        snapshot.time = now - (uint32_t)((uint32_t)now - snapshot.event.timestamp);
+    }
+    std::stable_sort(snapshots.begin(), snapshots.end(), [](const Snapshot& a, const Snapshot& b) {
+        return a.time < b.time;
+    });
+    if (max_events > 0 && snapshots.size() > (size_t)max_events) {
+        dropped += snapshots.size() - max_events;
+        snapshots.erase(snapshots.begin(), snapshots.end() - max_events);
+    }
+
+    // Resolve the names of the tasks that are still alive
+    std::vector<TaskStatus_t> tasks(uxTaskGetNumberOfTasks() + 4);
+    tasks.resize(uxTaskGetSystemState(tasks.data(), tasks.size(), nullptr));
+
+    char buffer[128];
+    // newlib nano printf has no 64-bit formats, the times since boot go through std::to_string
+    std::string json = "{\"now_us\":" + std::to_string(now);
+    snprintf(buffer, sizeof(buffer), ",\"dropped\":%lu,\"tasks\":{", (unsigned long)dropped);
+    json += buffer;
+    json.reserve(snapshots.size() * 48 + tasks.size() * 32);
+    for (size_t i = 0; i < tasks.size(); i++) {
+        snprintf(buffer, sizeof(buffer), "%s\"%p\":\"%s\"", i == 0 ? "" : ",", tasks[i].xHandle, tasks[i].pcTaskName);
+        json += buffer;
+    }
+    json += "},\"events\":[";
+    bool first = true;
+    for (auto& snapshot : snapshots) {
+        auto& event = snapshot.event;
+        if (event.name == nullptr || event.type > kTraceEventCounter) {
+            continue;
+        }
+        json += first ? "[" : ",[";
+        json += std::to_string(snapshot.time);
+        snprintf(buffer, sizeof(buffer), ",%d,\"%s\",\"%s\",\"%p\",%ld]",
+            snapshot.core, phases[event.type], event.name, event.task, (long)event.value);
+        json += buffer;
+        first = false;
+    }
+    json += "]}";
+    ESP_LOGI(TAG, "Dumped %u events, %lu dropped", snapshots.size(), (unsigned long)dropped);
+    return json;
+}
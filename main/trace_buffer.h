@@ -0,0 +1,87 @@
+#ifndef TRACE_BUFFER_H
+#define TRACE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include "sdkconfig.h"
+
+/*
+ * Always-on trace buffer
+ *
+ * Every core writes timestamped binary events to its own ring buffer with a single atomic increment, the
+ * oldest events are overwritten. The buffer is dumped with the MCP tool `self.get_trace` and converted to
+ * a Chrome / Perfetto trace with scripts/trace_to_perfetto.py.
+ */
+#ifndef CONFIG_TRACE_BUFFER_EVENTS
+#define CONFIG_TRACE_BUFFER_EVENTS 256
+#endif
+
+enum TraceEventType : uint8_t {
+    kTraceEventBegin,
+    kTraceEventEnd,
+    kTraceEventInstant,
+    kTraceEventCounter,
+};
+
+struct TraceEvent {
+    uint32_t timestamp;     // esp_timer time in microseconds, wraps after 71 minutes
+    const char* name;       // Must outlive the buffer, string literals or the names of the MCP tools
+    void* task;
+    int32_t value;
+    TraceEventType type;
+};
+
+class TraceBuffer {
+public:
+    static TraceBuffer& GetInstance() {
+        static TraceBuffer instance;
+        return instance;
+    }
+    // 删除拷贝构造函数和赋值运算符
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    void Record(TraceEventType type, const char* name, int32_t value = 0);
+    // Returns the newest events of all cores sorted by time, the events written during the dump may be torn
+    std::string GetEventsJson(int max_events) const;
+
+private:
+    TraceBuffer() = default;
+
+    TraceEvent events_[portNUM_PROCESSORS][CONFIG_TRACE_BUFFER_EVENTS] = {};
+    std::atomic<uint32_t> write_index_[portNUM_PROCESSORS] = {};
+};
+
+#if CONFIG_USE_TRACE_BUFFER
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name_(name) {
+        TraceBuffer::GetInstance().Record(kTraceEventBegin, name_);
+    }
+    ~TraceScope() { TraceBuffer::GetInstance().Record(kTraceEventEnd, name_); }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_BEGIN(name) TraceBuffer::GetInstance().Record(kTraceEventBegin, name)
+#define TRACE_END(name) TraceBuffer::GetInstance().Record(kTraceEventEnd, name)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name, value) TraceBuffer::GetInstance().Record(kTraceEventInstant, name, value)
+#define TRACE_COUNTER(name, value) TraceBuffer::GetInstance().Record(kTraceEventCounter, name, value)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_INSTANT(name, value) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#endif
+
+#endif // TRACE_BUFFER_H
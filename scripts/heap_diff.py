@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+'''
+  Compare two heap snapshots of the heap profiler (CONFIG_USE_HEAP_PROFILER).
+
+  A snapshot can be the result of the MCP tool self.get_heap_stats (the tool result text, the
+  JSON-RPC reply, or the file saved by mock_server.py --mcp-save), or a serial log with the
+  periodic "Snapshot: {...}" lines. With a single log file, its first and last snapshots are compared.
+'''
+import argparse
+import json
+import re
+
+SNAPSHOT_PATTERN = re.compile(r'Snapshot: (\{.*\})')
+
+
+def load_snapshots(path):
+    with open(path, encoding='utf-8', errors='replace') as f:
+        text = f.read()
+    try:
+        data = json.loads(text)
+    except json.JSONDecodeError:
+        # A log file, strip the ANSI colors of the console
+        text = re.sub(r'\x1b\[[0-9;]*m', '', text)
+        return [json.loads(m.group(1)) for m in SNAPSHOT_PATTERN.finditer(text)]
+    if 'result' in data:
+        data = data['result']
+    if 'content' in data:
+        data = json.loads(data['content'][0]['text'])
+    return [data]
+
+
+def format_delta(value):
+    return f'{value:+d}' if value else '0'
+
+
+def compare(before, after):
+    print(f"Uptime: {before['uptime_s']}s -> {after['uptime_s']}s")
+    print(f"Tracked allocations: {before['tracked']} -> {after['tracked']}, "
+          f"untracked: {before['untracked']} -> {after['untracked']}")
+    print()
+
+    print(f"{'region':<10} {'free':>10} {'delta':>10} {'min_free':>10} {'largest':>10} {'frag %':>10}")
+    for region, stats in after['regions'].items():
+        old = before['regions'].get(region, {})
+        print(f"{region:<10} {stats['free']:>10} {format_delta(stats['free'] - old.get('free', 0)):>10} "
+              f"{stats['min_free']:>10} {stats['largest_free_block']:>10} "
+              f"{str(old.get('fragmentation', '-')) + ' -> ' + str(stats['fragmentation']):>10}")
+    print()
+
+    rows = []
+    for tag in sorted(set(before['tags']) | set(after['tags'])):
+        old_regions = before['tags'].get(tag, {})
+        new_regions = after['tags'].get(tag, {})
+        for region in sorted(set(old_regions) | set(new_regions)):
+            old = old_regions.get(region, {})
+            new = new_regions.get(region, {})
+            rows.append((tag, region,
+                         new.get('live_bytes', 0), new.get('live_bytes', 0) - old.get('live_bytes', 0),
+                         new.get('live_count', 0) - old.get('live_count', 0),
+                         new.get('peak_bytes', 0), new.get('allocs', 0) - old.get('allocs', 0)))
+    # The biggest growth first, a steady growth between snapshots is usually a leak
+    rows.sort(key=lambda row: row[3], reverse=True)
+
+    print(f"{'tag':<10} {'region':<10} {'live':>10} {'delta':>10} {'count':>8} {'peak':>10} {'allocs':>8}")
+    for tag, region, live, delta, count, peak, allocs in rows:
+        print(f"{tag:<10} {region:<10} {live:>10} {format_delta(delta):>10} {format_delta(count):>8} "
+              f"{peak:>10} {format_delta(allocs):>8}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two heap snapshots of self.get_heap_stats')
+    parser.add_argument('before', help='the first snapshot, or a log file with several snapshots')
+    parser.add_argument('after', nargs='?', help='the second snapshot')
+    args = parser.parse_args()
+
+    snapshots = load_snapshots(args.before)
+    if args.after:
+        snapshots = snapshots[:1] + load_snapshots(args.after)[-1:]
+    if len(snapshots) < 2:
+        parser.error('two snapshots are needed')
+    compare(snapshots[0], snapshots[-1])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,715 @@
+'''
+  Local stand-in for the xiaozhi conversation backend.
+
+  - OTA endpoint (HTTP) hands out websocket or mqtt config to the device
+  - Websocket server with binary protocol v1/v2/v3
+  - Minimal MQTT 3.1.1 broker (QoS 0/1, no TLS) + AES-CTR encrypted UDP audio channel
+  - Scripted conversation: stt -> llm emotion -> tts start/sentence_start -> replayed Opus (.p3) -> tts stop
+  - MCP initialize / tools/list (and optional tools/call) after each hello
+  - Optional CBOR control / MCP messages (--cbor), negotiated in the hello features
+  - Downlink impairments: fixed delay, jitter, loss and reordering, driven by a seeded RNG
+  - Per-session latency / throughput report (JSON), including the device's own last_session_stats
+'''
+import argparse
+import asyncio
+import json
+import os
+import random
+import socket
+import struct
+import time
+import uuid
+
+import cbor2
+import websockets
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+
+def now_ms():
+    return time.monotonic() * 1000
+
+
+def read_p3(path):
+    '''P3: |type 1u|reserved 1u|payload_len 2u|payload| repeated'''
+    frames = []
+    with open(path, 'rb') as f:
+        while True:
+            header = f.read(4)
+            if len(header) < 4:
+                break
+            _, _, length = struct.unpack('>BBH', header)
+            frames.append(f.read(length))
+    return frames
+
+
+def get_local_ip():
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    try:
+        s.connect(('10.255.255.255', 1))
+        return s.getsockname()[0]
+    except OSError:
+        return '127.0.0.1'
+    finally:
+        s.close()
+
+
+class Impairment:
+    '''Applies delay / jitter / loss / reordering to downlink audio frames'''
+
+    def __init__(self, delay_ms, jitter_ms, loss, reorder, seed):
+        self.delay_ms = delay_ms
+        self.jitter_ms = jitter_ms
+        self.loss = loss
+        self.reorder = reorder
+        self.rng = random.Random(seed)
+        self.held = None
+        self.dropped = 0
+        self.reordered = 0
+
+    def plan(self, frame):
+        '''Returns a list of (extra_delay_ms, frame) to send for this input frame'''
+        if self.loss > 0 and self.rng.random() < self.loss:
+            self.dropped += 1
+            return []
+        out = []
+        if self.held is None and self.reorder > 0 and self.rng.random() < self.reorder:
+            # Hold this frame and send it after the next one
+            self.held = frame
+            self.reordered += 1
+            return []
+        out.append(frame)
+        if self.held is not None:
+            out.append(self.held)
+            self.held = None
+        delay = self.delay_ms
+        if self.jitter_ms > 0:
+            delay += self.rng.uniform(0, self.jitter_ms)
+        return [(delay, f) for f in out]
+
+    def flush(self):
+        if self.held is None:
+            return []
+        frame, self.held = self.held, None
+        return [(self.delay_ms, frame)]
+
+
+class Session:
+    '''Transport independent conversation logic, subclasses implement send_message / send_audio'''
+
+    def __init__(self, server, name):
+        self.server = server
+        self.args = server.args
+        self.name = name
+        self.session_id = str(uuid.uuid4())
+        self.impairment = Impairment(self.args.delay, self.args.jitter, self.args.loss,
+                                     self.args.reorder, self.args.seed)
+        self.cbor = False
+        self.listening = False
+        self.listen_mode = 'auto'
+        self.turn_end_time = None
+        self.tts_task = None
+        self.next_mcp_id = 1
+        self.mcp_pending = {}
+        self.mcp_progress = {}
+        self.mcp_frames = 0
+        self.start_time = now_ms()
+        self.report = {
+            'session_id': self.session_id,
+            'transport': name,
+            'turns': [],
+            'uplink': {'packets': 0, 'bytes': 0, 'lost': 0, 'jitter_ms': 0.0},
+            'downlink': {'packets': 0, 'bytes': 0, 'dropped': 0, 'reordered': 0},
+            'mcp': [],
+            'device_stats': None,
+        }
+        self.last_uplink_time = None
+        self.last_uplink_sequence = None
+        self.turn_audio_ms = 0
+
+    def log(self, message):
+        print(f'[{self.name} {self.session_id[:8]}] {message}')
+
+    async def send_json(self, message):
+        if self.cbor and message.get('type') != 'hello':
+            await self.send_message(cbor2.dumps(message), True)
+        else:
+            await self.send_message(json.dumps(message, ensure_ascii=False), False)
+
+    async def send_message(self, data, binary):
+        raise NotImplementedError
+
+    async def send_audio(self, payload, timestamp):
+        raise NotImplementedError
+
+    def server_hello(self):
+        features = {'cbor': True} if self.cbor else {}
+        return {
+            'type': 'hello',
+            'features': features,
+            'transport': 'websocket',
+            'session_id': self.session_id,
+            'audio_params': {
+                'format': 'opus',
+                'sample_rate': self.args.sample_rate,
+                'channels': 1,
+                'frame_duration': self.args.frame_duration,
+            },
+        }
+
+    async def on_json(self, message):
+        msg_type = message.get('type')
+        if msg_type == 'hello':
+            stats = message.get('last_session_stats')
+            if stats is not None:
+                self.report['device_stats'] = stats
+            self.cbor = self.args.cbor and message.get('features', {}).get('cbor', False)
+            await self.send_json(self.server_hello())
+            asyncio.ensure_future(self.run_mcp())
+        elif msg_type == 'listen':
+            state = message.get('state')
+            if state == 'start':
+                self.listening = True
+                self.listen_mode = message.get('mode', 'auto')
+                self.turn_audio_ms = 0
+                self.log(f'listen start ({self.listen_mode})')
+            elif state == 'stop':
+                self.log('listen stop')
+                self.listening = False
+                await self.end_turn()
+            elif state == 'detect':
+                self.log(f'wake word: {message.get("text")}')
+        elif msg_type == 'abort':
+            self.log(f'abort ({message.get("reason", "")})')
+            if self.tts_task is not None:
+                self.tts_task.cancel()
+        elif msg_type == 'mcp':
+            self.on_mcp(message.get('payload', {}))
+        elif msg_type == 'goodbye':
+            stats = message.get('stats')
+            if stats is not None:
+                self.report['device_stats'] = stats
+            self.log('goodbye')
+
+    def on_audio(self, payload, sequence=None):
+        now = now_ms()
+        uplink = self.report['uplink']
+        if self.last_uplink_time is not None:
+            # Inter-arrival jitter (RFC 3550), same estimator as the device side
+            deviation = abs(now - self.last_uplink_time - self.args.frame_duration)
+            uplink['jitter_ms'] += (deviation - uplink['jitter_ms']) / 16
+        self.last_uplink_time = now
+        if sequence is not None:
+            if self.last_uplink_sequence is not None and sequence > self.last_uplink_sequence + 1:
+                uplink['lost'] += sequence - self.last_uplink_sequence - 1
+            self.last_uplink_sequence = sequence
+        uplink['packets'] += 1
+        uplink['bytes'] += len(payload)
+
+        if self.listening and self.listen_mode != 'manual':
+            # There is no VAD here, end the turn after a fixed amount of speech
+            self.turn_audio_ms += self.args.frame_duration
+            if self.turn_audio_ms >= self.args.turn_ms:
+                self.turn_audio_ms = 0
+                asyncio.ensure_future(self.end_turn())
+
+    async def end_turn(self):
+        if self.tts_task is not None and not self.tts_task.done():
+            return
+        self.turn_end_time = now_ms()
+        self.tts_task = asyncio.ensure_future(self.reply())
+
+    async def reply(self):
+        turn = {'start': round(self.turn_end_time - self.start_time)}
+        try:
+            await self.send_json({'session_id': self.session_id, 'type': 'stt', 'text': self.args.stt_text})
+            await self.send_json({'session_id': self.session_id, 'type': 'llm', 'emotion': 'happy', 'text': '😀'})
+            await asyncio.sleep(self.args.think_ms / 1000)
+            await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'start'})
+            turn['tts_start_ms'] = round(now_ms() - self.turn_end_time)
+            await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'sentence_start',
+                                  'text': self.args.reply_text})
+
+            # Pace the frames at real time, the impairment adds delay on top of the schedule
+            frames = self.server.tts_frames
+            start = now_ms()
+            pending = []
+            for i, frame in enumerate(frames):
+                due = start + i * self.args.frame_duration
+                for extra, f in self.impairment.plan(frame):
+                    pending.append(asyncio.ensure_future(self.send_delayed(due + extra, f, i * self.args.frame_duration)))
+                if i == 0:
+                    turn['first_audio_ms'] = round(now_ms() + self.args.delay - self.turn_end_time)
+                await asyncio.sleep(max(0, due + self.args.frame_duration - now_ms()) / 1000)
+            for extra, f in self.impairment.flush():
+                pending.append(asyncio.ensure_future(self.send_delayed(now_ms() + extra, f, 0)))
+            if pending:
+                await asyncio.gather(*pending)
+
+            await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'stop'})
+            turn['duration_ms'] = round(now_ms() - self.turn_end_time)
+        except asyncio.CancelledError:
+            turn['aborted'] = True
+            await self.send_json({'session_id': self.session_id, 'type': 'tts', 'state': 'stop'})
+        finally:
+            self.report['turns'].append(turn)
+            self.log(f'turn {turn}')
+
+    async def send_delayed(self, due, frame, timestamp):
+        await asyncio.sleep(max(0, due - now_ms()) / 1000)
+        await self.send_audio(frame, timestamp)
+        downlink = self.report['downlink']
+        downlink['packets'] += 1
+        downlink['bytes'] += len(frame)
+
+    async def run_mcp(self):
+        '''Requests are sent one at a time, so the latency doesn't include queueing on the device'''
+        try:
+            await self.call_mcp('initialize', {
+                'protocolVersion': '2024-11-05',
+                'capabilities': {},
+                'clientInfo': {'name': 'xiaozhi-mock-server', 'version': '1.0.0'},
+            })
+            for _ in range(self.args.mcp_repeat):
+                cursor = ''
+                while True:
+                    result = await self.call_mcp('tools/list', {'cursor': cursor})
+                    cursor = result.get('result', {}).get('nextCursor') if result else None
+                    if not cursor:
+                        break
+                if self.args.mcp_call:
+                    name, _, arguments = self.args.mcp_call.partition(':')
+                    params = {'name': name, 'arguments': json.loads(arguments or '{}')}
+                    if self.args.mcp_batch > 1:
+                        await self.call_mcp_batch([('tools/call', params)] * self.args.mcp_batch)
+                    else:
+                        result = await self.call_mcp('tools/call', params, cancel_ms=self.args.mcp_cancel_ms)
+                        if result and self.args.mcp_save:
+                            with open(self.args.mcp_save, 'w', encoding='utf-8') as f:
+                                json.dump(result, f, ensure_ascii=False)
+        except (asyncio.TimeoutError, websockets.ConnectionClosed, ConnectionError):
+            pass
+
+    async def call_mcp(self, method, params, cancel_ms=0):
+        mcp_id = self.next_mcp_id
+        self.next_mcp_id += 1
+        future = asyncio.get_running_loop().create_future()
+        self.mcp_pending[mcp_id] = (method, now_ms(), future)
+        if method == 'tools/call':
+            # The request id doubles as the progress token
+            params = dict(params, _meta={'progressToken': mcp_id})
+        await self.send_json({'session_id': self.session_id, 'type': 'mcp', 'payload': {
+            'jsonrpc': '2.0', 'id': mcp_id, 'method': method, 'params': params}})
+        if cancel_ms <= 0:
+            return await asyncio.wait_for(future, 30)
+        try:
+            return await asyncio.wait_for(asyncio.shield(future), cancel_ms / 1000)
+        except asyncio.TimeoutError:
+            # The device must not reply to a cancelled request
+            self.mcp_pending.pop(mcp_id, None)
+            await self.send_json({'session_id': self.session_id, 'type': 'mcp', 'payload': {
+                'jsonrpc': '2.0', 'method': 'notifications/cancelled',
+                'params': {'requestId': mcp_id, 'reason': 'Cancelled by the mock server'}}})
+            entry = {'method': method, 'cancelled_ms': cancel_ms, **self.mcp_progress.pop(mcp_id, {})}
+            self.report['mcp'].append(entry)
+            self.log(f'mcp {method}: cancelled after {cancel_ms} ms')
+            return None
+
+    async def call_mcp_batch(self, requests):
+        '''All the requests go out in one JSON-RPC batch array, the device replies with one array as well'''
+        loop = asyncio.get_running_loop()
+        batch, futures = [], []
+        for method, params in requests:
+            mcp_id = self.next_mcp_id
+            self.next_mcp_id += 1
+            future = loop.create_future()
+            self.mcp_pending[mcp_id] = (method, now_ms(), future)
+            futures.append(future)
+            batch.append({'jsonrpc': '2.0', 'id': mcp_id, 'method': method, 'params': params})
+        sent_time = now_ms()
+        frames = self.mcp_frames
+        await self.send_json({'session_id': self.session_id, 'type': 'mcp', 'payload': batch})
+        await asyncio.wait_for(asyncio.gather(*futures), 30)
+        latency = round(now_ms() - sent_time)
+        self.report['mcp'].append({'method': 'batch', 'requests': len(batch), 'latency_ms': latency,
+                                   'reply_frames': self.mcp_frames - frames})
+        self.log(f'mcp batch of {len(batch)}: {latency} ms, {self.mcp_frames - frames} reply frames')
+
+    def on_mcp(self, payload):
+        self.mcp_frames += 1
+        for message in payload if isinstance(payload, list) else [payload]:
+            self.on_mcp_message(message)
+
+    def on_mcp_message(self, payload):
+        if payload.get('method') == 'notifications/progress':
+            params = payload.get('params', {})
+            token = params.get('progressToken')
+            pending = self.mcp_pending.get(token)
+            if pending is not None:
+                progress = self.mcp_progress.setdefault(token, {'progress': 0})
+                progress['progress'] += 1
+                progress.setdefault('first_progress_ms', round(now_ms() - pending[1]))
+            self.log(f'mcp progress {token}: {params.get("progress")} {params.get("message", "")}')
+            return
+        mcp_id = payload.get('id')
+        pending = self.mcp_pending.pop(mcp_id, None)
+        if pending is None:
+            return
+        method, sent_time, future = pending
+        latency = round(now_ms() - sent_time)
+        entry = {'method': method, 'latency_ms': latency, 'bytes': len(json.dumps(payload)),
+                 'cbor_bytes': len(cbor2.dumps(payload)), **self.mcp_progress.pop(mcp_id, {})}
+        if 'error' in payload:
+            entry['error'] = payload['error']
+        self.report['mcp'].append(entry)
+        self.log(f'mcp {method}: {latency} ms')
+        if not future.done():
+            future.set_result(payload)
+
+    def mcp_summary(self):
+        summary = {}
+        for entry in self.report['mcp']:
+            if 'latency_ms' not in entry:
+                continue
+            summary.setdefault(entry['method'], []).append(entry['latency_ms'])
+        return {method: {'count': len(values), 'avg_ms': round(sum(values) / len(values), 1),
+                         'min_ms': min(values), 'max_ms': max(values)} for method, values in summary.items()}
+
+    def close(self):
+        if self.tts_task is not None:
+            self.tts_task.cancel()
+        duration = now_ms() - self.start_time
+        self.report['duration_ms'] = round(duration)
+        self.report['uplink']['jitter_ms'] = round(self.report['uplink']['jitter_ms'], 1)
+        self.report['uplink']['kbps'] = round(self.report['uplink']['bytes'] * 8 / duration, 1) if duration > 0 else 0
+        self.report['downlink']['kbps'] = round(self.report['downlink']['bytes'] * 8 / duration, 1) if duration > 0 else 0
+        self.report['downlink']['dropped'] = self.impairment.dropped
+        self.report['downlink']['reordered'] = self.impairment.reordered
+        self.report['mcp_summary'] = self.mcp_summary()
+        self.server.finish_session(self)
+
+
+class WebsocketSession(Session):
+    def __init__(self, server, websocket, version):
+        super().__init__(server, f'ws-v{version}')
+        self.websocket = websocket
+        self.version = version
+
+    async def send_message(self, data, binary):
+        if binary:
+            await self.send_audio(data, 0, 2)
+        else:
+            await self.websocket.send(data)
+
+    async def send_audio(self, payload, timestamp, payload_type=0):
+        if self.version == 2:
+            data = struct.pack('>HHIII', 2, payload_type, 0, timestamp, len(payload)) + payload
+        elif self.version == 3:
+            data = struct.pack('>BBH', payload_type, 0, len(payload)) + payload
+        else:
+            data = payload
+        try:
+            await self.websocket.send(data)
+        except websockets.ConnectionClosed:
+            pass
+
+    def parse_binary(self, data):
+        '''Returns (type, payload), type 0 is Opus and 2 is CBOR'''
+        if self.version == 2:
+            _, payload_type, _, _, size = struct.unpack('>HHIII', data[:16])
+            return payload_type, data[16:16 + size]
+        elif self.version == 3:
+            payload_type, _, size = struct.unpack('>BBH', data[:4])
+            return payload_type, data[4:4 + size]
+        return 0, data
+
+
+class UdpSession(Session):
+    def __init__(self, server, mqtt_client):
+        super().__init__(server, 'mqtt-udp')
+        self.mqtt_client = mqtt_client
+        self.key = os.urandom(16)
+        self.ssrc = random.getrandbits(32)
+        self.local_sequence = 0
+        self.udp_address = None
+
+    def server_hello(self):
+        hello = super().server_hello()
+        hello['transport'] = 'udp'
+        nonce = struct.pack('>BBHIII', 0x01, 0, 0, self.ssrc, 0, 0)
+        hello['udp'] = {
+            'server': self.args.host_ip,
+            'port': self.args.udp_port,
+            'key': self.key.hex(),
+            'nonce': nonce.hex(),
+        }
+        return hello
+
+    async def send_message(self, data, binary):
+        await self.mqtt_client.publish(data if binary else data.encode())
+
+    async def send_audio(self, payload, timestamp):
+        if self.udp_address is None:
+            return
+        self.local_sequence += 1
+        nonce = struct.pack('>BBHIII', 0x01, 0, len(payload), self.ssrc, timestamp, self.local_sequence)
+        encryptor = Cipher(algorithms.AES(self.key), modes.CTR(nonce)).encryptor()
+        self.server.udp_transport.sendto(nonce + encryptor.update(payload), self.udp_address)
+
+    def on_datagram(self, data, address):
+        '''|type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|payload|'''
+        self.udp_address = address
+        nonce = data[:16]
+        _, _, size, _, _, sequence = struct.unpack('>BBHIII', nonce)
+        decryptor = Cipher(algorithms.AES(self.key), modes.CTR(nonce)).decryptor()
+        self.on_audio(decryptor.update(data[16:16 + size]), sequence)
+
+
+class MqttClient:
+    '''One device connection on the built-in broker'''
+
+    def __init__(self, server, reader, writer):
+        self.server = server
+        self.reader = reader
+        self.writer = writer
+        self.client_id = ''
+        self.session = None
+
+    async def read_packet(self):
+        header = await self.reader.readexactly(1)
+        length, multiplier = 0, 1
+        while True:
+            byte = (await self.reader.readexactly(1))[0]
+            length += (byte & 0x7F) * multiplier
+            if byte & 0x80 == 0:
+                break
+            multiplier *= 128
+        return header[0], await self.reader.readexactly(length)
+
+    def write_packet(self, header, body):
+        length = len(body)
+        encoded = bytearray()
+        while True:
+            byte = length % 128
+            length //= 128
+            encoded.append(byte | 0x80 if length > 0 else byte)
+            if length == 0:
+                break
+        self.writer.write(bytes([header]) + bytes(encoded) + body)
+
+    async def publish(self, payload):
+        # The device never subscribes explicitly, deliver everything to it
+        topic = f'devices/p2p/{self.client_id}'.encode()
+        self.write_packet(0x30, struct.pack('>H', len(topic)) + topic + payload)
+        await self.writer.drain()
+
+    async def run(self):
+        try:
+            while True:
+                header, body = await self.read_packet()
+                packet_type = header >> 4
+                if packet_type == 1:  # CONNECT
+                    offset = 2 + struct.unpack('>H', body[:2])[0] + 4
+                    id_len = struct.unpack('>H', body[offset:offset + 2])[0]
+                    self.client_id = body[offset + 2:offset + 2 + id_len].decode()
+                    self.write_packet(0x20, b'\x00\x00')
+                    print(f'MQTT client connected: {self.client_id}')
+                elif packet_type == 3:  # PUBLISH
+                    qos = (header >> 1) & 0x03
+                    topic_len = struct.unpack('>H', body[:2])[0]
+                    offset = 2 + topic_len
+                    if qos > 0:
+                        self.write_packet(0x40, body[offset:offset + 2])
+                        offset += 2
+                    payload = body[offset:]
+                    # JSON messages start with '{', anything else is CBOR
+                    await self.on_message(json.loads(payload) if payload[:1] == b'{' else cbor2.loads(payload))
+                elif packet_type == 8:  # SUBSCRIBE
+                    packet_id = body[:2]
+                    granted, offset = bytearray(), 2
+                    while offset < len(body):
+                        topic_len = struct.unpack('>H', body[offset:offset + 2])[0]
+                        offset += 2 + topic_len
+                        granted.append(min(body[offset], 1))
+                        offset += 1
+                    self.write_packet(0x90, packet_id + bytes(granted))
+                elif packet_type == 12:  # PINGREQ
+                    self.write_packet(0xD0, b'')
+                elif packet_type == 14:  # DISCONNECT
+                    break
+                await self.writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError):
+            pass
+        finally:
+            if self.session is not None:
+                self.session.close()
+            self.writer.close()
+            print(f'MQTT client disconnected: {self.client_id}')
+
+    async def on_message(self, message):
+        if message.get('type') == 'hello':
+            if self.session is not None:
+                self.session.close()
+            self.session = UdpSession(self.server, self)
+            self.server.udp_sessions[self.session.ssrc] = self.session
+        if self.session is not None:
+            await self.session.on_json(message)
+            if message.get('type') == 'goodbye':
+                self.session.close()
+                self.session = None
+
+
+class UdpServerProtocol(asyncio.DatagramProtocol):
+    def __init__(self, server):
+        self.server = server
+
+    def datagram_received(self, data, address):
+        if len(data) < 16 or data[0] != 0x01:
+            return
+        ssrc = struct.unpack('>I', data[4:8])[0]
+        session = self.server.udp_sessions.get(ssrc)
+        if session is not None:
+            session.on_datagram(data, address)
+
+
+class MockServer:
+    def __init__(self, args):
+        self.args = args
+        self.tts_frames = read_p3(args.tts)
+        self.udp_sessions = {}
+        self.udp_transport = None
+        self.reports = []
+        self.done = asyncio.Event()
+
+    def finish_session(self, session):
+        self.udp_sessions.pop(getattr(session, 'ssrc', None), None)
+        if session.report in self.reports:
+            return
+        self.reports.append(session.report)
+        print(json.dumps(session.report, ensure_ascii=False, indent=2))
+        if self.args.report:
+            with open(self.args.report, 'w') as f:
+                json.dump(self.reports, f, ensure_ascii=False, indent=2)
+        if self.args.sessions > 0 and len(self.reports) >= self.args.sessions:
+            self.done.set()
+
+    async def handle_ota(self, reader, writer):
+        '''Answers every request (OTA check / activate) with the configured transport'''
+        try:
+            request = await reader.readuntil(b'\r\n\r\n')
+            length = 0
+            for line in request.decode(errors='ignore').split('\r\n'):
+                if line.lower().startswith('content-length:'):
+                    length = int(line.split(':', 1)[1])
+            if length > 0:
+                await reader.readexactly(length)
+            path = request.split(b' ')[1].decode()
+
+            response = {
+                'server_time': {'timestamp': int(time.time() * 1000), 'timezone_offset': 480},
+                'firmware': {'version': '0.0.0', 'url': ''},
+            }
+            if self.args.transport == 'mqtt':
+                response['mqtt'] = {
+                    'endpoint': f'{self.args.host_ip}:{self.args.mqtt_port}',
+                    'client_id': f'mock@@@{uuid.uuid4().hex[:12]}',
+                    'username': 'mock',
+                    'password': 'mock',
+                    'publish_topic': 'device-server',
+                }
+            else:
+                response['websocket'] = {
+                    'url': f'ws://{self.args.host_ip}:{self.args.ws_port}/xiaozhi/v1/',
+                    'token': 'mock-token',
+                    'version': self.args.version,
+                }
+            body = json.dumps(response).encode() if 'activate' not in path else b'{}'
+            writer.write(b'HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n'
+                         + f'Content-Length: {len(body)}\r\nConnection: close\r\n\r\n'.encode() + body)
+            await writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError, IndexError):
+            pass
+        finally:
+            writer.close()
+
+    async def handle_websocket(self, websocket, path=None):
+        request = getattr(websocket, 'request', None)
+        headers = request.headers if request is not None else websocket.request_headers
+        version = int(headers.get('Protocol-Version', '1'))
+        session = WebsocketSession(self, websocket, version)
+        session.log(f'connected, device {headers.get("Device-Id")}')
+        try:
+            async for message in websocket:
+                if isinstance(message, bytes):
+                    payload_type, payload = session.parse_binary(message)
+                    if payload_type == 2:
+                        await session.on_json(cbor2.loads(payload))
+                    else:
+                        session.on_audio(payload)
+                else:
+                    await session.on_json(json.loads(message))
+        except websockets.ConnectionClosed:
+            pass
+        finally:
+            session.close()
+
+    async def run(self):
+        loop = asyncio.get_running_loop()
+        ota = await asyncio.start_server(self.handle_ota, '0.0.0.0', self.args.ota_port)
+        ws = await websockets.serve(self.handle_websocket, '0.0.0.0', self.args.ws_port, max_size=None)
+        mqtt = await asyncio.start_server(lambda r, w: MqttClient(self, r, w).run(), '0.0.0.0', self.args.mqtt_port)
+        self.udp_transport, _ = await loop.create_datagram_endpoint(
+            lambda: UdpServerProtocol(self), local_addr=('0.0.0.0', self.args.udp_port))
+
+        print(f'OTA URL: http://{self.args.host_ip}:{self.args.ota_port}/xiaozhi/ota/ (transport: {self.args.transport})')
+        print(f'Websocket: ws://{self.args.host_ip}:{self.args.ws_port}/xiaozhi/v1/')
+        print(f'MQTT: {self.args.host_ip}:{self.args.mqtt_port}, UDP: {self.args.udp_port}')
+        print(f'TTS: {self.args.tts} ({len(self.tts_frames)} frames)')
+        try:
+            await self.done.wait()
+        finally:
+            ota.close()
+            ws.close()
+            mqtt.close()
+            self.udp_transport.close()
+
+
+if __name__ == "__main__":
+    default_tts = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', 'main', 'assets', 'zh-CN', 'welcome.p3')
+    parser = argparse.ArgumentParser(description='本地模拟对话服务器，用于不依赖云端测试 WebSocket / MQTT+UDP 协议的延迟和吞吐')
+    parser.add_argument('--transport', choices=['websocket', 'mqtt'], default='websocket',
+                        help='OTA 下发的协议 (默认: websocket)')
+    parser.add_argument('--version', type=int, choices=[1, 2, 3], default=3,
+                        help='WebSocket 二进制协议版本 (默认: 3)')
+    parser.add_argument('--host-ip', default=get_local_ip(),
+                        help='下发给设备的服务器地址 (默认: 本机局域网 IP)')
+    parser.add_argument('--ota-port', type=int, default=8002, help='OTA HTTP 端口 (默认: 8002)')
+    parser.add_argument('--ws-port', type=int, default=8003, help='WebSocket 端口 (默认: 8003)')
+    parser.add_argument('--mqtt-port', type=int, default=1883, help='MQTT 端口，无 TLS (默认: 1883)')
+    parser.add_argument('--udp-port', type=int, default=8888, help='UDP 音频端口 (默认: 8888)')
+    parser.add_argument('--tts', default=default_tts, help='回放的 P3 文件 (默认: welcome.p3)')
+    parser.add_argument('--sample-rate', type=int, default=16000, help='TTS 采样率 (默认: 16000)')
+    parser.add_argument('--frame-duration', type=int, default=60, help='Opus 帧长 ms (默认: 60)')
+    parser.add_argument('--stt-text', default='你好小智', help='模拟的识别结果')
+    parser.add_argument('--reply-text', default='你好，我是小智', help='模拟的回复文本')
+    parser.add_argument('--turn-ms', type=int, default=3000,
+                        help='auto/realtime 模式下收到多少毫秒音频后结束一轮 (默认: 3000)')
+    parser.add_argument('--think-ms', type=int, default=300, help='stt 到 tts start 的模拟处理时间 (默认: 300)')
+    parser.add_argument('--cbor', action='store_true', help='设备支持时使用 CBOR 编码控制消息和 MCP 消息')
+    parser.add_argument('--mcp-repeat', type=int, default=1, help='hello 后重复请求完整 tools/list（及 --mcp-call）的次数 (默认: 1)')
+    parser.add_argument('--mcp-call', default='', help='hello 后调用的 MCP 工具，格式 name:{"arg":1}')
+    parser.add_argument('--mcp-batch', type=int, default=1, help='把 N 个 --mcp-call 请求放在一个 JSON-RPC 批量数组中发送 (默认: 1 不使用批量)')
+    parser.add_argument('--mcp-save', default='', help='把 --mcp-call 的回复保存到文件，例如 self.get_trace 的结果')
+    parser.add_argument('--mcp-cancel-ms', type=int, default=0, help='--mcp-call 超过该时间未返回则发送 notifications/cancelled (默认: 0 不取消)')
+    parser.add_argument('--delay', type=float, default=0, help='下行音频固定延迟 ms')
+    parser.add_argument('--jitter', type=float, default=0, help='下行音频随机抖动上限 ms')
+    parser.add_argument('--loss', type=float, default=0, help='下行音频丢包率 0~1')
+    parser.add_argument('--reorder', type=float, default=0, help='下行音频乱序概率 0~1')
+    parser.add_argument('--seed', type=int, default=0, help='随机数种子，保证损伤可复现 (默认: 0)')
+    parser.add_argument('--sessions', type=int, default=0, help='完成 N 个会话后退出，0 表示一直运行')
+    parser.add_argument('--report', default='', help='报告输出的 JSON 文件')
+
+    args = parser.parse_args()
+    try:
+        asyncio.run(MockServer(args).run())
+    except KeyboardInterrupt:
+        print('\nStopping mock server...')
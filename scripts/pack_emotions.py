@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+'''
+  Pack animated emotions for the emotions partition (CONFIG_USE_EMOTION_ANIMATIONS).
+
+  Every animated GIF / WebP / PNG file in the input directory, or every directory of PNG frames,
+  becomes the animation of the emotion with the same name, e.g. happy.gif or thinking/0001.png.
+  The names are the ones of Display::SetEmotion (neutral, happy, sad, thinking...), the emotions
+  without an animation are still shown with the emoji font.
+
+  Flash the output to the partition:
+    parttool.py write_partition --partition-name emotions --input emotions.bin
+
+  The format is described in main/display/emotion_player.h. Requires Pillow.
+'''
+import argparse
+import os
+import struct
+
+from PIL import Image, ImageSequence
+
+MAGIC = b'EMOT'
+VERSION = 1
+NAME_LENGTH = 16
+HEADER_FORMAT = '<4sHH'
+ENTRY_FORMAT = '<16sHHHHI'
+MAX_COUNT = 0x8000
+# Shorter runs are cheaper as literals
+MIN_RUN = 3
+
+
+def to_rgb565(image, background):
+    '''Flatten the transparent pixels onto the background, return the little endian RGB565 pixels'''
+    canvas = Image.new('RGBA', image.size, background)
+    canvas.alpha_composite(image.convert('RGBA'))
+    pixels = []
+    for r, g, b, _ in canvas.getdata():
+        pixels.append(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3))
+    return pixels
+
+
+def encode_frame(pixels):
+    '''A run token has the high bit set and is followed by the pixel, a literal token by its pixels'''
+    tokens = []
+    literals = []
+
+    def flush_literals():
+        while literals:
+            chunk = literals[:MAX_COUNT]
+            del literals[:MAX_COUNT]
+            tokens.append(len(chunk) - 1)
+            tokens.extend(chunk)
+
+    i = 0
+    while i < len(pixels):
+        run = 1
+        while i + run < len(pixels) and run < MAX_COUNT and pixels[i + run] == pixels[i]:
+            run += 1
+        if run >= MIN_RUN:
+            flush_literals()
+            tokens.append(0x8000 | (run - 1))
+            tokens.append(pixels[i])
+        else:
+            literals.extend(pixels[i:i + run])
+        i += run
+    flush_literals()
+    return struct.pack(f'<{len(tokens)}H', *tokens)
+
+
+def load_frames(path):
+    '''Return the frames and the frame duration in ms of an animated image or a directory of frames'''
+    if os.path.isdir(path):
+        files = sorted(f for f in os.listdir(path) if f.lower().endswith('.png'))
+        return [Image.open(os.path.join(path, f)) for f in files], None
+    image = Image.open(path)
+    frames = [frame.copy() for frame in ImageSequence.Iterator(image)]
+    durations = [frame.info.get('duration', 0) for frame in ImageSequence.Iterator(image)]
+    durations = [d for d in durations if d > 0]
+    return frames, (sum(durations) / len(durations) if durations else None)
+
+
+def fit(frames, size):
+    '''Scale the frames down to fit in a size x size box, keeping the aspect ratio'''
+    width, height = frames[0].size
+    scale = min(1.0, size / max(width, height))
+    target = (max(1, round(width * scale)), max(1, round(height * scale)))
+    return [frame.convert('RGBA').resize(target, Image.LANCZOS) if frame.size != target else frame.convert('RGBA')
+            for frame in frames]
+
+
+def pack(animations):
+    '''animations: a list of (name, width, height, fps, encoded frames)'''
+    header_size = struct.calcsize(HEADER_FORMAT) + len(animations) * struct.calcsize(ENTRY_FORMAT)
+    data = bytearray()
+    entries = []
+    for name, width, height, fps, frames in animations:
+        # The frame table is 4-byte aligned and the frames 2-byte aligned, the device reads them in place
+        table_offset = header_size + len(data)
+        data += bytes(4 * (len(frames) + 1))
+        offsets = []
+        for frame in frames:
+            offsets.append(header_size + len(data))
+            data += frame
+        offsets.append(header_size + len(data))
+        data[table_offset - header_size:table_offset - header_size + 4 * len(offsets)] = \
+            struct.pack(f'<{len(offsets)}I', *offsets)
+        data += bytes(-len(data) % 4)
+        entries.append(struct.pack(ENTRY_FORMAT, name.encode('utf-8'), width, height, fps, len(frames), table_offset))
+    return struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(animations)) + b''.join(entries) + bytes(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Pack animated emotions for the emotions partition')
+    parser.add_argument('input', help='directory of animated images or directories of PNG frames')
+    parser.add_argument('-o', '--output', default='emotions.bin', help='the pack to write')
+    parser.add_argument('--size', type=int, default=64, help='the largest width or height of the frames')
+    parser.add_argument('--fps', type=int, help='the frame rate, the GIF / WebP frame durations by default')
+    parser.add_argument('--background', default='#FFFFFF', help='the color of the transparent pixels')
+    parser.add_argument('--partition-size', type=lambda s: int(s, 0), default=0x300000,
+                        help='fail if the pack is larger than the partition')
+    args = parser.parse_args()
+
+    animations = []
+    for entry in sorted(os.listdir(args.input)):
+        path = os.path.join(args.input, entry)
+        name = os.path.splitext(entry)[0] if os.path.isfile(path) else entry
+        if len(name.encode('utf-8')) > NAME_LENGTH:
+            parser.error(f'the name {name} is longer than {NAME_LENGTH} bytes')
+        try:
+            frames, duration = load_frames(path)
+        except OSError:
+            print(f'Skip {entry}, not an image')
+            continue
+        if not frames:
+            continue
+        frames = fit(frames, args.size)
+        fps = args.fps or (round(1000 / duration) if duration else 10)
+        fps = max(1, min(fps, 60))
+        width, height = frames[0].size
+        encoded = [encode_frame(to_rgb565(frame, args.background)) for frame in frames]
+        raw_size = width * height * 2 * len(frames)
+        packed_size = sum(len(frame) for frame in encoded)
+        print(f'{name}: {len(frames)} frames {width}x{height} @ {fps} fps, {raw_size} -> {packed_size} bytes')
+        animations.append((name, width, height, fps, encoded))
+
+    if not animations:
+        parser.error('no animations found')
+    data = pack(animations)
+    if len(data) > args.partition_size:
+        parser.error(f'the pack is {len(data)} bytes, larger than the partition ({args.partition_size} bytes)')
+    with open(args.output, 'wb') as f:
+        f.write(data)
+    print(f'Wrote {len(animations)} animations, {len(data)} bytes to {args.output}')
+
+
+if __name__ == '__main__':
+    main()
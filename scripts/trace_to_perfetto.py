@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+'''
+  Convert the trace buffer dump of the MCP tool self.get_trace to the Chrome trace event format.
+  Open the output with https://ui.perfetto.dev or chrome://tracing.
+
+  The input can be the tool result text, the JSON-RPC reply, or the file saved by
+  mock_server.py --mcp-save.
+'''
+import argparse
+import json
+
+
+def load_dump(path):
+    with open(path, encoding='utf-8') as f:
+        data = json.load(f)
+    if 'result' in data:
+        data = data['result']
+    if 'content' in data:
+        data = json.loads(data['content'][0]['text'])
+    return data
+
+
+def convert(dump):
+    tasks = dump.get('tasks', {})
+    tids = {}
+    open_spans = {}
+    events = []
+
+    for ts, core, phase, name, task, value in dump['events']:
+        tid = tids.setdefault(task, len(tids) + 1)
+        event = {'name': name, 'ph': phase, 'ts': ts, 'pid': 1, 'tid': tid}
+        if phase == 'B':
+            open_spans.setdefault(tid, []).append(name)
+            event['args'] = {'core': core}
+        elif phase == 'E':
+            # The begin event may have been overwritten in the ring buffer
+            stack = open_spans.get(tid)
+            if not stack or name not in stack:
+                continue
+            while stack.pop() != name:
+                pass
+        elif phase == 'i':
+            event['s'] = 't'
+            event['args'] = {'value': value, 'core': core}
+        elif phase == 'C':
+            event['args'] = {name: value}
+        events.append(event)
+
+    events.append({'name': 'process_name', 'ph': 'M', 'pid': 1, 'args': {'name': 'xiaozhi'}})
+    for task, tid in tids.items():
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 1, 'tid': tid,
+                       'args': {'name': tasks.get(task, task)}})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms',
+            'otherData': {'now_us': dump.get('now_us'), 'dropped': dump.get('dropped')}}
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Convert a self.get_trace dump to a Perfetto / Chrome trace')
+    parser.add_argument('input', help='the dump of self.get_trace')
+    parser.add_argument('-o', '--output', default='trace.json', help='the output file (default: trace.json)')
+    args = parser.parse_args()
+
+    trace = convert(load_dump(args.input))
+    with open(args.output, 'w', encoding='utf-8') as f:
+        json.dump(trace, f)
+    print(f'Wrote {len(trace["traceEvents"])} events to {args.output}')
+
+
+if __name__ == '__main__':
+    main()